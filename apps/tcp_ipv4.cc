@@ -1,6 +1,7 @@
 #include "bidirectional_stream_copy.hh"
 #include "tcp_config.hh"
 #include "tcp_minnow_socket.hh"
+#include "tcp_minnow_stack.hh"
 #include "tun.hh"
 
 #include <cstdint>
@@ -10,6 +11,9 @@
 #include <random>
 #include <span>
 #include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
 #include <tuple>
 
 using namespace std;
@@ -27,12 +31,21 @@ void show_usage( const char* argv0, const char* msg )
        << "   -l              Server (listen) mode.                           (client mode)\n"
        << "                   In server mode, <host>:<port> is the address to bind.\n\n"
 
+       << "   -e              Echo server: with -l, serve any number of       (one client, stdin/stdout)\n"
+       << "                   clients at once, sending each one's bytes back.\n"
+       << "                   (Loss options don't apply.)\n\n"
+
        << "   -a <addr>       Set source address (client mode only)           " << LOCAL_ADDRESS_DFLT << "\n"
        << "   -s <port>       Set source port (client mode only)              (random)\n\n"
 
        << "   -w <winsz>      Use a window of <winsz> bytes                   " << TCPConfig::MAX_PAYLOAD_SIZE
        << "\n\n"
 
+       << "   -m <mss>        Use segments of up to <mss> payload bytes       " << TCPConfig::MAX_PAYLOAD_SIZE
+       << "\n"
+       << "   -p              Probe the path for the largest segment size     (off)\n"
+       << "                   it carries, up to <mss> (RFC 4821).\n\n"
+
        << "   -t <tmout>      Set rt_timeout to tmout                         " << TCPConfig::TIMEOUT_DFLT << "\n\n"
 
        << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n\n"
@@ -56,7 +69,7 @@ void check_argc( const span<char*>& args, size_t curr, const char* err )
   }
 }
 
-tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char*>& args )
+tuple<TCPConfig, FdAdapterConfig, bool, bool, const char*> get_config( const span<char*>& args )
 {
   TCPConfig c_fsm {};
   c_fsm.isn = Wrap32 { random_device()() };
@@ -66,6 +79,7 @@ tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char
 
   size_t curr = 1;
   bool listen = false;
+  bool echo = false;
   const size_t argc = args.size();
 
   string source_address = LOCAL_ADDRESS_DFLT;
@@ -76,6 +90,10 @@ tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char
       listen = true;
       curr += 1;
 
+    } else if ( strncmp( "-e", args[curr], 3 ) == 0 ) {
+      echo = true;
+      curr += 1;
+
     } else if ( strncmp( "-a", args[curr], 3 ) == 0 ) {
       check_argc( args, curr, "ERROR: -a requires one argument." );
       source_address = args[curr + 1];
@@ -89,8 +107,18 @@ tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char
     } else if ( strncmp( "-w", args[curr], 3 ) == 0 ) {
       check_argc( args, curr, "ERROR: -w requires one argument." );
       c_fsm.recv_capacity = strtol( args[curr + 1], nullptr, 0 );
+      c_fsm.window_scaling = c_fsm.recv_capacity > UINT16_MAX;
       curr += 2;
 
+    } else if ( strncmp( "-m", args[curr], 3 ) == 0 ) {
+      check_argc( args, curr, "ERROR: -m requires one argument." );
+      c_fsm.mss = static_cast<uint16_t>( strtol( args[curr + 1], nullptr, 0 ) );
+      curr += 2;
+
+    } else if ( strncmp( "-p", args[curr], 3 ) == 0 ) {
+      c_fsm.pmtu_discovery = true;
+      curr += 1;
+
     } else if ( strncmp( "-t", args[curr], 3 ) == 0 ) {
       check_argc( args, curr, "ERROR: -t requires one argument." );
       c_fsm.rt_timeout = strtol( args[curr + 1], nullptr, 0 );
@@ -139,7 +167,39 @@ tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char
     c_filt.source = { source_address, source_port };
   }
 
-  return make_tuple( c_fsm, c_filt, listen, tundev );
+  if ( echo and not listen ) {
+    show_usage( args[0], "ERROR: -e requires -l." );
+    exit( 1 );
+  }
+
+  return make_tuple( c_fsm, c_filt, listen, echo, tundev );
+}
+
+// Accept clients forever, each served by its own thread that sends the client's bytes back to it
+[[noreturn]] void serve_echo( const TCPConfig& c_fsm, const Address& local, const char* tun_dev_name )
+{
+  TCPMinnowStack stack { TunFD( tun_dev_name ) };
+  stack.listen( c_fsm, local );
+  cerr << "DEBUG: minnow echo server listening on port " << local.port() << "...\n";
+
+  while ( true ) {
+    auto [socket, peer] = stack.accept( local );
+    cerr << "DEBUG: minnow new connection from " << peer.to_string() << ".\n";
+    thread( [client = std::move( socket )]() mutable {
+      try {
+        string buffer;
+        while ( not client.eof() ) {
+          client.read( buffer );
+          for ( string_view rest = buffer; not rest.empty(); ) {
+            rest.remove_prefix( client.write( rest ) );
+          }
+        }
+        client.shutdown( SHUT_WR );
+      } catch ( const exception& e ) {
+        cerr << "Exception in echo client: " << e.what() << endl;
+      }
+    } ).detach();
+  }
 }
 } // namespace
 
@@ -157,7 +217,11 @@ int main( int argc, char** argv )
       return EXIT_FAILURE;
     }
 
-    auto [c_fsm, c_filt, listen, tun_dev_name] = get_config( args );
+    auto [c_fsm, c_filt, listen, echo, tun_dev_name] = get_config( args );
+    if ( echo ) {
+      serve_echo( c_fsm, c_filt.source, tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name );
+    }
+
     LossyTCPOverIPv4MinnowSocket tcp_socket( LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>(
       TCPOverIPv4OverTunFdAdapter( TunFD( tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name ) ) ) );
 
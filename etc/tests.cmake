@@ -23,6 +23,7 @@ ttest(byte_stream_one_write)
 ttest(byte_stream_two_writes)
 ttest(byte_stream_many_writes)
 ttest(byte_stream_stress_test)
+ttest(byte_stream_chunked)
 
 ttest(reassembler_single)
 ttest(reassembler_cap)
@@ -31,6 +32,7 @@ ttest(reassembler_dup)
 ttest(reassembler_holes)
 ttest(reassembler_overlapping)
 ttest(reassembler_win)
+ttest(reassembler_bitmap)
 
 ttest(wrapping_integers_cmp)
 ttest(wrapping_integers_wrap)
@@ -45,6 +47,8 @@ ttest(recv_reorder)
 ttest(recv_reorder_more)
 ttest(recv_close)
 ttest(recv_special)
+ttest(recv_window_scale)
+ttest(recv_sack)
 
 ttest(send_connect)
 ttest(send_transmit)
@@ -53,6 +57,22 @@ ttest(send_window)
 ttest(send_ack)
 ttest(send_close)
 ttest(send_extra)
+ttest(send_fast_retx)
+ttest(send_rto)
+ttest(send_congestion)
+ttest(send_sack)
+ttest(send_mss)
+ttest(send_nagle)
+ttest(send_pacing)
+ttest(peer_delayed_ack)
+ttest(peer_syn_options)
+ttest(timer_wheel)
+ttest(eventloop_epoll)
+ttest(io_uring_rw)
+ttest(spsc_queue)
+ttest(tcp_minnow_stack)
+ttest(packet_buffer)
+ttest(checksum)
 
 ttest(net_interface)
 
@@ -90,3 +110,4 @@ set_tests_properties(${compile_name_opt} PROPERTIES FIXTURES_SETUP compile_opt)
 
 stest(byte_stream_speed_test)
 stest(reassembler_speed_test)
+stest(checksum_speed_test)
@@ -1,9 +1,15 @@
 #include "byte_stream.hh"
 
+#include <algorithm>
+
 using namespace std;
 
-ByteStream::ByteStream( uint64_t capacity )
-  : finish_write_( false ), tot_write_( 0 ), stream_( std::queue<char> {} ), capacity_( capacity )
+ByteStream::ByteStream( uint64_t capacity, Storage storage )
+  : finish_write_( false )
+  , tot_write_( 0 )
+  , storage_( storage )
+  , buffer_( storage == Storage::Ring ? capacity : 0, '\0' )
+  , capacity_( capacity )
 {}
 
 bool Writer::is_closed() const
@@ -13,14 +19,30 @@ bool Writer::is_closed() const
 
 void Writer::push( string data )
 {
-  for ( char x : data ) {
-    if ( stream_.size() == capacity_ ) {
-      break;
+  const uint64_t len = min( static_cast<uint64_t>( data.size() ), available_capacity() );
+  if ( len == 0 ) {
+    return;
+  }
+  size_ += len;
+  tot_write_ += len;
+
+  if ( storage_ == Storage::Chunked ) {
+    // 截断到可用容量（不会重新分配），然后直接接管字符串
+    data.resize( len );
+    // 只有当内容远小于字符串的分配时才复制一次（例如 64 KiB 的读缓冲里只有几个字节），
+    // 否则许多短 push 会各占一整块缓冲，内存远超容量；通常的 push 都不会复制
+    if ( data.capacity() - len > MAX_CHUNK_SLACK and data.capacity() > 4 * len ) {
+      data.shrink_to_fit();
     }
-    stream_.push( x );
-    tot_write_++;
+    chunks_.push_back( move( data ) );
+    return;
   }
-  return;
+
+  // 写入位置为环形缓冲区的尾部，最多分两段拷贝
+  const uint64_t tail = ( head_ + size_ - len ) % capacity_;
+  const uint64_t first = min( len, capacity_ - tail );
+  copy_n( data.data(), first, buffer_.data() + tail );
+  copy_n( data.data() + first, len - first, buffer_.data() );
 }
 
 void Writer::close()
@@ -30,7 +52,7 @@ void Writer::close()
 
 uint64_t Writer::available_capacity() const
 {
-  return capacity_ - stream_.size();
+  return capacity_ - size_;
 }
 
 uint64_t Writer::bytes_pushed() const
@@ -40,34 +62,46 @@ uint64_t Writer::bytes_pushed() const
 
 bool Reader::is_finished() const
 {
-  return finish_write_ && stream_.size() == 0;
+  return finish_write_ && size_ == 0;
 }
 
 uint64_t Reader::bytes_popped() const
 {
-  return tot_write_ - stream_.size();
+  return tot_write_ - size_;
 }
 
 string_view Reader::peek() const
 {
-  if ( is_finished() || stream_.empty() ) {
-    return string_view( "" );
+  if ( storage_ == Storage::Chunked ) {
+    return chunks_.empty() ? string_view {} : string_view( chunks_.front() ).substr( chunk_skip_ );
   }
-  string_view result( &stream_.front(), 1 );
-  return result;
+  // 返回从 head_ 开始的最长连续可读区间
+  return string_view( buffer_ ).substr( head_, min( size_, capacity_ - head_ ) );
 }
 
 void Reader::pop( uint64_t len )
 {
-  while ( len-- ) {
-    if ( stream_.empty() ) {
-      break;
+  len = min( len, size_ );
+  size_ -= len;
+
+  if ( storage_ == Storage::Chunked ) {
+    while ( len ) {
+      const uint64_t to_pop_now = min( len, chunks_.front().size() - chunk_skip_ );
+      chunk_skip_ += to_pop_now;
+      len -= to_pop_now;
+      if ( chunk_skip_ == chunks_.front().size() ) {
+        chunks_.pop_front();
+        chunk_skip_ = 0;
+      }
     }
-    stream_.pop();
+    return;
   }
+
+  // 缓冲区清空时回到起点，使后续写入尽量连续
+  head_ = size_ == 0 ? 0 : ( head_ + len ) % capacity_;
 }
 
 uint64_t Reader::bytes_buffered() const
 {
-  return stream_.size();
+  return size_;
 }
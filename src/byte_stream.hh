@@ -1,7 +1,7 @@
 #pragma once
 
 #include <cstdint>
-#include <queue>
+#include <deque>
 #include <string>
 #include <string_view>
 
@@ -11,7 +11,14 @@ class Writer;
 class ByteStream
 {
 public:
-  explicit ByteStream( uint64_t capacity );
+  // How buffered bytes are stored
+  enum class Storage
+  {
+    Ring,   // copy pushed bytes into a contiguous ring buffer preallocated at construction
+    Chunked // keep pushed strings as-is (moved in, not copied); peek() returns the front chunk
+  };
+
+  explicit ByteStream( uint64_t capacity, Storage storage = Storage::Ring );
 
   // Helper functions (provided) to access the ByteStream's Reader and Writer interfaces
   Reader& reader();
@@ -26,7 +33,17 @@ protected:
   // Please add any additional state to the ByteStream here, and not to the Writer and Reader interfaces.
   bool finish_write_;
   uint64_t tot_write_;
-  std::queue<char> stream_;
+  Storage storage_;
+  uint64_t size_ {}; // 当前缓冲的字节数
+
+  // Storage::Ring —— 定长环形缓冲区：可读字节从 head_ 开始，可能在末尾回绕
+  std::string buffer_;
+  uint64_t head_ {};
+
+  // Storage::Chunked —— 直接持有被 push 进来的字符串，首块跳过 chunk_skip_ 个已读字节
+  std::deque<std::string> chunks_ {};
+  uint64_t chunk_skip_ {};
+  static constexpr uint64_t MAX_CHUNK_SLACK = 4096; // 块的分配最多可比内容多出的字节数（超过就复制一份）
 
   uint64_t capacity_;
   bool error_ {};
@@ -46,7 +63,7 @@ public:
 class Reader : public ByteStream
 {
 public:
-  std::string_view peek() const; // Peek at the next bytes in the buffer
+  std::string_view peek() const; // Peek at the next bytes in the buffer (largest contiguous span)
   void pop( uint64_t len );      // Remove `len` bytes from the buffer
 
   bool is_finished() const;        // Is the stream finished (closed and fully popped)?
@@ -0,0 +1,340 @@
+#include "congestion_control.hh"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+// RFC 6928 初始窗口
+uint64_t initial_window( uint64_t mss )
+{
+  return min( 10 * mss, max( 2 * mss, uint64_t { 14600 } ) );
+}
+} // namespace
+
+unique_ptr<CongestionControl> CongestionControl::make( Algorithm algorithm, uint64_t mss )
+{
+  switch ( algorithm ) {
+    case Algorithm::NewReno:
+      return make_unique<NewReno>( mss );
+    case Algorithm::Cubic:
+      return make_unique<Cubic>( mss );
+    case Algorithm::BBR:
+      return make_unique<BBR>( mss );
+    case Algorithm::None:
+      break;
+  }
+  return nullptr;
+}
+
+NewReno::NewReno( uint64_t mss ) : mss_( mss ), cwnd_( initial_window( mss ) ) {}
+
+void NewReno::on_ack( const AckSample& sample )
+{
+  if ( in_recovery_ ) {
+    if ( sample.ackno >= recover_ ) {
+      // 完全确认：退出快速恢复，窗口收缩回 ssthresh
+      in_recovery_ = false;
+      cwnd_ = min( ssthresh_, max( sample.bytes_in_flight, mss_ ) + mss_ );
+    } else {
+      // 部分确认：减去被确认的量，再为即将重传的分组补回一个 MSS
+      cwnd_ -= min( cwnd_, sample.acked_bytes );
+      cwnd_ += mss_;
+    }
+    return;
+  }
+
+  if ( cwnd_ < ssthresh_ ) {
+    // 慢启动：RFC 3465 L = 2 MSS，对方延迟 ACK 时也能每 RTT 翻倍；超时后的慢启动 L = 1 MSS
+    cwnd_ += min( sample.acked_bytes, ( after_timeout_ ? 1 : 2 ) * mss_ );
+    return;
+  }
+
+  // 拥塞避免：每确认一个窗口的数据，窗口增加一个 MSS
+  bytes_acked_ += sample.acked_bytes;
+  if ( bytes_acked_ >= cwnd_ ) {
+    bytes_acked_ -= cwnd_;
+    cwnd_ += mss_;
+  }
+}
+
+void NewReno::on_dup_ack()
+{
+  if ( in_recovery_ ) {
+    cwnd_ += mss_; // 每个重复 ACK 代表一个分组离开了网络
+  }
+}
+
+void NewReno::on_loss( uint64_t now [[maybe_unused]], uint64_t bytes_in_flight, uint64_t highest_sent )
+{
+  if ( in_recovery_ ) {
+    return;
+  }
+  ssthresh_ = max( bytes_in_flight / 2, 2 * mss_ );
+  cwnd_ = ssthresh_ + 3 * mss_;
+  bytes_acked_ = 0;
+  in_recovery_ = true;
+  recover_ = highest_sent;
+}
+
+void NewReno::on_timeout( uint64_t now [[maybe_unused]], uint64_t bytes_in_flight )
+{
+  ssthresh_ = max( bytes_in_flight / 2, 2 * mss_ );
+  cwnd_ = mss_;
+  bytes_acked_ = 0;
+  in_recovery_ = false;
+  after_timeout_ = true;
+}
+
+Cubic::Cubic( uint64_t mss )
+  : mss_( static_cast<double>( mss ) ), cwnd_( static_cast<double>( initial_window( mss ) ) )
+{}
+
+double Cubic::w_cubic( double t_seconds ) const
+{
+  return C * pow( t_seconds - k_, 3 ) * mss_ + w_max_;
+}
+
+void Cubic::reduce()
+{
+  // 快速收敛：窗口还没恢复到上次的 W_max 就又拥塞了，说明有新流加入，主动让出带宽
+  w_max_ = cwnd_ < w_max_ ? cwnd_ * ( 1 + BETA ) / 2 : cwnd_;
+  ssthresh_ = max( cwnd_ * BETA, 2 * mss_ );
+  epoch_started_ = false;
+}
+
+void Cubic::on_ack( const AckSample& sample )
+{
+  if ( sample.rtt.has_value() ) {
+    rtt_ = *sample.rtt;
+  }
+
+  if ( in_recovery_ ) {
+    // 恢复期间窗口保持在 ssthresh，部分确认只触发重传
+    in_recovery_ = sample.ackno < recover_;
+    return;
+  }
+
+  if ( cwnd_ < ssthresh_ ) {
+    cwnd_ += min( static_cast<double>( sample.acked_bytes ), ( after_timeout_ ? 1 : 2 ) * mss_ ); // 慢启动
+    return;
+  }
+
+  if ( !epoch_started_ ) {
+    epoch_started_ = true;
+    epoch_start_ = sample.now;
+    w_max_ = max( w_max_, cwnd_ );
+    k_ = cbrt( ( w_max_ - cwnd_ ) / mss_ / C );
+    w_est_ = cwnd_;
+  }
+
+  const double acked = static_cast<double>( sample.acked_bytes );
+  const double t = static_cast<double>( sample.now - epoch_start_ ) / 1000;
+
+  // Reno 在同样时间内能达到的窗口：每个 RTT 增加 alpha 个 MSS
+  constexpr double alpha = 3 * ( 1 - BETA ) / ( 1 + BETA );
+  w_est_ += alpha * mss_ * acked / cwnd_;
+
+  if ( w_cubic( t ) < w_est_ ) {
+    cwnd_ = w_est_; // TCP 友好区域：至少和 Reno 一样快
+    return;
+  }
+
+  // 朝一个 RTT 之后的目标窗口增长，每个 RTT 最多增长到 1.5 倍
+  const double target = clamp( w_cubic( t + static_cast<double>( rtt_ ) / 1000 ), cwnd_, 1.5 * cwnd_ );
+  cwnd_ += ( target - cwnd_ ) * acked / cwnd_;
+}
+
+void Cubic::on_loss( uint64_t now [[maybe_unused]],
+                     uint64_t bytes_in_flight [[maybe_unused]],
+                     uint64_t highest_sent )
+{
+  if ( in_recovery_ ) {
+    return;
+  }
+  reduce();
+  cwnd_ = ssthresh_;
+  in_recovery_ = true;
+  recover_ = highest_sent;
+}
+
+void Cubic::on_timeout( uint64_t now [[maybe_unused]], uint64_t bytes_in_flight [[maybe_unused]] )
+{
+  if ( !in_recovery_ ) {
+    reduce();
+  }
+  cwnd_ = mss_;
+  in_recovery_ = false;
+  after_timeout_ = true;
+}
+
+namespace {
+// ProbeBW 的发送速率增益循环：探测一轮、排空一轮、巡航六轮
+constexpr array<double, 8> PROBE_BW_GAINS { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+} // namespace
+
+BBR::BBR( uint64_t mss ) : mss_( mss ), cwnd_( initial_window( mss ) ) {}
+
+uint64_t BBR::bdp( double gain ) const
+{
+  if ( min_rtt_ == UINT64_MAX || bw_samples_.empty() ) {
+    return initial_window( mss_ );
+  }
+  return static_cast<uint64_t>( gain * bottleneck_bw() * static_cast<double>( min_rtt_ ) );
+}
+
+void BBR::enter( Mode mode, uint64_t now )
+{
+  mode_ = mode;
+  switch ( mode ) {
+    case Mode::Startup:
+      pacing_gain_ = HIGH_GAIN;
+      cwnd_gain_ = HIGH_GAIN;
+      break;
+    case Mode::Drain:
+      // 发送方不一定按 pacing_rate 限速，所以窗口也收到一个 BDP，保证队列能被排空
+      pacing_gain_ = 1 / HIGH_GAIN;
+      cwnd_gain_ = 1;
+      break;
+    case Mode::ProbeBW:
+      cycle_index_ = 0;
+      cycle_stamp_ = now;
+      pacing_gain_ = PROBE_BW_GAINS[cycle_index_];
+      cwnd_gain_ = CWND_GAIN;
+      break;
+    case Mode::ProbeRTT:
+      pacing_gain_ = 1;
+      cwnd_gain_ = 1;
+      probe_rtt_done_stamp_ = now + PROBE_RTT_DURATION;
+      break;
+  }
+}
+
+void BBR::update_bw( const AckSample& sample )
+{
+  round_start_ = sample.prior_delivered >= next_round_delivered_;
+  if ( round_start_ ) {
+    next_round_delivered_ = sample.total_delivered;
+    ++round_count_;
+  }
+
+  // 应用受限时的采样偏低，只有超过当前估计时才采纳
+  const double rate = sample.delivery_rate();
+  if ( rate > 0 && ( !sample.app_limited || rate >= bottleneck_bw() ) ) {
+    while ( !bw_samples_.empty() && bw_samples_.back().second <= rate ) {
+      bw_samples_.pop_back();
+    }
+    bw_samples_.emplace_back( round_count_, rate );
+  }
+  while ( bw_samples_.size() > 1 && bw_samples_.front().first + BW_WINDOW_ROUNDS <= round_count_ ) {
+    bw_samples_.pop_front();
+  }
+}
+
+void BBR::update_min_rtt( const AckSample& sample )
+{
+  const bool expired = sample.now > min_rtt_stamp_ + MIN_RTT_WINDOW && min_rtt_ != UINT64_MAX;
+  if ( sample.rtt.has_value() && ( *sample.rtt <= min_rtt_ || expired ) ) {
+    min_rtt_ = *sample.rtt;
+    min_rtt_stamp_ = sample.now;
+  }
+  if ( expired && mode_ != Mode::ProbeRTT ) {
+    mode_before_probe_rtt_ = mode_;
+    prior_cwnd_ = max( prior_cwnd_, cwnd_ );
+    enter( Mode::ProbeRTT, sample.now );
+  }
+}
+
+void BBR::update_mode( const AckSample& sample )
+{
+  switch ( mode_ ) {
+    case Mode::Startup:
+      if ( round_start_ && !sample.app_limited ) {
+        if ( bottleneck_bw() >= full_bw_ * 1.25 ) {
+          full_bw_ = bottleneck_bw();
+          full_bw_rounds_ = 0;
+        } else if ( ++full_bw_rounds_ >= 3 ) {
+          filled_pipe_ = true;
+          enter( Mode::Drain, sample.now );
+        }
+      }
+      break;
+    case Mode::Drain:
+      if ( sample.bytes_in_flight <= bdp( 1 ) ) {
+        enter( Mode::ProbeBW, sample.now );
+      }
+      break;
+    case Mode::ProbeBW:
+      if ( sample.now - cycle_stamp_ > min_rtt_ ) {
+        cycle_index_ = ( cycle_index_ + 1 ) % PROBE_BW_GAINS.size();
+        cycle_stamp_ = sample.now;
+        pacing_gain_ = PROBE_BW_GAINS[cycle_index_];
+      }
+      break;
+    case Mode::ProbeRTT:
+      if ( sample.now >= probe_rtt_done_stamp_ ) {
+        min_rtt_stamp_ = sample.now;
+        cwnd_ = max( cwnd_, prior_cwnd_ );
+        prior_cwnd_ = 0;
+        enter( mode_before_probe_rtt_ == Mode::Startup ? Mode::Startup : Mode::ProbeBW, sample.now );
+      }
+      break;
+  }
+}
+
+void BBR::update_cwnd( const AckSample& sample )
+{
+  if ( mode_ == Mode::ProbeRTT ) {
+    cwnd_ = 4 * mss_;
+    return;
+  }
+
+  if ( in_recovery_ ) {
+    if ( sample.ackno < recover_ ) {
+      // 分组守恒：每确认多少就再发多少
+      cwnd_ = max( cwnd_, sample.bytes_in_flight + sample.acked_bytes );
+      return;
+    }
+    in_recovery_ = false;
+    cwnd_ = max( cwnd_, prior_cwnd_ );
+    prior_cwnd_ = 0;
+  }
+
+  // 管道填满前窗口随确认量增长；之后每次确认向 cwnd_gain 倍 BDP 靠拢
+  const uint64_t target = bdp( cwnd_gain_ );
+  if ( filled_pipe_ ) {
+    cwnd_ = min( cwnd_ + sample.acked_bytes, target );
+  } else if ( cwnd_ < target || sample.total_delivered < initial_window( mss_ ) ) {
+    cwnd_ += sample.acked_bytes;
+  }
+  cwnd_ = max( cwnd_, 4 * mss_ );
+}
+
+void BBR::on_ack( const AckSample& sample )
+{
+  update_bw( sample );
+  update_min_rtt( sample );
+  update_mode( sample );
+  update_cwnd( sample );
+}
+
+void BBR::on_loss( uint64_t now [[maybe_unused]], uint64_t bytes_in_flight, uint64_t highest_sent )
+{
+  // BBR 不把丢包当作拥塞信号，只在恢复期间限制窗口不超过在途数据量
+  if ( in_recovery_ ) {
+    return;
+  }
+  prior_cwnd_ = max( prior_cwnd_, cwnd_ );
+  cwnd_ = max( bytes_in_flight, mss_ );
+  in_recovery_ = true;
+  recover_ = highest_sent;
+}
+
+void BBR::on_timeout( uint64_t now [[maybe_unused]], uint64_t bytes_in_flight [[maybe_unused]] )
+{
+  // 超时后从一个 MSS 开始，按确认量重新增长回目标窗口
+  cwnd_ = mss_;
+  in_recovery_ = false;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// 一次确认新数据的 ACK 带给拥塞控制器的信息
+struct AckSample
+{
+  uint64_t now {};                 // 当前时刻（毫秒）
+  uint64_t ackno {};               // 确认到的绝对序号
+  uint64_t acked_bytes {};         // 本次新确认的序号数
+  uint64_t bytes_in_flight {};     // 处理完本次确认后仍在途的序号数
+  std::optional<uint64_t> rtt {};  // RTT 采样（Karn 算法排除了重传分组）
+
+  // 交付速率采样（draft-cheng-iccrg-delivery-rate-estimation）
+  uint64_t delivered {};       // 采样区间内交付的字节数
+  uint64_t interval {};        // 采样区间长度（毫秒），为 0 表示本次没有有效采样
+  uint64_t prior_delivered {}; // 被采样分组发出时的累计交付字节数
+  uint64_t total_delivered {}; // 处理完本次确认后的累计交付字节数
+  bool app_limited {};         // 被采样分组发出时发送方受限于应用数据而不是窗口
+
+  // 交付速率（字节/毫秒），没有有效采样时为 0
+  double delivery_rate() const
+  {
+    return interval == 0 ? 0 : static_cast<double>( delivered ) / static_cast<double>( interval );
+  }
+};
+
+// 拥塞控制算法的公共接口：TCPSender 在各个事件上回调，并用 window() 限制在途数据量
+class CongestionControl
+{
+public:
+  enum class Algorithm
+  {
+    None,   // 不做拥塞控制，只受对方通告窗口限制
+    NewReno, // RFC 5681 慢启动 / 拥塞避免 + RFC 6582 快速恢复
+    Cubic,   // RFC 9438，窗口按距上次拥塞的时间三次增长
+    BBR      // 按瓶颈带宽与最小 RTT 估计 BDP，不以丢包作为拥塞信号
+  };
+
+  // 按算法构造控制器；Algorithm::None 返回空指针
+  static std::unique_ptr<CongestionControl> make( Algorithm algorithm, uint64_t mss );
+
+  virtual ~CongestionControl() = default;
+
+  // 当前拥塞窗口（字节）
+  virtual uint64_t window() const = 0;
+
+  // 建议的发送速率（字节/毫秒），为 0 表示算法不要求限速
+  virtual double pacing_rate() const { return 0; }
+
+  // 是否处于快速恢复中；恢复期间的部分确认需要发送方立即重传下一个缺口
+  virtual bool in_recovery() const { return false; }
+
+  // 是否处于慢启动；按 cwnd/SRTT 限速时，慢启动用更大的增益，以免拖慢窗口翻倍
+  virtual bool in_slow_start() const { return false; }
+
+  // 有新数据被确认
+  virtual void on_ack( const AckSample& sample ) = 0;
+
+  // 收到重复 ACK；第 DUP_ACK_THRESHOLD 个时 sender 另外调用 on_loss
+  virtual void on_dup_ack() {}
+
+  // 通过重复 ACK 检测到丢包；highest_sent 为此刻已发送的最大序号
+  virtual void on_loss( uint64_t now, uint64_t bytes_in_flight, uint64_t highest_sent ) = 0;
+
+  // 重传超时
+  virtual void on_timeout( uint64_t now, uint64_t bytes_in_flight ) = 0;
+
+  // 连接中途分组大小变化（路径 MTU 探测改变了 MSS）；窗口仍按字节计，只影响此后的增减步长
+  virtual void set_mss( uint64_t mss ) = 0;
+
+protected:
+  CongestionControl() = default;
+  CongestionControl( const CongestionControl& ) = default;
+  CongestionControl& operator=( const CongestionControl& ) = default;
+};
+
+class NewReno : public CongestionControl
+{
+public:
+  explicit NewReno( uint64_t mss );
+
+  uint64_t window() const override { return cwnd_; }
+  bool in_recovery() const override { return in_recovery_; }
+  bool in_slow_start() const override { return cwnd_ < ssthresh_; }
+
+  void on_ack( const AckSample& sample ) override;
+  void on_dup_ack() override;
+  void on_loss( uint64_t now, uint64_t bytes_in_flight, uint64_t highest_sent ) override;
+  void on_timeout( uint64_t now, uint64_t bytes_in_flight ) override;
+  void set_mss( uint64_t mss ) override { mss_ = mss; }
+
+  uint64_t slow_start_threshold() const { return ssthresh_; }
+
+private:
+  uint64_t mss_;
+  uint64_t cwnd_;
+  uint64_t ssthresh_ { UINT64_MAX };
+  uint64_t bytes_acked_ {}; // 拥塞避免阶段累计确认的字节数（RFC 3465 按字节计数）
+  bool after_timeout_ {};   // 发生过超时：慢启动每个 ACK 最多增加一个 MSS
+  bool in_recovery_ {};
+  uint64_t recover_ {}; // 进入快速恢复时已发送的最大序号
+};
+
+class Cubic : public CongestionControl
+{
+public:
+  explicit Cubic( uint64_t mss );
+
+  uint64_t window() const override { return static_cast<uint64_t>( cwnd_ ); }
+  bool in_recovery() const override { return in_recovery_; }
+  bool in_slow_start() const override { return cwnd_ < ssthresh_; }
+
+  void on_ack( const AckSample& sample ) override;
+  void on_loss( uint64_t now, uint64_t bytes_in_flight, uint64_t highest_sent ) override;
+  void on_timeout( uint64_t now, uint64_t bytes_in_flight ) override;
+  void set_mss( uint64_t mss ) override { mss_ = static_cast<double>( mss ); }
+
+  uint64_t slow_start_threshold() const { return static_cast<uint64_t>( ssthresh_ ); }
+
+private:
+  static constexpr double C = 0.4;    // 三次函数的缩放系数（段/秒^3）
+  static constexpr double BETA = 0.7; // 乘性减小系数
+
+  void reduce();                            // 拥塞事件：记录 W_max 并把窗口降到 BETA 倍
+  double w_cubic( double t_seconds ) const; // 拥塞事件后 t 秒时的目标窗口（字节）
+
+  double mss_;
+  double cwnd_;
+  double ssthresh_ { 1e18 };
+  double w_max_ {};       // 上次拥塞事件前的窗口
+  double k_ {};           // 窗口增长回 W_max 所需的秒数
+  double w_est_ {};       // 同等条件下 Reno 的窗口估计（TCP 友好区域）
+  bool epoch_started_ {}; // 本轮拥塞避免是否已开始计时
+  uint64_t epoch_start_ {};
+  uint64_t rtt_ {};       // 最近的 RTT 采样（毫秒）
+  bool after_timeout_ {}; // 发生过超时：慢启动每个 ACK 最多增加一个 MSS
+  bool in_recovery_ {};
+  uint64_t recover_ {};
+};
+
+class BBR : public CongestionControl
+{
+public:
+  enum class Mode
+  {
+    Startup,  // 指数增长直到带宽不再上涨
+    Drain,    // 排空 Startup 阶段在瓶颈处积压的队列
+    ProbeBW,  // 以 BDP 为中心周期性探测更多带宽
+    ProbeRTT  // 长时间没有更小的 RTT 时缩小窗口重新测量
+  };
+
+  explicit BBR( uint64_t mss );
+
+  uint64_t window() const override { return cwnd_; }
+  double pacing_rate() const override { return pacing_gain_ * bottleneck_bw(); }
+  bool in_recovery() const override { return in_recovery_; }
+
+  void on_ack( const AckSample& sample ) override;
+  void on_loss( uint64_t now, uint64_t bytes_in_flight, uint64_t highest_sent ) override;
+  void on_timeout( uint64_t now, uint64_t bytes_in_flight ) override;
+  void set_mss( uint64_t mss ) override { mss_ = mss; }
+
+  Mode mode() const { return mode_; }
+  double bottleneck_bw() const { return bw_samples_.empty() ? 0 : bw_samples_.front().second; }
+  uint64_t min_rtt() const { return min_rtt_; }
+
+private:
+  static constexpr double HIGH_GAIN = 2.885; // 2/ln2，Startup 阶段每轮翻倍
+  static constexpr double CWND_GAIN = 2;
+  static constexpr uint64_t BW_WINDOW_ROUNDS = 10;    // 带宽最大值滤波的窗口（往返轮数）
+  static constexpr uint64_t MIN_RTT_WINDOW = 10'000;  // 最小 RTT 的有效期（毫秒）
+  static constexpr uint64_t PROBE_RTT_DURATION = 200; // ProbeRTT 至少持续的时间（毫秒）
+
+  uint64_t bdp( double gain ) const; // gain 倍的带宽时延积（字节）
+  void update_bw( const AckSample& sample );
+  void update_min_rtt( const AckSample& sample );
+  void update_mode( const AckSample& sample );
+  void update_cwnd( const AckSample& sample );
+  void enter( Mode mode, uint64_t now );
+
+  uint64_t mss_;
+  uint64_t cwnd_;
+  Mode mode_ { Mode::Startup };
+  double pacing_gain_ { HIGH_GAIN };
+  double cwnd_gain_ { HIGH_GAIN };
+
+  // 往返轮次：被确认分组发出时的累计交付量越过轮次起点即进入新一轮
+  uint64_t round_count_ {};
+  uint64_t next_round_delivered_ {};
+  bool round_start_ {};
+
+  std::deque<std::pair<uint64_t, double>> bw_samples_ {}; // (轮次, 速率) 单调递减，队首为窗口内最大值
+
+  uint64_t min_rtt_ { UINT64_MAX };
+  uint64_t min_rtt_stamp_ {};
+
+  // Startup 结束判据：连续三轮带宽增长不足 25%
+  double full_bw_ {};
+  uint64_t full_bw_rounds_ {};
+  bool filled_pipe_ {};
+
+  uint64_t cycle_index_ {}; // ProbeBW 增益循环的位置
+  uint64_t cycle_stamp_ {};
+  uint64_t probe_rtt_done_stamp_ {};
+  Mode mode_before_probe_rtt_ { Mode::ProbeBW };
+  uint64_t prior_cwnd_ {}; // ProbeRTT 或丢包恢复前的窗口，结束后恢复
+
+  bool in_recovery_ {};
+  uint64_t recover_ {};
+};
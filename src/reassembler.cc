@@ -1,42 +1,213 @@
 #include "reassembler.hh"
 
+#include <algorithm>
+#include <bit>
+#include <iterator>
+
 using namespace std;
 
+namespace {
+constexpr uint64_t WORD_BITS = 64;
+
+// 单个字内 [bit, bit + len) 的掩码
+uint64_t word_mask( uint64_t bit, uint64_t len )
+{
+  return ( len == WORD_BITS ? ~uint64_t {} : ( ( uint64_t { 1 } << len ) - 1 ) ) << bit;
+}
+} // namespace
+
+Reassembler::Reassembler( ByteStream&& output, Backend backend )
+  : output_( std::move( output ) )
+  , next_index_( 0 )
+  , last_index_( -1 )
+  , backend_( backend )
+  , capacity_( output_.writer().available_capacity() )
+{
+  if ( backend_ == Backend::Bitmap ) {
+    ring_.resize( capacity_ );
+    present_.resize( ( capacity_ + WORD_BITS - 1 ) / WORD_BITS );
+  }
+}
+
 void Reassembler::insert( uint64_t first_index, string data, bool is_last_substring )
 {
-  uint64_t index = first_index;
   if ( is_last_substring ) {
     last_index_ = first_index + data.length();
   }
 
-  for ( char c : data ) {
-    // 当前 index 在此范围内才能被加入
-    if ( index < next_index_ || index >= next_index_ + output_.writer().available_capacity() ) {
-      index++;
-      continue;
+  // 裁剪到 [next_index_, next_index_ + available_capacity) 窗口内
+  const uint64_t window_end = next_index_ + writer().available_capacity();
+  const uint64_t data_end = min( first_index + data.length(), window_end );
+  if ( first_index < next_index_ ) {
+    data.erase( 0, min( next_index_ - first_index, data.length() ) );
+    first_index = next_index_;
+  }
+  if ( first_index < data_end ) {
+    data.resize( data_end - first_index );
+    if ( backend_ == Backend::Bitmap ) {
+      insert_bitmap( first_index, data );
+    } else {
+      insert_intervals( first_index, move( data ) );
     }
-    internal_bytes[index] = c;
-    index++;
   }
 
-  index = next_index_;
-  string msg;
-  while ( internal_bytes.count( next_index_ ) ) {
-    msg.push_back( internal_bytes[next_index_] );
-    internal_bytes.erase( next_index_ );
-    next_index_++;
+  if ( next_index_ == last_index_ ) {
+    writer().close();
+  }
+}
 
-    if ( next_index_ == last_index_ ) {
-      break;
+void Reassembler::insert_intervals( uint64_t first_index, string data )
+{
+  const uint64_t data_end = first_index + data.length();
+
+  // 与左侧相交或相邻的区间合并
+  auto it = pending_.upper_bound( first_index );
+  if ( it != pending_.begin() ) {
+    auto prev_it = prev( it );
+    const uint64_t prev_end = prev_it->first + prev_it->second.length();
+    if ( prev_end >= first_index ) {
+      pending_bytes_ -= prev_it->second.length();
+      if ( prev_end < data_end ) {
+        prev_it->second.append( data, prev_end - first_index );
+      }
+      data = move( prev_it->second );
+      first_index = prev_it->first;
+      pending_.erase( prev_it );
     }
   }
-  writer().push( msg );
-  if ( next_index_ == last_index_ ) {
-    writer().close();
+
+  // 吞并右侧被覆盖或相邻的区间
+  uint64_t end = first_index + data.length();
+  while ( it != pending_.end() && it->first <= end ) {
+    const uint64_t it_end = it->first + it->second.length();
+    if ( it_end > end ) {
+      data.append( it->second, end - it->first );
+      end = it_end;
+    }
+    pending_bytes_ -= it->second.length();
+    it = pending_.erase( it );
+  }
+
+  pending_bytes_ += data.length();
+  pending_.emplace_hint( it, first_index, move( data ) );
+
+  // 把与已写入部分相接的区间整体交给 Writer
+  if ( pending_.begin()->first == next_index_ ) {
+    auto head = pending_.extract( pending_.begin() );
+    pending_bytes_ -= head.mapped().length();
+    next_index_ += head.mapped().length();
+    writer().push( move( head.mapped() ) );
+  }
+}
+
+void Reassembler::insert_bitmap( uint64_t first_index, string_view data )
+{
+  // 窗口不超过容量，所以窗口内的下标映射到 ring_ 时不会冲突；至多回绕一次
+  const uint64_t slot = first_index % capacity_;
+  const uint64_t first = min( static_cast<uint64_t>( data.length() ), capacity_ - slot );
+  copy_n( data.data(), first, ring_.data() + slot );
+  copy_n( data.data() + first, data.length() - first, ring_.data() );
+  pending_bytes_ += set_bits( slot, slot + first );
+  pending_bytes_ += set_bits( 0, data.length() - first );
+
+  // 用位扫描找出从 next_index_ 开始的连续已到达字节
+  const uint64_t head = next_index_ % capacity_;
+  uint64_t run = count_run( head, capacity_, true );
+  if ( run == capacity_ - head ) {
+    run += count_run( 0, head, true );
+  }
+  if ( run == 0 ) {
+    return;
+  }
+
+  const uint64_t run_first = min( run, capacity_ - head );
+  string out;
+  out.reserve( run );
+  out.append( ring_, head, run_first );
+  out.append( ring_, 0, run - run_first );
+  clear_bits( head, head + run_first );
+  clear_bits( 0, run - run_first );
+
+  pending_bytes_ -= run;
+  next_index_ += run;
+  writer().push( move( out ) );
+}
+
+uint64_t Reassembler::set_bits( uint64_t begin, uint64_t end )
+{
+  uint64_t newly_set = 0;
+  for ( uint64_t i = begin; i < end; ) {
+    const uint64_t len = min( WORD_BITS - i % WORD_BITS, end - i );
+    uint64_t& word = present_[i / WORD_BITS];
+    const uint64_t mask = word_mask( i % WORD_BITS, len );
+    newly_set += popcount( mask & ~word );
+    word |= mask;
+    i += len;
   }
+  return newly_set;
+}
+
+void Reassembler::clear_bits( uint64_t begin, uint64_t end )
+{
+  for ( uint64_t i = begin; i < end; ) {
+    const uint64_t len = min( WORD_BITS - i % WORD_BITS, end - i );
+    present_[i / WORD_BITS] &= ~word_mask( i % WORD_BITS, len );
+    i += len;
+  }
+}
+
+uint64_t Reassembler::count_run( uint64_t begin, uint64_t end, bool bit ) const
+{
+  uint64_t count = 0;
+  for ( uint64_t i = begin; i < end; ) {
+    const uint64_t len = min( WORD_BITS - i % WORD_BITS, end - i );
+    const uint64_t word = bit ? present_[i / WORD_BITS] : ~present_[i / WORD_BITS];
+    const auto ones = static_cast<uint64_t>( countr_one( word >> ( i % WORD_BITS ) ) );
+    if ( ones < len ) {
+      return count + ones;
+    }
+    count += len;
+    i += len;
+  }
+  return count;
 }
 
 uint64_t Reassembler::bytes_pending() const
 {
-  return internal_bytes.size();
+  return pending_bytes_;
+}
+
+vector<pair<uint64_t, uint64_t>> Reassembler::pending_intervals() const
+{
+  vector<pair<uint64_t, uint64_t>> intervals;
+  if ( pending_bytes_ == 0 ) {
+    return intervals;
+  }
+
+  if ( backend_ == Backend::Intervals ) {
+    intervals.reserve( pending_.size() );
+    for ( const auto& [first, data] : pending_ ) {
+      intervals.emplace_back( first, first + data.length() );
+    }
+    return intervals;
+  }
+
+  // 从 next_index_ 对应的槽位开始，交替扫描 0 和 1 的连续段；跨越 ring_ 末尾的段在追加时合并
+  const uint64_t head = next_index_ % capacity_;
+  for ( uint64_t offset = 0; offset < capacity_; ) {
+    const uint64_t slot = ( head + offset ) % capacity_;
+    const uint64_t end = slot + min( capacity_ - offset, capacity_ - slot );
+    const uint64_t gap = count_run( slot, end, false );
+    const uint64_t run = count_run( slot + gap, end, true );
+    if ( run > 0 ) {
+      const uint64_t first = next_index_ + offset + gap;
+      if ( !intervals.empty() && intervals.back().second == first ) {
+        intervals.back().second += run;
+      } else {
+        intervals.emplace_back( first, first + run );
+      }
+    }
+    offset += gap + run;
+  }
+  return intervals;
 }
@@ -2,17 +2,23 @@
 
 #include "byte_stream.hh"
 #include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 class Reassembler
 {
 public:
+  // How out-of-order bytes are held until the gaps before them are filled
+  enum class Backend
+  {
+    Intervals, // ordered map of merged substrings; memory proportional to the data held
+    Bitmap     // circular byte array plus presence bitmap, both preallocated to the stream's capacity
+  };
+
   // Construct Reassembler to write into given ByteStream.
-  explicit Reassembler( ByteStream&& output )
-    : output_( std::move( output ) )
-    , next_index_( 0 )
-    , last_index_( -1 )
-    , internal_bytes( std::map<uint64_t, char> {} )
-  {}
+  explicit Reassembler( ByteStream&& output, Backend backend = Backend::Intervals );
 
   /*
    * Insert a new substring to be reassembled into a ByteStream.
@@ -39,6 +45,9 @@ public:
   // How many bytes are stored in the Reassembler itself?
   uint64_t bytes_pending() const;
 
+  // The [first, last) stream indices of the bytes stored in the Reassembler, as maximal ranges in order
+  std::vector<std::pair<uint64_t, uint64_t>> pending_intervals() const;
+
   // Access output stream reader
   Reader& reader() { return output_.reader(); }
   const Reader& reader() const { return output_.reader(); }
@@ -50,7 +59,25 @@ private:
   ByteStream output_; // the Reassembler writes to this ByteStream
   uint64_t next_index_;
   uint64_t last_index_;
-  std::map<uint64_t, char> internal_bytes;
+
+  Backend backend_;
+  uint64_t pending_bytes_ {};
+
+  // Backend::Intervals —— 暂存的乱序数据：起始下标 -> 数据，区间互不重叠也不相邻（插入时合并）
+  std::map<uint64_t, std::string> pending_ {};
+
+  // Backend::Bitmap —— 下标 i 的字节存放在 ring_[i % capacity_]，present_ 中对应位表示是否已收到
+  uint64_t capacity_;
+  std::string ring_ {};
+  std::vector<uint64_t> present_ {};
+
+  void insert_intervals( uint64_t first_index, std::string data );
+  void insert_bitmap( uint64_t first_index, std::string_view data );
+
+  // 对 present_ 中 [begin, end) 范围的位操作（不回绕），返回被改变的位数
+  uint64_t set_bits( uint64_t begin, uint64_t end );
+  void clear_bits( uint64_t begin, uint64_t end );
+  uint64_t count_run( uint64_t begin, uint64_t end, bool bit ) const; // 从 begin 开始连续的 bit 的个数
 
   Writer& writer() { return output_.writer(); }
 };
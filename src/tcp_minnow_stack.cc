@@ -0,0 +1,628 @@
+#include "tcp_minnow_stack.hh"
+
+#include "exception.hh"
+#include "parser.hh"
+#include "tcp_minnow_socket_impl.hh" // for timestamp_ms() and socket_pair_helper()
+
+#include <array>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <utility>
+
+using namespace std;
+
+namespace {
+constexpr size_t MAX_READS_PER_EVENT = 64; // datagrams read before giving the connections' sockets a turn
+constexpr size_t MAX_UNSENT = 4096;        // datagrams queued for a full device before more are dropped
+}
+
+size_t TCPMinnowStack::FourTupleHash::operator()( const FourTuple& t ) const noexcept
+{
+  const uint64_t local = ( uint64_t { t.local_ip } << 16 ) | t.local_port;
+  const uint64_t remote = ( uint64_t { t.remote_ip } << 16 ) | t.remote_port;
+  return hash<uint64_t> {}( local * 0x9e3779b97f4a7c15 ^ remote );
+}
+
+TCPMinnowStack::Connection::Connection( uint64_t s_id,
+                                        const TCPConfig& config,
+                                        TCPOverIPv4Adapter&& s_adapter,
+                                        LocalStreamSocket&& s_data )
+  : id( s_id ), adapter( std::move( s_adapter ) ), peer( config ), data( std::move( s_data ) )
+{
+  data.set_blocking( false );
+}
+
+TCPMinnowStack::Shard::Shard() : wakeup( _new_eventfd() )
+{
+  push_category = eventloop.add_category( "push bytes to TCPPeer" );
+  inbound_category = eventloop.add_category( "read bytes from inbound stream" );
+}
+
+TCPMinnowStack::TCPMinnowStack( FileDescriptor&& datagram_fd, size_t shards )
+{
+  _devices.push_back( { std::move( datagram_fd ) } );
+  _start( shards );
+}
+
+void TCPMinnowStack::_start( size_t shards )
+{
+  if ( shards == 0 ) {
+    throw runtime_error( "TCPMinnowStack needs at least one shard" );
+  }
+  for ( auto& device : _devices ) {
+    device.fd.set_blocking( false );
+  }
+
+  for ( size_t i = 0; i < shards; i++ ) {
+    Shard& s = *_shards.emplace_back( make_unique<Shard>() );
+    s.eventloop.add_rule( "take connections and datagrams handed to this shard", s.wakeup, Direction::In, [&] {
+      string counter( sizeof( uint64_t ), 0 );
+      s.wakeup.read( counter );
+
+      vector<ConnectRequest> requests;
+      vector<pair<FourTuple, InternetDatagram>> forwarded;
+      {
+        const lock_guard lock { s.requests_mutex };
+        swap( requests, s.requests );
+        swap( forwarded, s.forwarded );
+      }
+      for ( auto& request : requests ) {
+        _open( s, std::move( request ) );
+      }
+      for ( const auto& [key, dgram] : forwarded ) {
+        _deliver( s, key, dgram );
+      }
+
+      while ( auto datagram = s.inbound.pop() ) {
+        _deliver( s, datagram->first, datagram->second );
+      }
+    } );
+  }
+
+  if ( _has_io_thread() ) {
+    // the I/O thread passes each datagram to its shard, and wakes the shards once per batch (in _io_main)
+    _io_delivered.resize( _shards.size() );
+    _add_device_rules( _io_eventloop, _devices.front(), [this]( const FourTuple& key, InternetDatagram&& dgram ) {
+      const size_t index = flow_hash( key ) % _shards.size();
+      if ( _shards[index]->inbound.push( { key, std::move( dgram ) } ) ) {
+        _io_delivered[index] = true;
+      } // else dropped, as by a NIC whose receive ring is full
+    } );
+    _io_eventloop.add_rule( "write datagrams from the shards", _io_wakeup, Direction::In, [&] {
+      string counter( sizeof( uint64_t ), 0 );
+      _io_wakeup.read( counter );
+      for ( auto& shard : _shards ) {
+        while ( auto datagram = shard->outbound.pop() ) {
+          _write_datagram( _devices.front(), std::move( datagram.value() ) );
+        }
+      }
+    } );
+  } else if ( _devices.size() == shards ) {
+    // each shard serves its own device (or queue), handing on datagrams for the other shards' connections
+    for ( size_t i = 0; i < shards; i++ ) {
+      Shard& s = *_shards[i];
+      s.device = i;
+      _add_device_rules( s.eventloop, _devices[i], [this, &s]( const FourTuple& key, InternetDatagram&& dgram ) {
+        Shard& owner = _shard_for( key );
+        if ( &owner == &s ) {
+          _deliver( s, key, dgram );
+        } else {
+          _forward( owner, key, std::move( dgram ) );
+        }
+      } );
+    }
+  } else {
+    throw runtime_error( "TCPMinnowStack needs one device, or one queue per shard" );
+  }
+
+  for ( auto& shard : _shards ) {
+    shard->thread = thread( &TCPMinnowStack::_shard_main, this, std::ref( *shard ) );
+  }
+  if ( _has_io_thread() ) {
+    _io_thread = thread( &TCPMinnowStack::_io_main, this );
+  }
+}
+
+TCPMinnowStack::~TCPMinnowStack()
+{
+  try {
+    {
+      const lock_guard lock { _listeners_mutex };
+      _abort.store( true );
+    }
+    _accepted.notify_all();
+    for ( auto& shard : _shards ) {
+      _wake( shard->wakeup );
+      shard->thread.join();
+    }
+    if ( _io_thread.joinable() ) {
+      _wake( _io_wakeup );
+      _io_thread.join();
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception destructing TCPMinnowStack: " << e.what() << endl;
+  }
+}
+
+FileDescriptor TCPMinnowStack::_new_eventfd()
+{
+  return FileDescriptor { CheckSystemCall( "eventfd", ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) };
+}
+
+void TCPMinnowStack::_wake( FileDescriptor& eventfd )
+{
+  const uint64_t one = 1;
+  eventfd.write( string_view { reinterpret_cast<const char*>( &one ), sizeof( one ) } );
+}
+
+size_t TCPMinnowStack::connection_count() const
+{
+  size_t count = 0;
+  for ( const auto& shard : _shards ) {
+    count += shard->connection_count;
+  }
+  return count;
+}
+
+uint32_t TCPMinnowStack::flow_hash( const FourTuple& t )
+{
+  static constexpr array<uint8_t, 40> KEY {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3,
+    0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3,
+    0x80, 0x30, 0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa };
+
+  // the input is in network byte order
+  Serializer input;
+  input.integer( t.remote_ip );
+  input.integer( t.local_ip );
+  input.integer( t.remote_port );
+  input.integer( t.local_port );
+  const string& bytes = input.output().front();
+
+  // for each set bit of the input, xor in the 32 bits of the key that start at the same position
+  uint64_t window = 0;
+  for ( size_t i = 0; i < sizeof( window ); i++ ) {
+    window = ( window << 8 ) | KEY.at( i );
+  }
+  uint32_t result = 0;
+  for ( size_t i = 0; i < bytes.size(); i++ ) {
+    for ( int bit = 7; bit >= 0; bit-- ) {
+      if ( ( static_cast<uint8_t>( bytes[i] ) >> bit ) & 1 ) {
+        result ^= static_cast<uint32_t>( window >> 32 );
+      }
+      window <<= 1;
+    }
+    window |= KEY.at( i + sizeof( window ) );
+  }
+  return result;
+}
+
+LocalStreamSocket TCPMinnowStack::connect( const TCPConfig& config, const Address& local, const Address& remote )
+{
+  const FourTuple key { .local_ip = local.ipv4_numeric(),
+                        .local_port = local.port(),
+                        .remote_ip = remote.ipv4_numeric(),
+                        .remote_port = remote.port() };
+  Shard& s = _shard_for( key );
+
+  auto [application, data] = socket_pair_helper<LocalStreamSocket>( AF_UNIX, SOCK_STREAM );
+  {
+    const lock_guard lock { s.requests_mutex };
+    s.requests.push_back( { config, { .source = local, .destination = remote }, std::move( data ) } );
+  }
+  _wake( s.wakeup );
+  return std::move( application );
+}
+
+void TCPMinnowStack::listen( const TCPConfig& config, const Address& local, size_t backlog )
+{
+  const lock_guard lock { _listeners_mutex };
+  if ( not _listeners.emplace( _listen_key( local.ipv4_numeric(), local.port() ), Listener { config, backlog } )
+              .second ) {
+    throw runtime_error( "TCPMinnowStack is already listening on " + local.to_string() );
+  }
+}
+
+pair<LocalStreamSocket, Address> TCPMinnowStack::accept( const Address& local )
+{
+  unique_lock lock { _listeners_mutex };
+  const auto it = _listeners.find( _listen_key( local.ipv4_numeric(), local.port() ) );
+  if ( it == _listeners.end() ) {
+    throw runtime_error( "accept() on " + local.to_string() + ", which has no listener" );
+  }
+
+  Listener& listener = it->second;
+  _accepted.wait( lock, [&] { return _abort or not listener.accepted.empty(); } );
+  if ( _abort ) {
+    throw runtime_error( "TCPMinnowStack shut down during accept()" );
+  }
+
+  auto connection = std::move( listener.accepted.front() );
+  listener.accepted.pop_front();
+  return connection;
+}
+
+void TCPMinnowStack::_shard_main( Shard& s )
+{
+  try {
+    while ( not _abort ) {
+      // sleep until something happens or the earliest connection's deadline, whichever is first
+      int timeout = -1;
+      if ( const auto next_expiry = s.timers.next_expiry() ) {
+        const auto now = timestamp_ms();
+        timeout = static_cast<int>( next_expiry.value() > now ? next_expiry.value() - now : 0 );
+      }
+
+      s.now = timestamp_ms();
+      s.eventloop.wait_next_event( timeout );
+      s.now = timestamp_ms();
+
+      // only the connections whose deadlines have passed are ticked
+      for ( const auto id : s.timers.expire( s.now ) ) {
+        Connection& c = *s.connections.at( s.timer_keys.at( id ) );
+        _advance( s, c );
+        _update( s, c );
+      }
+
+      for ( const auto& key : s.finished ) {
+        _remove( s, key );
+      }
+      s.finished.clear();
+
+      // hand everything this pass produced to the I/O thread at once
+      if ( s.wrote ) {
+        s.wrote = false;
+        _wake( _io_wakeup );
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception in TCPMinnowStack thread: " << e.what() << "\n";
+    throw;
+  }
+}
+
+void TCPMinnowStack::_io_main()
+{
+  try {
+    while ( not _abort ) {
+      _io_eventloop.wait_next_event( -1 );
+      for ( size_t i = 0; i < _shards.size(); i++ ) {
+        if ( _io_delivered[i] ) {
+          _io_delivered[i] = false;
+          _wake( _shards[i]->wakeup );
+        }
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception in TCPMinnowStack I/O thread: " << e.what() << "\n";
+    throw;
+  }
+}
+
+void TCPMinnowStack::_add_device_rules( EventLoop& eventloop,
+                                        Device& device,
+                                        const function<void( const FourTuple&, InternetDatagram&& )>& deliver )
+{
+  eventloop.add_rule( "receive TCP segments from the network", device.fd, Direction::In, [&device, deliver] {
+    for ( size_t i = 0; i < MAX_READS_PER_EVENT; i++ ) {
+      vector<string> strs( 2 );
+      strs.front().resize( IPv4Header::LENGTH );
+      device.fd.read( strs );
+      if ( strs.empty() ) {
+        return; // nothing more to read
+      }
+
+      InternetDatagram dgram;
+      if ( not parse( dgram, strs ) ) {
+        continue;
+      }
+      if ( const auto key = _four_tuple( dgram ) ) {
+        deliver( key.value(), std::move( dgram ) );
+      }
+    }
+  } );
+
+  device.send_rule = eventloop.add_rule(
+    "send queued datagrams",
+    device.fd,
+    Direction::Out,
+    [&device] {
+      while ( not device.unsent.empty() and device.fd.write( device.unsent.front().view() ) > 0 ) {
+        device.unsent.pop_front();
+      }
+    },
+    [&device] { return not device.unsent.empty(); } );
+}
+
+void TCPMinnowStack::_write_datagram( Device& device, PacketBuffer&& datagram )
+{
+  if ( device.unsent.empty() and device.fd.write( datagram.view() ) > 0 ) {
+    return;
+  }
+
+  // the device is full: queue the datagram until it's writable again, or drop it if the queue is full too
+  if ( device.unsent.empty() and device.send_rule.has_value() ) {
+    device.send_rule->update_interest();
+  }
+  if ( device.unsent.size() < MAX_UNSENT ) {
+    device.unsent.push_back( std::move( datagram ) );
+  }
+}
+
+optional<TCPMinnowStack::FourTuple> TCPMinnowStack::_four_tuple( const InternetDatagram& dgram )
+{
+  if ( dgram.header.proto != IPv4Header::PROTO_TCP ) {
+    return {};
+  }
+
+  // the ports are the first four bytes of the TCP header
+  string ports;
+  for ( const auto& piece : dgram.payload ) {
+    ports.append( piece, 0, 4 - ports.size() );
+    if ( ports.size() == 4 ) {
+      return FourTuple { .local_ip = dgram.header.dst,
+                         .local_port = static_cast<uint16_t>( static_cast<uint8_t>( ports[2] ) << 8
+                                                              | static_cast<uint8_t>( ports[3] ) ),
+                         .remote_ip = dgram.header.src,
+                         .remote_port = static_cast<uint16_t>( static_cast<uint8_t>( ports[0] ) << 8
+                                                               | static_cast<uint8_t>( ports[1] ) ) };
+    }
+  }
+  return {};
+}
+
+void TCPMinnowStack::_deliver( Shard& s, const FourTuple& key, const InternetDatagram& dgram )
+{
+  const auto it = s.connections.find( key );
+  if ( it == s.connections.end() ) {
+    _accept_syn( s, key, dgram ); // not for any of our connections, unless it starts a new one
+    return;
+  }
+
+  Connection& c = *it->second;
+  auto msg = c.adapter.unwrap_tcp_in_ip( dgram );
+  if ( msg.has_value() and c.peer.active() ) {
+    _advance( s, c );
+    c.peer.receive( std::move( msg.value() ), [&]( auto x ) { _transmit( s, c, x ); } );
+    _update( s, c );
+  }
+}
+
+void TCPMinnowStack::_forward( Shard& owner, const FourTuple& key, InternetDatagram&& dgram )
+{
+  // rare: once the owner has written a datagram of the connection, the device steers the rest to its queue
+  {
+    const lock_guard lock { owner.requests_mutex };
+    if ( owner.forwarded.size() >= QUEUE_DEPTH ) {
+      return; // dropped, as by a NIC whose receive ring is full
+    }
+    owner.forwarded.emplace_back( key, std::move( dgram ) );
+  }
+  _wake( owner.wakeup );
+}
+
+void TCPMinnowStack::_open( Shard& s, ConnectRequest&& request )
+{
+  const FourTuple key { .local_ip = request.addresses.source.ipv4_numeric(),
+                        .local_port = request.addresses.source.port(),
+                        .remote_ip = request.addresses.destination.ipv4_numeric(),
+                        .remote_port = request.addresses.destination.port() };
+  if ( s.connections.contains( key ) ) {
+    cerr << "DEBUG: minnow stack already has a connection from " << request.addresses.source.to_string() << " to "
+         << request.addresses.destination.to_string() << ".\n";
+    return; // closing request.data hands the application EOF
+  }
+
+  TCPOverIPv4Adapter adapter;
+  adapter.config_mut() = request.addresses;
+  Connection& c = _add( s, key, request.config, std::move( adapter ), std::move( request.data ) );
+  c.peer.push( [&]( auto x ) { _transmit( s, c, x ); } );
+  _update( s, c );
+}
+
+TCPMinnowStack::Connection& TCPMinnowStack::_add( Shard& s,
+                                                  const FourTuple& key,
+                                                  const TCPConfig& config,
+                                                  TCPOverIPv4Adapter&& adapter,
+                                                  LocalStreamSocket&& data )
+{
+  const uint64_t id = s.next_id++;
+  Connection& c
+    = *s.connections.emplace( key, make_unique<Connection>( id, config, std::move( adapter ), std::move( data ) ) )
+         .first->second;
+  s.timer_keys.emplace( id, key );
+  s.connection_count++;
+  c.last_tick = s.now;
+
+  // read from the application's pipe into the outbound stream
+  c.rules.push_back( s.eventloop.add_rule(
+    s.push_category,
+    c.data,
+    Direction::In,
+    [this, &s, &c] {
+      _advance( s, c );
+      string bytes;
+      bytes.resize( c.peer.outbound_writer().available_capacity() );
+      c.data.read( bytes );
+      c.peer.outbound_writer().push( std::move( bytes ) );
+      if ( c.data.eof() ) {
+        c.peer.outbound_writer().close();
+        c.outbound_shutdown = true;
+      }
+      c.peer.push( [&]( auto x ) { _transmit( s, c, x ); } );
+      _update( s, c );
+    },
+    [&c] {
+      return c.peer.active() and not c.outbound_shutdown and c.peer.outbound_writer().available_capacity() > 0;
+    },
+    [this, &s, &c] {
+      c.peer.outbound_writer().close();
+      c.outbound_shutdown = true;
+      _update( s, c );
+    },
+    [&c] { c.peer.outbound_writer().set_error(); } ) );
+
+  // write from the inbound stream into the application's pipe
+  c.rules.push_back( s.eventloop.add_rule(
+    s.inbound_category,
+    c.data,
+    Direction::Out,
+    [this, &s, &c] {
+      _advance( s, c );
+      Reader& inbound = c.peer.inbound_reader();
+      if ( inbound.bytes_buffered() ) {
+        inbound.pop( c.data.write( inbound.peek() ) );
+      }
+      if ( inbound.is_finished() or inbound.has_error() ) {
+        c.data.shutdown( SHUT_WR );
+        c.inbound_shutdown = true;
+      }
+      _update( s, c );
+    },
+    [&c] {
+      const Reader& inbound = c.peer.inbound_reader();
+      return inbound.bytes_buffered()
+             or ( ( inbound.is_finished() or inbound.has_error() ) and not c.inbound_shutdown );
+    },
+    [this, &s, &c] {
+      c.inbound_shutdown = true; // the application has gone away
+      _update( s, c );
+    },
+    [&c] { c.peer.inbound_reader().set_error(); } ) );
+
+  return c;
+}
+
+void TCPMinnowStack::_accept_syn( Shard& s, const FourTuple& key, const InternetDatagram& dgram )
+{
+  // a listening adapter takes its addresses from a SYN, and ignores anything else
+  TCPOverIPv4Adapter adapter;
+  adapter.config_mut().source = Address { "0", key.local_port };
+  adapter.set_listening( true );
+  auto msg = adapter.unwrap_tcp_in_ip( dgram );
+  if ( not msg.has_value() or msg->receiver.ackno.has_value() ) {
+    return;
+  }
+
+  uint64_t listener_key = _listen_key( key.local_ip, key.local_port );
+  TCPConfig config;
+  {
+    const lock_guard lock { _listeners_mutex };
+    auto it = _listeners.find( listener_key );
+    if ( it == _listeners.end() ) {
+      listener_key = _listen_key( 0, key.local_port );
+      it = _listeners.find( listener_key );
+    }
+    if ( it == _listeners.end() ) {
+      return;
+    }
+
+    Listener& listener = it->second;
+    if ( listener.handshaking >= listener.backlog or listener.accepted.size() >= listener.backlog ) {
+      return; // the queues are full; the client will retransmit its SYN
+    }
+    listener.handshaking++;
+    config = listener.config;
+  }
+  config.isn = Wrap32 { static_cast<uint32_t>( s.random() ) };
+
+  auto [application, data] = socket_pair_helper<LocalStreamSocket>( AF_UNIX, SOCK_STREAM );
+  Connection& c = _add( s, key, config, std::move( adapter ), std::move( data ) );
+  c.listener = listener_key;
+  c.application = std::move( application );
+  c.peer.receive( std::move( msg.value() ), [&]( auto x ) { _transmit( s, c, x ); } );
+  _update( s, c );
+}
+
+void TCPMinnowStack::_establish( Connection& c )
+{
+  {
+    const lock_guard lock { _listeners_mutex };
+    Listener& listener = _listeners.at( c.listener.value() );
+    listener.handshaking--;
+    listener.accepted.emplace_back( std::move( c.application.value() ), c.adapter.config().destination );
+  }
+  _accepted.notify_all();
+  c.listener.reset();
+  c.application.reset();
+}
+
+void TCPMinnowStack::_transmit( Shard& s, Connection& c, const TCPMessage& msg )
+{
+  PacketBuffer datagram;
+  c.adapter.wrap_tcp_in_ip( msg, datagram );
+  if ( s.device.has_value() ) {
+    _write_datagram( _devices[s.device.value()], std::move( datagram ) );
+  } else if ( s.outbound.push( std::move( datagram ) ) ) {
+    s.wrote = true;
+  } // else dropped, as by a full device
+}
+
+void TCPMinnowStack::_advance( Shard& s, Connection& c )
+{
+  if ( s.now > c.last_tick and c.peer.active() ) {
+    c.peer.tick( s.now - c.last_tick, [&]( auto x ) { _transmit( s, c, x ); } );
+  }
+  c.last_tick = s.now;
+}
+
+void TCPMinnowStack::_update( Shard& s, Connection& c )
+{
+  // the connection's rules are only asked for their interest on demand
+  for ( auto& rule : c.rules ) {
+    rule.update_interest();
+  }
+
+  if ( c.closing ) {
+    return;
+  }
+
+  // an inbound connection is ready for accept() once our SYN has been acknowledged
+  if ( c.listener.has_value() and c.peer.has_ackno() and c.peer.sender().sequence_numbers_in_flight() == 0
+       and c.peer.active() ) {
+    _establish( c );
+  }
+
+  if ( c.peer.active() ) {
+    if ( const auto deadline = c.peer.next_deadline_ms() ) {
+      s.timers.schedule( c.id, s.now + deadline.value() );
+    } else {
+      s.timers.cancel( c.id );
+    }
+    return;
+  }
+
+  // done once the TCPPeer is inactive and everything it received has reached the application
+  const Reader& inbound = c.peer.inbound_reader();
+  if ( c.inbound_shutdown or not( inbound.bytes_buffered() or inbound.is_finished() or inbound.has_error() ) ) {
+    c.closing = true;
+    s.timers.cancel( c.id );
+    s.finished.push_back( s.timer_keys.at( c.id ) );
+  }
+}
+
+void TCPMinnowStack::_remove( Shard& s, const FourTuple& key )
+{
+  const auto it = s.connections.find( key );
+  Connection& c = *it->second;
+  for ( auto& rule : c.rules ) {
+    rule.cancel();
+  }
+  try {
+    c.data.shutdown( SHUT_RDWR );
+  } catch ( const unix_error& ) {
+    // the application already closed its end
+  }
+  if ( c.listener.has_value() ) {
+    const lock_guard lock { _listeners_mutex };
+    _listeners.at( c.listener.value() ).handshaking--;
+  }
+
+  s.timer_keys.erase( c.id );
+  s.connections.erase( it );
+  s.connection_count--;
+}
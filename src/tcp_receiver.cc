@@ -1,5 +1,7 @@
 #include "tcp_receiver.hh"
 
+#include <algorithm>
+
 using namespace std;
 
 void TCPReceiver::receive( TCPSenderMessage message )
@@ -9,6 +11,8 @@ void TCPReceiver::receive( TCPSenderMessage message )
   }
   if ( message.SYN ) {
     zero_point_ = message.seqno;
+    peer_scales_ = message.window_scale.has_value();
+    peer_sack_ = message.sack_permitted;
   }
   if ( !zero_point_.has_value() ) {
     return;
@@ -19,6 +23,12 @@ void TCPReceiver::receive( TCPSenderMessage message )
   uint64_t absolute_seqno = seqno.unwrap( zero_point_.value(), checkpoint_ );
   uint64_t stream_index = ( message.SYN ? 0 : absolute_seqno - 1 );
 
+  if ( sack_ && !message.payload.empty() ) {
+    recent_inserts_.push_front( stream_index );
+    if ( recent_inserts_.size() > 4 * TCPReceiverMessage::MAX_SACK_BLOCKS ) {
+      recent_inserts_.pop_back();
+    }
+  }
   reassembler_.insert( stream_index, message.payload, message.FIN );
 }
 
@@ -29,9 +39,47 @@ TCPReceiverMessage TCPReceiver::send() const
   if ( zero_point_.has_value() ) {
     msg.ackno = Wrap32::wrap( checkpoint_, zero_point_.value() );
   }
-  msg.window_size = min( 65535ul, writer().available_capacity() );
+  if ( window_shift_.has_value() && peer_scales_ ) {
+    // 双方都同意缩放：窗口可以超过 65535，但只能以 2^shift 为单位通告，向下取整
+    const uint64_t window = min( uint64_t { UINT16_MAX } << *window_shift_, writer().available_capacity() );
+    msg.window_size = window >> *window_shift_ << *window_shift_;
+  } else {
+    msg.window_size = min( uint64_t { UINT16_MAX }, writer().available_capacity() );
+  }
+  if ( sack_ && peer_sack_ && zero_point_.has_value() ) {
+    msg.sack = sack_blocks();
+  }
   if ( reassembler_.reader().has_error() || reassembler_.writer().has_error() ) {
     msg.RST = true;
   }
   return msg;
 }
+
+vector<pair<Wrap32, Wrap32>> TCPReceiver::sack_blocks() const
+{
+  auto intervals = reassembler_.pending_intervals();
+
+  // RFC 2018 4：第一个块包含最近收到的报文段，其后是最近报告过的块，这样每个块都会被重复报告几次；
+  // 剩余位置按序号从小到大填充
+  auto ordered = intervals.begin();
+  for ( const uint64_t index : recent_inserts_ ) {
+    const auto it = find_if( ordered, intervals.end(), [&]( const auto& iv ) {
+      return iv.first <= index && index < iv.second;
+    } );
+    if ( it != intervals.end() ) {
+      rotate( ordered, it, it + 1 );
+      ++ordered;
+    }
+  }
+
+  vector<pair<Wrap32, Wrap32>> blocks;
+  for ( const auto& [first, last] : intervals ) {
+    if ( blocks.size() == TCPReceiverMessage::MAX_SACK_BLOCKS ) {
+      break;
+    }
+    // 流下标 + 1 才是绝对序号（SYN 占用了序号 0）
+    blocks.emplace_back( Wrap32::wrap( first + 1, zero_point_.value() ),
+                         Wrap32::wrap( last + 1, zero_point_.value() ) );
+  }
+  return blocks;
+}
@@ -4,12 +4,24 @@
 #include "tcp_receiver_message.hh"
 #include "tcp_sender_message.hh"
 
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <utility>
+#include <vector>
+
 class TCPReceiver
 {
 public:
-  // Construct with given Reassembler
-  explicit TCPReceiver( Reassembler&& reassembler )
-    : reassembler_( std::move( reassembler ) ), zero_point_( std::nullopt )
+  // Construct with given Reassembler, the window scale to offer if window scaling is wanted, and whether
+  // to offer selective acknowledgments
+  explicit TCPReceiver( Reassembler&& reassembler,
+                        std::optional<uint8_t> window_shift = std::nullopt,
+                        bool sack = false )
+    : reassembler_( std::move( reassembler ) )
+    , zero_point_( std::nullopt )
+    , window_shift_( window_shift )
+    , sack_( sack )
   {}
 
   /*
@@ -27,8 +39,21 @@ public:
   const Reader& reader() const { return reassembler_.reader(); }
   const Writer& writer() const { return reassembler_.writer(); }
 
+  // Did the peer's SYN offer window scaling, or permit selective acknowledgments?
+  bool peer_scales() const { return peer_scales_; }
+  bool peer_sack() const { return peer_sack_; }
+
 private:
   Reassembler reassembler_;
 
   std::optional<Wrap32> zero_point_;
+
+  std::optional<uint8_t> window_shift_; // 本端希望使用的窗口缩放因子
+  bool peer_scales_ {};                 // 对方的 SYN 是否带有窗口缩放选项
+
+  bool sack_;                             // 本端是否提供 SACK
+  bool peer_sack_ {};                     // 对方的 SYN 是否允许 SACK
+  std::deque<uint64_t> recent_inserts_ {}; // 最近收到的报文段的流下标，新的在前，用于给 SACK 块排序
+
+  std::vector<std::pair<Wrap32, Wrap32>> sack_blocks() const;
 };
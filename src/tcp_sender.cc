@@ -1,19 +1,50 @@
 #include "tcp_sender.hh"
 #include "tcp_config.hh"
 #include <algorithm>
+#include <cmath>
+#include <optional>
 
 using namespace std;
 
 void TCPSender::push( const TransmitFunction& transmit )
 {
+  if ( need_fast_retransmit_ ) {
+    need_fast_retransmit_ = false;
+    retransmit_lost( transmit );
+  }
+
   Reader& bytes_reader = input_.reader();
-  const size_t window_size = wnd_size_ == 0 ? 1 : wnd_size_;
+  paced_bytes_ = 0;
+  // 有效窗口为拥塞窗口与对方通告窗口中较小者
+  const uint64_t receive_window = wnd_size_ == 0 ? 1 : wnd_size_;
+  const uint64_t window_size = min( receive_window, congestion_window() );
+  bool held_back = false;
   // 不断组装并发送分组数据报，且在 FIN 发出后不再尝试组装报文
   for ( string payload {}; !sent_fin_; payload.clear() ) {
     // 从流中读取数据并组装报文，直到达到报文长度限制或窗口上限
-    const uint64_t max_payload_size
-      = min( TCPConfig::MAX_PAYLOAD_SIZE, window_size - ( num_bytes_in_flight_ + ( !sent_syn_ ) ) );
-    read( bytes_reader, min( max_payload_size, bytes_reader.bytes_buffered() ), payload );
+    const uint64_t window_used = num_bytes_in_flight_ + ( !sent_syn_ );
+    const uint64_t window_left = window_size > window_used ? window_size - window_used : 0;
+    uint64_t payload_size = min( { max_send_size(), window_left, bytes_reader.bytes_buffered() } );
+    // 路径 MTU 探测分组要装满数据（RFC 4821 第 7.4 节），窗口和待发的数据都够时才发
+    const uint64_t probe = probe_size();
+    const bool probing = probe > 0 && window_left >= probe && bytes_reader.bytes_buffered() >= probe;
+    if ( probing ) {
+      payload_size = probe;
+    }
+    if ( hold_back( payload_size ) ) {
+      held_back = true;
+      break;
+    }
+    // 令牌不够发这个数据分组：留在流里，等 tick() 补充（只有 SYN、FIN 的空分组不限速）
+    const double rate = pacing_rate();
+    if ( payload_size > 0 && rate > 0 && pacing_tokens_ < static_cast<double>( payload_size ) ) {
+      paced_bytes_ = payload_size;
+      break;
+    }
+    if ( rate > 0 ) {
+      pacing_tokens_ -= static_cast<double>( payload_size );
+    }
+    read( bytes_reader, payload_size, payload );
     // 判断 FIN 能否在此刻发出去
     if ( payload.length() + num_bytes_in_flight_ + ( !sent_syn_ ) + 1 <= window_size ) {
       sent_fin_ |= bytes_reader.is_finished();
@@ -23,13 +54,139 @@ void TCPSender::push( const TransmitFunction& transmit )
     if ( msg.sequence_length() == 0 ) {
       break;
     }
-    outstanding_bytes_.push( msg );
+    outstanding_bytes_.push_back( { .msg = msg, .sent_time = current_time_, .probe = probing } );
+    stamp( outstanding_bytes_.back() );
+    if ( probing ) {
+      pmtu_probe_size_ = probe;
+    } else {
+      // TSO 的超大分组在线路上是一个个 MSS 大小的分组：按 MSS 记录，重传和 SACK 都以单个分组为单位
+      split_outstanding( outstanding_bytes_.size() - 1, mss_ );
+    }
     num_bytes_in_flight_ += msg.sequence_length();
     next_seqno_ += msg.sequence_length();
     sent_syn_ = true;
     transmit( msg );
     timer_.active();
   }
+
+  // cork 扣住数据最多 MAX_CORK_DELAY（与 Linux 的 TCP_CORK 相同），到时由 tick() 放行
+  if ( !held_back || !corked_ ) {
+    cork_deadline_.reset();
+  } else if ( !cork_deadline_.has_value() ) {
+    cork_deadline_ = current_time_ + TCPConfig::MAX_CORK_DELAY;
+  }
+
+  // 数据发完了而窗口还有余量：此后的速率采样反映的是应用而不是网络
+  if ( bytes_reader.bytes_buffered() == 0 && num_bytes_in_flight_ < window_size ) {
+    app_limited_until_ = max<uint64_t>( delivered_ + num_bytes_in_flight_, 1 );
+  }
+}
+
+bool TCPSender::hold_back( uint64_t payload_size ) const
+{
+  // 满 MSS 的分组、握手、流已关闭（FIN 随最后的数据一起走）和零窗口探测都不等待
+  if ( payload_size == 0 || payload_size >= mss_ || !sent_syn_ || input_.writer().is_closed() || wnd_size_ == 0 ) {
+    return false;
+  }
+  // 对方的窗口装不下一个满 MSS 的分组时，cork 等不到满的分组；扣住的时间也有上限
+  const bool cork_expired = cork_deadline_.has_value() && current_time_ >= *cork_deadline_;
+  const bool cork = corked_ && wnd_size_ >= mss_ && !cork_expired;
+  return cork || ( nagle_ && num_bytes_in_flight_ > 0 );
+}
+
+void TCPSender::retransmit_lost( const TransmitFunction& transmit )
+{
+  if ( outstanding_bytes_.empty() ) {
+    return;
+  }
+
+  if ( !peer_sacks_ ) {
+    // 重复 ACK 是探测分组之后的分组引起的：它们比探测分组小，却到了
+    if ( outstanding_bytes_.front().probe ) {
+      probe_lost( true );
+    }
+    outstanding_bytes_.front().retransmitted = true;
+    stamp( outstanding_bytes_.front() );
+    transmit( outstanding_bytes_.front().msg );
+    timer_.reset();
+    return;
+  }
+
+  // RFC 6675 IsLost：其后已有 DUP_ACK_THRESHOLD 个分组被 SACK，或被 SACK 的字节超过
+  // (DUP_ACK_THRESHOLD - 1) 个 MSS；队首分组在重复 ACK 达到阈值时也视为丢失。
+  // 对方使用 SACK 时，部分确认本身不再说明队首丢失。每个缺口只快速重传一次，再次丢失交给超时处理
+  vector<bool> lost( outstanding_bytes_.size() );
+  uint64_t sacked_segments = 0;
+  uint64_t sacked_bytes = 0;
+  for ( size_t i = outstanding_bytes_.size(); i-- > 0; ) {
+    const auto& seg = outstanding_bytes_[i];
+    if ( seg.sacked ) {
+      ++sacked_segments;
+      sacked_bytes += seg.msg.sequence_length();
+      continue;
+    }
+    lost[i] = ( i == 0 && dup_acks_ >= TCPConfig::DUP_ACK_THRESHOLD )
+              || sacked_segments >= TCPConfig::DUP_ACK_THRESHOLD
+              || sacked_bytes > ( TCPConfig::DUP_ACK_THRESHOLD - 1 ) * mss_;
+  }
+
+  // 丢失的探测分组不原样重传：切开以后重新判断
+  for ( size_t i = 0; i < outstanding_bytes_.size(); ++i ) {
+    if ( lost[i] && outstanding_bytes_[i].probe ) {
+      probe_lost( true );
+      retransmit_lost( transmit );
+      return;
+    }
+  }
+
+  for ( size_t i = 0; i < outstanding_bytes_.size(); ++i ) {
+    auto& seg = outstanding_bytes_[i];
+    if ( lost[i] && !seg.retransmitted ) {
+      seg.retransmitted = true;
+      stamp( seg );
+      transmit( seg.msg );
+      timer_.reset();
+    }
+  }
+}
+
+bool TCPSender::update_scoreboard( const vector<pair<Wrap32, Wrap32>>& blocks )
+{
+  bool newly_sacked = false;
+  for ( const auto& [begin, end] : blocks ) {
+    const uint64_t first = begin.unwrap( isn_, next_seqno_ );
+    const uint64_t last = end.unwrap( isn_, next_seqno_ );
+    if ( last <= first || last > next_seqno_ ) {
+      continue; // 无效的块
+    }
+    // 只有完整落在块内的分组才算收到
+    for ( auto& seg : outstanding_bytes_ ) {
+      const uint64_t seqno = seg.msg.seqno.unwrap( isn_, next_seqno_ );
+      if ( !seg.sacked && first <= seqno && seqno + seg.msg.sequence_length() <= last ) {
+        seg.sacked = true;
+        newly_sacked = true;
+        if ( seg.probe ) {
+          seg.probe = false;
+          probe_acked();
+        }
+      }
+    }
+  }
+  return newly_sacked;
+}
+
+void TCPSender::stamp( OutstandingSegment& segment )
+{
+  // 没有在途数据时开始一个新的发送区间
+  if ( num_bytes_in_flight_ == 0 ) {
+    first_sent_time_ = current_time_;
+    delivered_time_ = current_time_;
+  }
+  segment.sent_time = current_time_;
+  segment.delivered = delivered_;
+  segment.delivered_time = delivered_time_;
+  segment.first_sent_time = first_sent_time_;
+  segment.app_limited = app_limited_until_ != 0;
 }
 
 TCPSenderMessage TCPSender::make_empty_message() const
@@ -37,8 +194,9 @@ TCPSenderMessage TCPSender::make_empty_message() const
   return make_message( next_seqno_, {}, false );
 }
 
-void TCPSender::receive( const TCPReceiverMessage& msg )
+void TCPSender::receive( const TCPReceiverMessage& msg, bool carries_data )
 {
+  const uint32_t last_wnd_size = wnd_size_;
   wnd_size_ = msg.window_size;
   if ( !msg.ackno.has_value() ) {
     if ( msg.window_size == 0 )
@@ -51,8 +209,12 @@ void TCPSender::receive( const TCPReceiverMessage& msg )
     return;                            // 不接受这个确认报文
 
   bool is_acknowledged = false; // 用于判断确认是否发生
+  uint64_t acked_payload = 0;   // 本次确认的数据字节数（不计 SYN/FIN）
+  const bool was_in_recovery = cc_ && cc_->in_recovery();
+  optional<uint64_t> rtt_sample;
+  AckSample sample;
   while ( !outstanding_bytes_.empty() ) {
-    auto& buffered_msg = outstanding_bytes_.front();
+    auto& buffered_msg = outstanding_bytes_.front().msg;
     // 对方期待的下一字节不大于队首的字节序号，或者队首分组只有部分字节被确认
     const uint64_t final_seqno = acked_seqno_ + buffered_msg.sequence_length() - buffered_msg.SYN;
     if ( excepting_seqno <= acked_seqno_ || excepting_seqno < final_seqno ) {
@@ -60,11 +222,78 @@ void TCPSender::receive( const TCPReceiverMessage& msg )
     }
 
     is_acknowledged = true; // 表示有字节被确认
+    acked_payload += buffered_msg.payload.size();
     num_bytes_in_flight_ -= buffered_msg.sequence_length() - syn_flag_;
     acked_seqno_ += buffered_msg.sequence_length() - syn_flag_;
     // 最后检查 syn 是否被确认
     syn_flag_ = sent_syn_ ? syn_flag_ : excepting_seqno <= next_seqno_;
-    outstanding_bytes_.pop();
+    // 用本次确认的最后一个（最近发送的）分组测量 RTT，重传过的分组不采样
+    const auto& acked = outstanding_bytes_.front();
+    if ( acked.retransmitted ) {
+      rtt_sample.reset();
+    } else {
+      rtt_sample = current_time_ - acked.sent_time;
+    }
+    // 交付速率采样：取发送区间与确认区间中较长者，避免 ACK 压缩导致高估
+    delivered_ += buffered_msg.payload.size();
+    delivered_time_ = current_time_;
+    first_sent_time_ = acked.sent_time;
+    sample.prior_delivered = acked.delivered;
+    sample.delivered = delivered_ - acked.delivered;
+    sample.interval = max( acked.sent_time - acked.first_sent_time, delivered_time_ - acked.delivered_time );
+    sample.app_limited = acked.app_limited;
+    if ( acked.probe ) {
+      probe_acked();
+    }
+    outstanding_bytes_.pop_front();
+  }
+
+  if ( rtt_sample.has_value() ) {
+    timer_.sample_RTT( *rtt_sample );
+  }
+
+  peer_sacks_ |= !msg.sack.empty();
+  const bool newly_sacked = update_scoreboard( msg.sack );
+
+  if ( cc_ && is_acknowledged ) {
+    sample.now = current_time_;
+    sample.ackno = acked_seqno_;
+    sample.acked_bytes = acked_payload;
+    sample.bytes_in_flight = num_bytes_in_flight_;
+    sample.rtt = rtt_sample;
+    sample.total_delivered = delivered_;
+    cc_->on_ack( sample );
+    // 快速恢复中的部分确认：下一个缺口也丢了，立即重传
+    if ( was_in_recovery && cc_->in_recovery() && !outstanding_bytes_.empty() ) {
+      need_fast_retransmit_ = true;
+    }
+  }
+
+  // 没有确认新数据、窗口也没变的 ACK 视为重复 ACK；累计到阈值时快速重传队首分组
+  // （receive() 没有 transmit，重传留到下一次 push() 发出）。
+  // 搭在对方数据（或 SYN、FIN）上的 ACK 不算重复 ACK（RFC 5681 第 2 节），但也不打断计数
+  const bool no_progress = !is_acknowledged && !outstanding_bytes_.empty() && excepting_seqno == acked_seqno_
+                           && msg.window_size == last_wnd_size;
+  if ( !no_progress ) {
+    dup_acks_ = 0;
+  } else if ( fast_retransmit_ && !carries_data ) {
+    ++dup_acks_;
+    if ( dup_acks_ == TCPConfig::DUP_ACK_THRESHOLD && !( cc_ && cc_->in_recovery() ) ) {
+      need_fast_retransmit_ = true;
+      if ( cc_ ) {
+        cc_->on_loss( current_time_, num_bytes_in_flight_, next_seqno_ );
+      }
+    } else if ( cc_ ) {
+      cc_->on_dup_ack();
+    }
+  }
+  // 快速重传之后，新的 SACK 信息可能暴露出更多缺口
+  if ( no_progress && fast_retransmit_ && newly_sacked && dup_acks_ > TCPConfig::DUP_ACK_THRESHOLD ) {
+    need_fast_retransmit_ = true;
+  }
+
+  if ( app_limited_until_ != 0 && delivered_ > app_limited_until_ ) {
+    app_limited_until_ = 0;
   }
 
   if ( is_acknowledged ) {
@@ -79,14 +308,203 @@ void TCPSender::receive( const TCPReceiverMessage& msg )
 
 void TCPSender::tick( uint64_t ms_since_last_tick, const TransmitFunction& transmit )
 {
+  current_time_ += ms_since_last_tick;
   timer_.tick( ms_since_last_tick );
+  if ( timer_.is_expired() && pmtu_discovery_ && !outstanding_bytes_.empty() ) {
+    if ( outstanding_bytes_.front().probe ) {
+      // 探测分组超时：其后有分组被 SACK，说明更小的分组能通过；否则也可能只是拥塞，不算这个大小失败
+      probe_lost( ranges::any_of( outstanding_bytes_, &OutstandingSegment::sacked ) );
+    } else if ( timer_.cnt_retransmit() + 1 >= TCPConfig::PMTU_TIMEOUTS
+                && outstanding_bytes_.front().msg.payload.size() > TCPConfig::MIN_MSS ) {
+      // 同一个分组连续超时，且它比最小 MSS 大：可能是路径 MTU 变小后被静默丢弃了
+      fall_back_to_min_mss();
+    }
+  }
   if ( timer_.is_expired() ) {
-    transmit( outstanding_bytes_.front() ); // 只传递队首元素
+    const size_t count = go_back_n_ ? outstanding_bytes_.size() : 1; // 默认只传递队首元素
+    for ( auto it = outstanding_bytes_.begin(); it != outstanding_bytes_.begin() + count; ++it ) {
+      if ( it->sacked ) {
+        continue; // 对方已经收到
+      }
+      it->retransmitted = true;
+      stamp( *it );
+      transmit( it->msg );
+    }
+    dup_acks_ = 0;
     timer_.reset();
+    if ( cc_ && wnd_size_ != 0 ) {
+      cc_->on_timeout( current_time_, num_bytes_in_flight_ );
+    }
     if ( wnd_size_ != 0 )
       timer_.timeout();
     timer_.add_retransmit();
   }
+
+  // 探测结束一段时间以后，路径可能变了：重新向上探测到 max_mss_（RFC 4821 第 7.7 节）
+  if ( pmtu_discovery_ && pmtu_search_done() && pmtu_high_ < max_mss_ && current_time_ >= pmtu_next_probe_ ) {
+    pmtu_high_ = max_mss_;
+    pmtu_bisect_ = false;
+  }
+
+  // 补充令牌；桶的容量为两个 MSS 或 1ms 的发送量，取较大者
+  const double rate = pacing_rate();
+  if ( rate > 0 ) {
+    const double burst = max( 2.0 * static_cast<double>( mss_ ), rate );
+    pacing_tokens_ = min( pacing_tokens_ + rate * static_cast<double>( ms_since_last_tick ), burst );
+  }
+  if ( paced_bytes_ > 0 || ( cork_deadline_.has_value() && current_time_ >= *cork_deadline_ ) ) {
+    push( transmit );
+  }
+}
+
+double TCPSender::pacing_rate() const
+{
+  if ( !pacing_ ) {
+    return 0;
+  }
+  if ( cc_ && cc_->pacing_rate() > 0 ) {
+    return cc_->pacing_rate(); // 算法自己给出了速率（BBR）
+  }
+  // 否则约为 cwnd / SRTT；还没有 RTT 采样时按 1ms 算，相当于不限速
+  const double gain = cc_ && cc_->in_slow_start() ? SLOW_START_PACING_GAIN : CONGESTION_AVOIDANCE_PACING_GAIN;
+  const uint64_t window = min<uint64_t>( congestion_window(), max<uint32_t>( wnd_size_, 1 ) );
+  return gain * static_cast<double>( window ) / max( timer_.srtt(), 1.0 );
+}
+
+optional<uint64_t> TCPSender::pacing_delay_ms() const
+{
+  const double rate = pacing_rate();
+  if ( paced_bytes_ == 0 || rate <= 0 ) {
+    return nullopt;
+  }
+  const double missing = static_cast<double>( paced_bytes_ ) - pacing_tokens_;
+  return max<uint64_t>( static_cast<uint64_t>( ceil( missing / rate ) ), 1 );
+}
+
+optional<uint64_t> TCPSender::next_deadline_ms() const
+{
+  // 计时器不活动、令牌桶和 cork 都没有扣住分组时，tick() 什么也不会做，不需要被唤醒
+  optional<uint64_t> deadline = pacing_delay_ms();
+  const auto consider = [&]( uint64_t remaining ) { deadline = min( deadline.value_or( remaining ), remaining ); };
+  if ( timer_.is_active() ) {
+    consider( timer_.remaining() );
+  }
+  // 已经到时却还被 Nagle 扣住的数据等 ACK 放行，不用再唤醒
+  if ( cork_deadline_.has_value() && *cork_deadline_ > current_time_ ) {
+    consider( *cork_deadline_ - current_time_ );
+  }
+  return deadline;
+}
+
+void TCPSender::set_peer_mss( uint16_t peer_mss )
+{
+  // 只在握手阶段（还没有发出数据）接受；重复的 SYN 不应改变已经开始的连接
+  if ( next_seqno_ > 1 || peer_mss == 0 ) {
+    return;
+  }
+  max_mss_ = min<uint64_t>( max_mss_, peer_mss );
+  start_pmtu_search();
+  cc_ = CongestionControl::make( cc_algorithm_, mss_ ); // 初始窗口依赖 MSS，此时控制器还没有状态
+}
+
+size_t TCPSender::split_outstanding( size_t index, uint64_t size )
+{
+  if ( outstanding_bytes_[index].msg.payload.size() <= size ) {
+    return 1;
+  }
+
+  // SYN 留在第一片，FIN 留在最后一片，其余状态每片相同
+  OutstandingSegment seg = move( outstanding_bytes_[index] );
+  const string payload = move( seg.msg.payload );
+  vector<OutstandingSegment> pieces;
+  Wrap32 seqno = seg.msg.seqno;
+  for ( size_t offset = 0; offset < payload.size(); offset += size ) {
+    OutstandingSegment piece = seg;
+    piece.msg.seqno = seqno;
+    piece.msg.SYN = seg.msg.SYN && offset == 0;
+    piece.msg.payload = payload.substr( offset, size );
+    piece.msg.FIN = seg.msg.FIN && offset + size >= payload.size();
+    piece.probe = false;
+    seqno = seqno + piece.msg.sequence_length();
+    pieces.push_back( move( piece ) );
+  }
+
+  const auto at = outstanding_bytes_.erase( outstanding_bytes_.begin() + static_cast<ptrdiff_t>( index ) );
+  outstanding_bytes_.insert( at, make_move_iterator( pieces.begin() ), make_move_iterator( pieces.end() ) );
+  return pieces.size();
+}
+
+void TCPSender::start_pmtu_search()
+{
+  pmtu_high_ = max_mss_;
+  pmtu_bisect_ = false;
+  mss_ = pmtu_discovery_ ? min<uint64_t>( max_mss_, TCPConfig::PMTU_BASE_MSS ) : max_mss_;
+}
+
+uint64_t TCPSender::probe_size() const
+{
+  // 握手完成前、恢复丢包期间都不探测：这时丢了探测分组，分辨不出原因
+  if ( !pmtu_discovery_ || acked_seqno_ == 0 || pmtu_probe_size_ > 0 || pmtu_search_done()
+       || current_time_ < pmtu_next_probe_ || timer_.cnt_retransmit() > 0 || dup_acks_ > 0
+       || ( cc_ && cc_->in_recovery() ) ) {
+    return 0;
+  }
+  return pmtu_bisect_ ? ( mss_ + pmtu_high_ + 1 ) / 2 : pmtu_high_;
+}
+
+void TCPSender::probe_acked()
+{
+  set_mss( pmtu_probe_size_ );
+  pmtu_probe_size_ = 0;
+  pmtu_probe_failures_ = 0;
+  schedule_probe();
+}
+
+void TCPSender::probe_lost( bool smaller_got_through )
+{
+  const auto probe = ranges::find_if( outstanding_bytes_, &OutstandingSegment::probe );
+  if ( probe != outstanding_bytes_.end() ) {
+    split_outstanding( static_cast<size_t>( probe - outstanding_bytes_.begin() ), mss_ );
+  }
+  // 同一个大小连续失败 PMTU_MAX_PROBES 次，才认定它超过了路径 MTU
+  if ( smaller_got_through && ++pmtu_probe_failures_ >= TCPConfig::PMTU_MAX_PROBES ) {
+    pmtu_high_ = pmtu_probe_size_ - 1;
+    pmtu_bisect_ = true;
+    pmtu_probe_failures_ = 0;
+  }
+  pmtu_probe_size_ = 0;
+  schedule_probe();
+}
+
+void TCPSender::fall_back_to_min_mss()
+{
+  // 也可能只是拥塞：原来的大小并不作废，而是成为下一个探测的大小，探测不过才真正放弃它
+  pmtu_high_ = mss_;
+  pmtu_bisect_ = false;
+  pmtu_probe_size_ = 0;
+  pmtu_probe_failures_ = 0;
+  set_mss( TCPConfig::MIN_MSS );
+  for ( size_t i = 0; i < outstanding_bytes_.size(); i += split_outstanding( i, mss_ ) ) {}
+  schedule_probe();
+}
+
+bool TCPSender::pmtu_search_done() const
+{
+  // 上限本身还没探测过就总要探测一次；之后在中间探测，离失败的大小足够近时停止
+  return pmtu_high_ <= mss_ || ( pmtu_bisect_ && pmtu_high_ < mss_ + TCPConfig::PMTU_SEARCH_STEP );
+}
+
+void TCPSender::schedule_probe()
+{
+  pmtu_next_probe_ = current_time_ + ( pmtu_search_done() ? TCPConfig::PMTU_REPROBE_MS : 0 );
+}
+
+void TCPSender::set_mss( uint64_t mss )
+{
+  mss_ = mss;
+  if ( cc_ ) {
+    cc_->set_mss( mss_ );
+  }
 }
 
 TCPSenderMessage TCPSender::make_message( uint64_t seqno, string payload, bool SYN, bool FIN ) const
@@ -98,6 +516,31 @@ TCPSenderMessage TCPSender::make_message( uint64_t seqno, string payload, bool S
            .RST = input_.reader().has_error() };
 }
 
+uint64_t TCPSender::max_segment_size() const
+{
+  return mss_;
+}
+
+uint64_t TCPSender::negotiated_mss() const
+{
+  return max_mss_;
+}
+
+uint64_t TCPSender::max_send_size() const
+{
+  // 通常就是 MSS；TSO 时交给设备一个 MSS 整数倍的超大分组，由设备切分。
+  // 限速的令牌桶装不下超大分组，缩小 MSS 也要求每个分组都不超过 MSS，这两种情况都不用 TSO
+  if ( tso_size_ <= mss_ || pacing_ || pmtu_discovery_ ) {
+    return mss_;
+  }
+  return tso_size_ / mss_ * mss_; // 设备切出的每一片（除了最后一片）都是满 MSS
+}
+
+uint64_t TCPSender::pmtu_probe_size() const
+{
+  return pmtu_probe_size_;
+}
+
 uint64_t TCPSender::sequence_numbers_in_flight() const
 {
   return num_bytes_in_flight_;
@@ -107,3 +550,37 @@ uint64_t TCPSender::consecutive_retransmissions() const
 {
   return timer_.cnt_retransmit();
 }
+
+double TCPSender::smoothed_RTT_ms() const
+{
+  return timer_.srtt();
+}
+
+uint64_t TCPSender::current_RTO_ms() const
+{
+  return timer_.RTO();
+}
+
+uint64_t TCPSender::congestion_window() const
+{
+  return cc_ ? cc_->window() : UINT64_MAX;
+}
+
+void RetransmissionTimer::sample_RTT( uint64_t rtt_ms ) noexcept
+{
+  // RFC 6298 (2.2), (2.3)：alpha = 1/8，beta = 1/4，K = 4，时钟粒度 G 取 1ms
+  const auto r = static_cast<double>( rtt_ms );
+  if ( !has_sample_ ) {
+    srtt_ = r;
+    rttvar_ = r / 2;
+    has_sample_ = true;
+  } else {
+    rttvar_ = 0.75 * rttvar_ + 0.25 * abs( srtt_ - r );
+    srtt_ = 0.875 * srtt_ + 0.125 * r;
+  }
+
+  if ( adaptive_ ) {
+    const auto rto = static_cast<uint64_t>( ceil( srtt_ + max( 1.0, 4 * rttvar_ ) ) );
+    base_RTO_ = max( rto, min_RTO_ );
+  }
+}
@@ -1,19 +1,25 @@
 #pragma once
 
 #include "byte_stream.hh"
+#include "congestion_control.hh"
+#include "tcp_config.hh"
 #include "tcp_receiver_message.hh"
 #include "tcp_sender_message.hh"
 
+#include <algorithm>
 #include <cstdint>
+#include <deque>
 #include <functional>
-#include <queue>
+#include <memory>
+#include <optional>
 #include <utility>
+#include <vector>
 
 // 超时计时器
 class RetransmissionTimer
 {
 public:
-  RetransmissionTimer( uint64_t initial_RTO_ms ) : initial_RTO_( initial_RTO_ms ), RTO_( initial_RTO_ms ) {}
+  RetransmissionTimer( uint64_t initial_RTO_ms ) : base_RTO_( initial_RTO_ms ), RTO_( initial_RTO_ms ) {}
   bool is_expired() const noexcept { return is_active_ && time_passed_ >= RTO_; }
   bool is_active() const noexcept { return is_active_; }
   void active() noexcept { is_active_ = true; }
@@ -21,7 +27,7 @@ public:
   void reset() noexcept { time_passed_ = 0; }
   void restart() noexcept
   {
-    RTO_ = initial_RTO_;
+    RTO_ = base_RTO_;
     time_passed_ = 0;
     is_active_ = false;
     retransmission_cnt_ = 0;
@@ -31,12 +37,29 @@ public:
   void add_retransmit() noexcept { retransmission_cnt_++; }
   uint64_t cnt_retransmit() const noexcept { return retransmission_cnt_; }
 
+  // RFC 6298 的 RTT 估计；只有 adaptive 时才用估计值代替初始 RTO
+  void set_adaptive( bool adaptive, uint64_t min_RTO_ms ) noexcept
+  {
+    adaptive_ = adaptive;
+    min_RTO_ = min_RTO_ms;
+  }
+  void sample_RTT( uint64_t rtt_ms ) noexcept;
+  double srtt() const noexcept { return srtt_; }
+  uint64_t RTO() const noexcept { return RTO_; }
+  uint64_t remaining() const noexcept { return time_passed_ >= RTO_ ? 0 : RTO_ - time_passed_; }
+
 private:
-  const uint64_t initial_RTO_;
+  uint64_t base_RTO_; // 未退避时的 RTO：初始值，或 adaptive 时由 RTT 估计得出
   uint64_t RTO_;
   uint64_t time_passed_ {};
   bool is_active_ {};
   uint64_t retransmission_cnt_ {};
+
+  bool adaptive_ {};
+  uint64_t min_RTO_ {};
+  bool has_sample_ {};
+  double srtt_ {};
+  double rttvar_ {};
 };
 
 class TCPSender
@@ -47,11 +70,29 @@ public:
     : input_( std::move( input ) ), isn_( isn ), initial_RTO_ms_( initial_RTO_ms ), timer_( initial_RTO_ms )
   {}
 
+  /* Construct TCP sender with the ISN, initial RTO and loss-recovery options taken from a TCPConfig */
+  TCPSender( ByteStream&& input, const TCPConfig& cfg ) : TCPSender( std::move( input ), cfg.isn, cfg.rt_timeout )
+  {
+    max_mss_ = cfg.mss;
+    pmtu_discovery_ = cfg.pmtu_discovery;
+    start_pmtu_search();
+    tso_size_ = std::min( cfg.tso_size, TCPConfig::MAX_TSO_SIZE );
+    nagle_ = cfg.nagle;
+    pacing_ = cfg.pacing;
+    pacing_tokens_ = 2.0 * static_cast<double>( mss_ );
+    cc_algorithm_ = cfg.congestion_control;
+    cc_ = CongestionControl::make( cfg.congestion_control, mss_ );
+    fast_retransmit_ = cfg.fast_retransmit or cc_ != nullptr; // 拥塞控制依赖重复 ACK 检测丢包
+    go_back_n_ = cfg.go_back_n;
+    timer_.set_adaptive( cfg.adaptive_rto, cfg.min_rt_timeout );
+  }
+
   /* Generate an empty TCPSenderMessage */
   TCPSenderMessage make_empty_message() const;
 
-  /* Receive and process a TCPReceiverMessage from the peer's receiver */
-  void receive( const TCPReceiverMessage& msg );
+  /* Receive and process a TCPReceiverMessage from the peer's receiver. `carries_data` says whether the segment
+     it arrived on also carried a payload, SYN or FIN; only a segment without any is a duplicate ACK (RFC 5681). */
+  void receive( const TCPReceiverMessage& msg, bool carries_data = false );
 
   /* Type of the `transmit` function that the push and tick methods can use to send messages */
   using TransmitFunction = std::function<void( const TCPSenderMessage& )>;
@@ -62,9 +103,27 @@ public:
   /* Time has passed by the given # of milliseconds since the last time the tick() method was called */
   void tick( uint64_t ms_since_last_tick, const TransmitFunction& transmit );
 
+  /* The peer's SYN advertised the largest segment it will accept */
+  void set_peer_mss( uint16_t peer_mss );
+
+  /* While corked, only full-sized segments are sent; uncorking lets the next push() send the rest. A partial
+     segment is still sent after MAX_CORK_DELAY, or if the peer's window could never take a full one. */
+  void set_cork( bool corked ) { corked_ = corked; }
+
   // Accessors
-  uint64_t sequence_numbers_in_flight() const;  // How many sequence numbers are outstanding?
-  uint64_t consecutive_retransmissions() const; // How many consecutive *re*transmissions have happened?
+  uint64_t sequence_numbers_in_flight() const;      // How many sequence numbers are outstanding?
+  uint64_t consecutive_retransmissions() const;     // How many consecutive *re*transmissions have happened?
+  double smoothed_RTT_ms() const;                   // Smoothed round-trip time (0 until the first sample)
+  uint64_t current_RTO_ms() const;                  // Retransmission timeout in effect, including any backoff
+  uint64_t congestion_window() const;               // Congestion window in bytes (UINT64_MAX if disabled)
+  uint64_t max_segment_size() const;                // Largest payload of a segment on the wire
+  uint64_t negotiated_mss() const;                  // Smaller of our MSS and the peer's SYN option
+  uint64_t max_send_size() const;                   // Largest payload of a segment passed to transmit (TSO)
+  uint64_t pmtu_probe_size() const;                 // Payload of the path MTU probe in flight (0 if none)
+  bool corked() const { return corked_; }           // Are sub-MSS segments being held until uncorked?
+  double pacing_rate() const;                       // Pacing rate in bytes per ms (0 if not pacing)
+  std::optional<uint64_t> pacing_delay_ms() const;  // ms until the pacer can release the segment it holds
+  std::optional<uint64_t> next_deadline_ms() const; // ms until tick() has work to do (retransmit, pacer, cork)
   Writer& writer() { return input_.writer(); }
   const Writer& writer() const { return input_.writer(); }
 
@@ -79,7 +138,7 @@ private:
   Wrap32 isn_;
   uint64_t initial_RTO_ms_;
 
-  uint16_t wnd_size_ { 1 }; // 初始假定窗口大小为 1
+  uint32_t wnd_size_ { 1 }; // 初始假定窗口大小为 1
   uint64_t next_seqno_ {};  // 待发送的下一个字节序号
   uint64_t acked_seqno_ {}; // 已确认的字节序号
   bool sent_syn_ {};        // syn 是否发出去过
@@ -88,6 +147,84 @@ private:
 
   RetransmissionTimer timer_;
 
-  std::queue<TCPSenderMessage> outstanding_bytes_ {};
+  // 已发出但未被确认的分组
+  struct OutstandingSegment
+  {
+    TCPSenderMessage msg;
+    uint64_t sent_time;    // 最近一次发送的时刻
+    bool retransmitted {}; // 重传过的分组不参与 RTT 采样（Karn 算法）
+    bool sacked {};        // 对方已通过 SACK 确认收到，不再需要重传
+    bool probe {};         // 路径 MTU 探测分组：比 MSS 大，确认了就可以用这个大小
+
+    // 发送时刻的交付状态快照，用于交付速率采样
+    uint64_t delivered {};       // 当时的累计交付字节数
+    uint64_t delivered_time {};  // 当时最近一次交付的时刻
+    uint64_t first_sent_time {}; // 当时所在发送区间的起点
+    bool app_limited {};         // 当时发送方是否受限于应用数据
+  };
+
+  void stamp( OutstandingSegment& segment ); // 发送或重传时记录时间与交付状态快照
+
+  // SACK 记分板：按 SACK 块标记已收到的分组，返回是否有新标记的分组
+  bool update_scoreboard( const std::vector<std::pair<Wrap32, Wrap32>>& blocks );
+  // 快速重传：没有 SACK 信息时重传队首，否则重传记分板上判定丢失的所有缺口
+  void retransmit_lost( const TransmitFunction& transmit );
+  // 把第 index 个未确认分组切成载荷不超过 size 的几片，返回片数
+  size_t split_outstanding( size_t index, uint64_t size );
+
+  // 路径 MTU 探测（RFC 4821）：普通分组用已确认能通过的大小（mss_），另发单独的探测分组试探更大的大小。
+  // 只有探测分组反复丢失、而更小的分组能通过时，才认定那个大小过不去
+  void start_pmtu_search();                    // 从 PMTU_BASE_MSS 开始，向上探测到 max_mss_
+  uint64_t probe_size() const;                 // 此刻该发的探测分组的载荷，0 表示不探测
+  void probe_acked();                          // 探测分组到了：此后都用这个大小
+  void probe_lost( bool smaller_got_through ); // 探测分组丢了：按 MSS 切开重传
+  void fall_back_to_min_mss();                 // 普通分组反复超时：先退到最小 MSS，再探测原来的大小
+  void schedule_probe();                       // 搜索没结束就尽快探测，否则隔 PMTU_REPROBE_MS 再来
+  bool pmtu_search_done() const;               // 没有值得探测的大小了
+  void set_mss( uint64_t mss );                // 改变 MSS，并告诉拥塞控制
+  // Nagle / cork：这么大的载荷是否应该先留在流里，等凑满一个分组
+  bool hold_back( uint64_t payload_size ) const;
+
+  uint64_t current_time_ {}; // 由 tick() 累加的当前时刻
+  std::deque<OutstandingSegment> outstanding_bytes_ {};
   uint64_t num_bytes_in_flight_ {};
+
+  // 交付速率估计的状态
+  uint64_t delivered_ {};         // 累计被确认的数据字节数
+  uint64_t delivered_time_ {};    // 最近一次有数据被确认的时刻
+  uint64_t first_sent_time_ {};   // 当前发送区间的起点
+  uint64_t app_limited_until_ {}; // 非零时，累计交付量越过它之前的采样都是应用受限的
+
+  // 丢包恢复选项
+  bool fast_retransmit_ {};      // 收到三个重复 ACK 时立即重传队首分组
+  bool go_back_n_ {};            // 超时后重传全部未确认分组，而不只是队首
+  uint64_t dup_acks_ {};         // 连续收到的重复 ACK 个数
+  bool need_fast_retransmit_ {}; // 下一次 push() 时先重传队首分组
+  bool peer_sacks_ {};           // 对方发过 SACK 块：按记分板判断丢包
+
+  // 分组大小
+  uint64_t mss_ { TCPConfig::MAX_PAYLOAD_SIZE };     // 每个分组的最大载荷（探测路径 MTU 时为已确认能通过的大小）
+  uint64_t max_mss_ { TCPConfig::MAX_PAYLOAD_SIZE }; // 本端配置与对方通告中较小者
+  uint64_t tso_size_ {}; // 交给设备按 MSS 切分的超大分组的载荷上限，0 表示不用 TSO
+  bool nagle_ {};        // 有未确认数据时不发不满 MSS 的分组
+  bool corked_ {};       // 应用要求只发满 MSS 的分组
+  std::optional<uint64_t> cork_deadline_ {}; // cork 扣住不满 MSS 的数据时，最晚放行的时刻
+
+  // 路径 MTU 探测（RFC 4821）
+  bool pmtu_discovery_ {};
+  uint64_t pmtu_high_ {};           // 还没有被探测否定的最大载荷
+  bool pmtu_bisect_ {};             // pmtu_high_ 是探测失败后得出的：在它与 mss_ 中间探测，否则直接探测它
+  uint64_t pmtu_probe_size_ {};     // 在途探测分组的载荷，0 表示没有
+  uint64_t pmtu_probe_failures_ {}; // 这个大小的探测分组连续丢失（而更小的分组能通过）的次数
+  uint64_t pmtu_next_probe_ {};     // 最早可以发下一个探测分组的时刻
+
+  // 发送限速：令牌桶（字节），由 tick() 按 pacing_rate() 补充
+  static constexpr double SLOW_START_PACING_GAIN = 2.0;           // 与 Linux 的 pacing_ss_ratio 相同
+  static constexpr double CONGESTION_AVOIDANCE_PACING_GAIN = 1.2; // 与 Linux 的 pacing_ca_ratio 相同
+  bool pacing_ {};
+  double pacing_tokens_ {};
+  uint64_t paced_bytes_ {}; // 正在等待令牌的分组大小，为 0 表示没有被限速挡住的分组
+
+  CongestionControl::Algorithm cc_algorithm_ { CongestionControl::Algorithm::None };
+  std::unique_ptr<CongestionControl> cc_ {}; // 为空时不做拥塞控制
 };
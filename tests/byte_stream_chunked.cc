@@ -0,0 +1,133 @@
+#include "byte_stream.hh"
+#include "byte_stream_test_harness.hh"
+#include "test_should_be.hh"
+
+#include <exception>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+static constexpr auto Chunked = ByteStream::Storage::Chunked;
+
+void random_test( const size_t input_len,    // NOLINT(bugprone-easily-swappable-parameters)
+                  const size_t capacity,     // NOLINT(bugprone-easily-swappable-parameters)
+                  const size_t random_seed ) // NOLINT(bugprone-easily-swappable-parameters)
+{
+  default_random_engine rd { random_seed };
+
+  const string data = [&rd, &input_len] {
+    uniform_int_distribution<char> ud;
+    string ret;
+    for ( size_t i = 0; i < input_len; ++i ) {
+      ret += ud( rd );
+    }
+    return ret;
+  }();
+
+  ByteStreamTestHarness bs {
+    "chunked random input=" + to_string( input_len ) + ", capacity=" + to_string( capacity ), capacity, Chunked };
+
+  size_t pushed {};
+  size_t popped {};
+  while ( pushed < data.size() or popped < data.size() ) {
+    uniform_int_distribution<size_t> push_dist { 0, data.size() - pushed };
+    const size_t amount_to_push = push_dist( rd );
+    bs.execute( Push { data.substr( pushed, amount_to_push ) } );
+    pushed += min( amount_to_push, capacity - ( pushed - popped ) );
+    bs.execute( BytesPushed { pushed } );
+
+    if ( pushed == data.size() ) {
+      bs.execute( Close {} );
+    }
+
+    const size_t peek_size = bs.peek_size();
+    if ( ( pushed != popped ) and peek_size == 0 ) {
+      throw runtime_error( "ByteStream::reader().peek() returned empty view" );
+    }
+    bs.execute( PeekOnce { data.substr( popped, peek_size ) } );
+    bs.execute( Peek { data.substr( popped, pushed - popped ) } );
+
+    uniform_int_distribution<size_t> pop_dist { 0, pushed - popped };
+    const size_t amount_to_pop = pop_dist( rd );
+    bs.execute( Pop { amount_to_pop } );
+    popped += amount_to_pop;
+    bs.execute( BytesPopped { popped } );
+    bs.execute( AvailableCapacity { capacity - ( pushed - popped ) } );
+  }
+
+  bs.execute( IsFinished { true } );
+}
+
+int main()
+{
+  try {
+    {
+      ByteStreamTestHarness test { "whole chunk is peekable", 15, Chunked };
+      test.execute( Push { "hello" } );
+      test.execute( Push { "world" } );
+      test.execute( PeekOnce { "hello" } );
+      test.execute( Peek { "helloworld" } );
+      test.execute( Pop { 3 } );
+      test.execute( PeekOnce { "lo" } );
+      test.execute( Pop { 3 } );
+      test.execute( PeekOnce { "orld" } );
+      test.execute( BytesBuffered { 4 } );
+      test.execute( BytesPopped { 6 } );
+      test.execute( AvailableCapacity { 11 } );
+    }
+
+    {
+      ByteStreamTestHarness test { "push is truncated to capacity", 4, Chunked };
+      test.execute( Push { "cat" } );
+      test.execute( Push { "dog" } );
+      test.execute( BytesPushed { 4 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( Peek { "catd" } );
+      test.execute( Pop { 4 } );
+      test.execute( Push { "" } );
+      test.execute( Peek { "" } );
+      test.execute( Close {} );
+      test.execute( IsFinished { true } );
+    }
+
+    {
+      ByteStreamTestHarness test { "pop across chunks", 10, Chunked };
+      test.execute( Push { "ab" } );
+      test.execute( Push { "cd" } );
+      test.execute( Push { "ef" } );
+      test.execute( Pop { 5 } );
+      test.execute( PeekOnce { "f" } );
+      test.execute( Pop { 10 } );
+      test.execute( BytesPopped { 6 } );
+      test.execute( BytesBuffered { 0 } );
+    }
+
+    // A pushed string is kept as-is, spare capacity and all, unless it is mostly spare capacity
+    {
+      ByteStream bs { 100000, Chunked };
+      string segment( 1460, 'x' );
+      segment.reserve( 2 * segment.size() );
+      const char* const segment_data = segment.data();
+      bs.writer().push( move( segment ) );
+      test_should_be( bs.reader().peek().data() == segment_data, true );
+      bs.reader().pop( 1460 );
+
+      string read_buffer( 65536, 'y' );
+      read_buffer.resize( 10 );
+      const char* const read_buffer_data = read_buffer.data();
+      bs.writer().push( move( read_buffer ) );
+      test_should_be( bs.reader().peek() == "yyyyyyyyyy", true );
+      test_should_be( bs.reader().peek().data() != read_buffer_data, true );
+    }
+
+    random_test( 19, 3, 10110 );
+    random_test( 1111, 17, 98765 );
+    random_test( 4097, 4096, 11101 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include "checksum.hh"
+#include "test_should_be.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// One byte at a time, as the checksum used to be computed
+uint16_t reference_checksum( string_view data, uint64_t sum = 0 )
+{
+  for ( size_t i = 0; i < data.size(); i++ ) {
+    const uint8_t byte = data[i];
+    sum += i % 2 ? byte : byte << 8;
+  }
+  while ( sum > 0xffff ) {
+    sum = ( sum >> 16 ) + static_cast<uint16_t>( sum );
+  }
+  return ~sum;
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    // the example from RFC 1071, section 3
+    {
+      InternetChecksum check;
+      check.add( string { 0x00, 0x01, static_cast<char>( 0xf2 ), 0x03 } );
+      check.add( string { static_cast<char>( 0xf4 ), static_cast<char>( 0xf5 ) } );
+      check.add( string { static_cast<char>( 0xf6 ), static_cast<char>( 0xf7 ) } );
+      test_should_be( check.value(), uint16_t { static_cast<uint16_t>( ~0xddf2 ) } );
+    }
+
+    // Any length, starting anywhere (so misaligned for the vector loads), in pieces of any length (so odd
+    // pieces leave a word halfway for the next), gives the same checksum as summing a byte at a time
+    default_random_engine rd { 1071 };
+    string data( 70000, 0 );
+    for ( auto& c : data ) {
+      c = static_cast<char>( uniform_int_distribution<int> { 0, 255 }( rd ) );
+    }
+    const vector<size_t> lengths { 0, 1, 2, 3, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1499, 1500, 65535 };
+    for ( const size_t length : lengths ) {
+      for ( size_t offset = 0; offset < 40; offset++ ) {
+        const string_view piece = string_view { data }.substr( offset, length );
+        const uint32_t pseudo = offset * 7919;
+
+        InternetChecksum whole { pseudo };
+        whole.add( piece );
+        test_should_be( whole.value(), reference_checksum( piece, pseudo ) );
+
+        vector<string_view> fragments;
+        for ( size_t i = 0; i < piece.size(); ) {
+          const size_t n = uniform_int_distribution<size_t> { 0, 100 }( rd );
+          fragments.push_back( piece.substr( i, n ) );
+          i += n;
+        }
+        InternetChecksum pieces { pseudo };
+        pieces.add( fragments );
+        test_should_be( pieces.value(), reference_checksum( piece, pseudo ) );
+      }
+    }
+
+    // long enough that the vector lanes fill up and are flushed along the way, all with the largest words
+    {
+      const string ones( size_t { 3 } << 20, static_cast<char>( 0xff ) );
+      InternetChecksum check;
+      check.add( ones );
+      test_should_be( check.value(), reference_checksum( ones ) );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return EXIT_SUCCESS;
+}
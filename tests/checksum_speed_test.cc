@@ -0,0 +1,110 @@
+#include "checksum.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// One byte at a time, as the checksum used to be computed
+uint16_t reference_checksum( string_view data )
+{
+  uint64_t sum = 0;
+  for ( size_t i = 0; i < data.size(); i++ ) {
+    const uint8_t byte = data[i];
+    sum += i % 2 ? byte : byte << 8;
+  }
+  while ( sum > 0xffff ) {
+    sum = ( sum >> 16 ) + static_cast<uint16_t>( sum );
+  }
+  return ~sum;
+}
+
+void speed_test( const size_t input_len,    // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t segment_size, // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t random_seed,  // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t repetitions ) // NOLINT(bugprone-easily-swappable-parameters)
+{
+  // Generate the data, and split it into segments that start at every alignment
+  const string data = [&random_seed, &input_len] {
+    default_random_engine rd { random_seed };
+    uniform_int_distribution<char> ud;
+    string ret;
+    for ( size_t i = 0; i < input_len; ++i ) {
+      ret += ud( rd );
+    }
+    return ret;
+  }();
+
+  vector<string_view> segments;
+  for ( size_t i = 0; i + segment_size <= data.size(); i += segment_size + 1 ) {
+    segments.push_back( string_view { data }.substr( i, segment_size ) );
+  }
+
+  size_t bytes = 0;
+  uint16_t total = 0;
+  const auto start_time = steady_clock::now();
+  for ( size_t rep = 0; rep < repetitions; rep++ ) {
+    for ( const auto segment : segments ) {
+      InternetChecksum check;
+      check.add( segment );
+      total += check.value();
+      bytes += segment.size();
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  uint16_t expected = 0;
+  for ( const auto segment : segments ) {
+    expected += reference_checksum( segment );
+  }
+  if ( static_cast<uint16_t>( expected * repetitions ) != total ) {
+    throw runtime_error( "Mismatch between InternetChecksum and a byte-at-a-time checksum" );
+  }
+
+  auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  auto bytes_per_second = static_cast<double>( bytes ) / test_duration.count();
+  auto bits_per_second = 8 * bytes_per_second;
+  auto gigabits_per_second = bits_per_second / 1e9;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "InternetChecksum (" << InternetChecksum::implementation() << ") with segment_size=" << segment_size
+       << " reached " << fixed << setprecision( 2 ) << gigabits_per_second << " Gbit/s.\n";
+
+  debug_output << "       InternetChecksum throughput: " << fixed << setprecision( 2 ) << gigabits_per_second
+               << " Gbit/s\n";
+
+  if ( gigabits_per_second < 1 ) {
+    throw runtime_error( "InternetChecksum did not meet minimum speed of 1 Gbit/s." );
+  }
+}
+
+void program_body()
+{
+  speed_test( 1e7, 20, 1071, 10 );    // headers
+  speed_test( 1e7, 1460, 1071, 50 );  // full segments
+  speed_test( 1e7, 65515, 1071, 50 ); // TSO segments
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,252 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "socket.hh"
+#include "test_should_be.hh"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+pair<LocalStreamSocket, LocalStreamSocket> make_pair_of_sockets()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM, 0, fds.data() ) );
+  return { LocalStreamSocket { FileDescriptor { fds[0] } }, LocalStreamSocket { FileDescriptor { fds[1] } } };
+}
+
+// Many idle fds and a few busy ones: every backend delivers the same bytes and honors interest()
+void many_rules( EventLoop::Backend backend )
+{
+  constexpr size_t N_PAIRS = 500;
+  EventLoop loop { backend };
+  vector<pair<LocalStreamSocket, LocalStreamSocket>> pairs;
+  vector<string> received( N_PAIRS );
+  bool paused = false;
+
+  const size_t category = loop.add_category( "read" );
+  pairs.reserve( N_PAIRS );
+  for ( size_t i = 0; i < N_PAIRS; i++ ) {
+    pairs.push_back( make_pair_of_sockets() );
+    auto& reader = pairs.back().second;
+    loop.add_rule(
+      category,
+      reader,
+      Direction::In,
+      [&, i] {
+        string buf;
+        pairs.at( i ).second.read( buf );
+        received.at( i ) += buf;
+      },
+      [&, i] { return not( paused and i == 7 ); } );
+  }
+
+  pairs.at( 7 ).first.write( "hello" );
+  pairs.at( 300 ).first.write( "world" );
+  for ( int i = 0; i < 4; i++ ) {
+    loop.wait_next_event( 0 );
+  }
+  test_should_be( received.at( 7 ) == "hello", true );
+  test_should_be( received.at( 300 ) == "world", true );
+
+  // an uninterested rule isn't served, and is again once interest returns
+  paused = true;
+  pairs.at( 7 ).first.write( "again" );
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+  test_should_be( received.at( 7 ) == "hello", true );
+  paused = false;
+  loop.wait_next_event( 0 );
+  test_should_be( received.at( 7 ) == "helloagain", true );
+
+  // once every reader has reached EOF, nothing is left to wait for
+  for ( auto& p : pairs ) {
+    p.first.shutdown( SHUT_WR );
+  }
+  EventLoop::Result result = EventLoop::Result::Success;
+  for ( size_t i = 0; i < 4 * N_PAIRS and result != EventLoop::Result::Exit; i++ ) {
+    result = loop.wait_next_event( 0 );
+  }
+  test_should_be( result == EventLoop::Result::Exit, true );
+}
+
+// The epoll backend serves an fd's In and Out rules together, and an edge-triggered rule only on new data
+void epoll_only()
+{
+  EventLoop loop { EventLoop::Backend::Epoll };
+  auto [a, b] = make_pair_of_sockets();
+  b.set_blocking( false );
+  unsigned reads = 0;
+  unsigned writes = 0;
+  bool want_write = true;
+
+  loop.add_rule(
+    "edge read",
+    b,
+    Direction::In,
+    EventLoop::Trigger::Edge,
+    [&] {
+      string buf;
+      b.read( buf );
+      reads++;
+    } );
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+
+  bool threw = false;
+  try {
+    loop.add_rule( "level write", b, Direction::Out, [&] {
+      b.write( "x" );
+      writes++;
+    } );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  test_should_be( threw, true ); // rules sharing an fd must agree on the trigger mode
+
+  loop.add_rule(
+    "edge write",
+    b,
+    Direction::Out,
+    EventLoop::Trigger::Edge,
+    [&] {
+      b.write( "x" );
+      writes++;
+      want_write = false;
+    },
+    [&] { return want_write; } );
+
+  a.write( "ping" );
+  loop.wait_next_event( 0 );
+  test_should_be( reads, 1U );
+  test_should_be( writes, 1U );
+
+  // nothing new arrived, so the edge-triggered reader isn't called again
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+  test_should_be( reads, 1U );
+
+  a.write( "pong" );
+  loop.wait_next_event( 0 );
+  test_should_be( reads, 2U );
+  test_should_be( writes, 1U );
+}
+
+// With on-demand interest updates, a wait asks only the rules that might have changed: not the idle ones
+void on_demand_interest()
+{
+  constexpr size_t N_PAIRS = 400;
+  EventLoop loop { EventLoop::Backend::Epoll, EventLoop::InterestUpdates::OnDemand };
+  vector<pair<LocalStreamSocket, LocalStreamSocket>> pairs;
+  vector<EventLoop::RuleHandle> handles;
+  vector<string> received( N_PAIRS );
+  size_t asked = 0;
+  bool paused = false;
+
+  const size_t category = loop.add_category( "read" );
+  pairs.reserve( N_PAIRS );
+  for ( size_t i = 0; i < N_PAIRS; i++ ) {
+    pairs.push_back( make_pair_of_sockets() );
+    handles.push_back( loop.add_rule(
+      category,
+      pairs.back().second,
+      Direction::In,
+      [&, i] {
+        string buf;
+        pairs.at( i ).second.read( buf );
+        received.at( i ) += buf;
+      },
+      [&, i] {
+        asked++;
+        return not( paused and i == 7 );
+      } ) );
+  }
+
+  // every new rule is asked once, and then only the one whose fd was ready
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+  test_should_be( asked, N_PAIRS );
+  asked = 0;
+  pairs.at( 7 ).first.write( "hello" );
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Success, true );
+  test_should_be( received.at( 7 ) == "hello", true );
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+  test_should_be( asked <= 3, true ); // when dispatched, after the callback, and before the next wait
+
+  // a change made elsewhere takes effect once the owner says so
+  paused = true;
+  handles.at( 7 ).update_interest();
+  pairs.at( 7 ).first.write( "again" );
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+  paused = false;
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+  test_should_be( received.at( 7 ) == "hello", true );
+  handles.at( 7 ).update_interest();
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Success, true );
+  test_should_be( received.at( 7 ) == "helloagain", true );
+
+  // a cancelled rule is dropped without being asked
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+  asked = 0;
+  handles.at( 300 ).cancel();
+  pairs.at( 300 ).first.write( "world" );
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, true );
+  test_should_be( received.at( 300 ).empty(), true );
+  test_should_be( asked, 0UL );
+
+  // rules that reach EOF are dropped too, until nothing is left to wait for
+  for ( auto& p : pairs ) {
+    p.first.shutdown( SHUT_WR );
+  }
+  EventLoop::Result result = EventLoop::Result::Success;
+  for ( size_t i = 0; i < 4 * N_PAIRS and result != EventLoop::Result::Exit; i++ ) {
+    result = loop.wait_next_event( 0 );
+  }
+  test_should_be( result == EventLoop::Result::Exit, true );
+}
+
+// A rule added on an fd number that was closed (and reused) before the loop ran again watches the new fd
+void reused_fd_number()
+{
+  EventLoop loop { EventLoop::Backend::Epoll };
+  auto [a, b] = make_pair_of_sockets();
+  string received;
+  loop.add_rule( "old", b, Direction::In, [&] { b.read( received ); } );
+  const int old_fd_num = b.fd_num();
+  b.close();
+
+  auto [c, d] = make_pair_of_sockets();
+  auto& reader = c.fd_num() == old_fd_num ? c : d;
+  auto& writer = c.fd_num() == old_fd_num ? d : c;
+  test_should_be( reader.fd_num(), old_fd_num );
+  loop.add_rule( "new", reader, Direction::In, [&] { reader.read( received ); } );
+
+  writer.write( "hello" );
+  test_should_be( loop.wait_next_event( 0 ) == EventLoop::Result::Success, true );
+  test_should_be( received == "hello", true );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    many_rules( EventLoop::Backend::Poll );
+    many_rules( EventLoop::Backend::Epoll );
+    epoll_only();
+    on_demand_interest();
+    reused_fd_number();
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return EXIT_SUCCESS;
+}
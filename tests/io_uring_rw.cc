@@ -0,0 +1,127 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "io_uring.hh"
+#include "socket.hh"
+#include "test_should_be.hh"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+using namespace std;
+
+int main()
+{
+  try {
+    optional<IoUring> maybe_ring;
+    try {
+      maybe_ring.emplace( 8 );
+    } catch ( const unix_error& e ) {
+      cerr << "io_uring unavailable, skipping: " << e.what() << "\n";
+      return EXIT_SUCCESS;
+    }
+    IoUring& ring = maybe_ring.value();
+
+    array<int, 2> fds {};
+    CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_SEQPACKET, 0, fds.data() ) );
+    FileDescriptor a { fds[0] };
+    FileDescriptor b { fds[1] };
+
+    // Queued requests don't reach the kernel until submitted, and then complete with their callbacks
+    {
+      vector<int32_t> results;
+      ring.write( a, "hello", [&]( int32_t r ) { results.push_back( r ); } );
+      ring.write( a, "world!", [&]( int32_t r ) { results.push_back( r ); } );
+      test_should_be( ring.queued(), size_t { 2 } );
+      test_should_be( ring.reap(), size_t { 0 } );
+      test_should_be( ring.submit(), size_t { 2 } );
+      while ( results.size() < 2 ) {
+        ring.wait();
+      }
+      test_should_be( results.at( 0 ), int32_t { 5 } );
+      test_should_be( results.at( 1 ), int32_t { 6 } );
+      test_should_be( ring.in_flight(), size_t { 0 } );
+    }
+
+    // Reads into a registered buffer, one datagram at a time
+    {
+      vector<char> arena( 64 );
+      ring.register_buffers( { span { arena } } );
+      string got;
+      const auto on_read = [&]( int32_t r ) { got.append( arena.data(), r ); };
+      ring.read( b, span { arena }, on_read, 0 );
+      ring.submit();
+      while ( got.empty() ) {
+        ring.wait();
+      }
+      test_should_be( got == "hello", true );
+      ring.read( b, span { arena }, on_read, 0 );
+      ring.wait();
+      test_should_be( got == "helloworld!", true );
+    }
+
+    // A callback that throws doesn't keep the others in the same batch from running; the exception comes out
+    // of reap() afterwards
+    {
+      unsigned ran = 0;
+      ring.write( a, "one", [&]( int32_t ) {
+        ran++;
+        throw runtime_error( "callback failed" );
+      } );
+      ring.write( a, "two", [&]( int32_t ) { ran++; } );
+      ring.submit();
+      bool threw = false;
+      while ( ring.in_flight() > 0 ) {
+        try {
+          ring.wait();
+        } catch ( const runtime_error& ) {
+          threw = true;
+        }
+      }
+      test_should_be( threw, true );
+      test_should_be( ran, 2U );
+
+      string datagram;
+      b.read( datagram );
+      b.read( datagram );
+      test_should_be( datagram == "two", true );
+    }
+
+    // In an EventLoop, requests queued by a callback are submitted before the next wait, and their
+    // completions run from the loop
+    {
+      EventLoop loop { EventLoop::Backend::Epoll };
+      vector<char> buf( 64 );
+      string echoed;
+      bool sent = false;
+      loop.add_rule( "io_uring", ring, [&] { return echoed.empty(); } );
+      loop.add_rule(
+        "start",
+        [&] {
+          sent = true;
+          ring.read( b, span { buf }, [&]( int32_t r ) { echoed.assign( buf.data(), r ); } );
+          ring.write( a, "ping", {} );
+        },
+        [&] { return not sent; } );
+
+      for ( int i = 0; i < 10 and echoed.empty(); i++ ) {
+        loop.wait_next_event( 1000 );
+      }
+      test_should_be( echoed == "ping", true );
+      test_should_be( ring.queued(), size_t { 0 } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return EXIT_SUCCESS;
+}
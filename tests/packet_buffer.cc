@@ -0,0 +1,226 @@
+#include "address.hh"
+#include "ethernet_frame.hh"
+#include "ethernet_header.hh"
+#include "packet_buffer.hh"
+#include "parser.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_segment.hh"
+#include "test_should_be.hh"
+#include "wrapping_integers.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+namespace {
+size_t heap_allocations = 0; // calls to the global operator new
+} // namespace
+
+// A Parser reads strings where they lie, so it can't be made from a temporary vector of them; a PacketBuffer
+// shares its block with the Parser, so a temporary one is fine
+static_assert( not is_constructible_v<Parser, vector<string>&&> );
+static_assert( is_constructible_v<Parser, PacketBuffer&&> );
+
+void* operator new( size_t size )
+{
+  heap_allocations++;
+  if ( void* p = malloc( size ) ) { // NOLINT(*-no-malloc, *-owning-memory)
+    return p;
+  }
+  throw bad_alloc {};
+}
+
+void operator delete( void* p ) noexcept
+{
+  free( p ); // NOLINT(*-no-malloc, *-owning-memory)
+}
+
+void operator delete( void* p, size_t /* size */ ) noexcept
+{
+  free( p ); // NOLINT(*-no-malloc, *-owning-memory)
+}
+
+namespace {
+
+string concat( const vector<string>& pieces )
+{
+  string ret;
+  for ( const auto& x : pieces ) {
+    ret += x;
+  }
+  return ret;
+}
+
+// Two ends of a connection, each with the other as its peer
+void connect( TCPOverIPv4Adapter& a, TCPOverIPv4Adapter& b )
+{
+  a.config_mut().source = b.config_mut().destination = Address { "10.0.0.1", 1000 };
+  a.config_mut().destination = b.config_mut().source = Address { "10.0.0.2", 2000 };
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    // Copies and slices share a block; growing a shared block leaves the other views alone
+    {
+      PacketBuffer buf;
+      buf.append( "payload" );
+      test_should_be( buf.headroom(), PacketBuffer::HEADROOM );
+
+      PacketBuffer tail = buf.slice( 3 );
+      test_should_be( tail.view() == "load", true );
+      test_should_be( tail.view().data() == buf.view().data() + 3, true );
+
+      tail.prepend( 1 )[0] = '-';
+      test_should_be( tail.view() == "-load", true );
+      test_should_be( buf.view() == "payload", true );
+      test_should_be( buf.slice( 1, 2 ).view() == "ay", true );
+    }
+
+    // A small packet takes a small block, and moves to a large one only if it outgrows it
+    {
+      PacketBuffer buf;
+      buf.append( string( 40, 'a' ) );
+      test_should_be( buf.tailroom(), PacketBuffer::SMALL_CAPACITY - PacketBuffer::HEADROOM - 40 );
+      buf.append( string( 4000, 'b' ) );
+      test_should_be( buf.tailroom(), PacketBuffer::CAPACITY - PacketBuffer::HEADROOM - 4040 );
+      test_should_be( buf.view() == string( 40, 'a' ) + string( 4000, 'b' ), true );
+      test_should_be( buf.headroom(), PacketBuffer::HEADROOM );
+    }
+
+    // Blocks go back to the pool of the thread that took them, even when another thread lets go of them, so a
+    // thread that sends packets for another to release stops allocating too
+    {
+      constexpr size_t batch = 32;
+      const auto send_batch = [] {
+        vector<PacketBuffer> packets( batch );
+        for ( auto& packet : packets ) {
+          packet.append( "ACK" );
+        }
+        thread { [released = std::move( packets )]() mutable { released.clear(); } }.join();
+      };
+      for ( int i = 0; i < 2; i++ ) {
+        send_batch();
+      }
+      const size_t before = PacketBuffer::heap_allocations();
+      for ( int i = 0; i < 100; i++ ) {
+        send_batch();
+      }
+      test_should_be( PacketBuffer::heap_allocations(), before );
+    }
+
+    // A block can outlive the thread that took it
+    {
+      PacketBuffer orphan;
+      thread { [&] { orphan.append( "from a thread that has exited" ); } }.join();
+      test_should_be( orphan.view() == "from a thread that has exited", true );
+    }
+
+    // Integers and headers decode the same whether or not they straddle two buffers
+    {
+      const vector<string> split { "\x01\x02\x03", "\x04\x05\x06\x07\x08\x09" };
+      const vector<string> whole { concat( split ) };
+      for ( const auto& input : { split, whole } ) {
+        Parser parser { input };
+        uint16_t first {};
+        uint32_t second {};
+        parser.integer( first );
+        parser.integer( second );
+        test_should_be( first, uint16_t { 0x0102 } );
+        test_should_be( second, uint32_t { 0x03040506 } );
+        const auto rest = parser.header<3>();
+        test_should_be( string( rest.begin(), rest.end() ) == "\x07\x08\x09", true );
+        test_should_be( parser.has_error(), false );
+      }
+
+      Parser parser { whole };
+      test_should_be( read_big_endian<uint64_t>( parser.header<8>() ), uint64_t { 0x0102030405060708 } );
+      parser.header<2>(); // only one byte left
+      test_should_be( parser.has_error(), true );
+    }
+
+    TCPOverIPv4Adapter a;
+    TCPOverIPv4Adapter b;
+    connect( a, b );
+
+    TCPMessage syn;
+    syn.sender.seqno = Wrap32 { 12345 };
+    syn.sender.SYN = true;
+    syn.sender.mss = 1400;
+    syn.sender.window_scale = 7;
+    syn.sender.payload = "hello, world";
+    syn.receiver.ackno = Wrap32 { 999 };
+    syn.receiver.window_size = 5000;
+
+    // Headers prepended in place down to Ethernet give the same bytes as serializing each layer in turn
+    const EthernetHeader ethernet {
+      .dst = { 1, 2, 3, 4, 5, 6 }, .src = { 7, 8, 9, 10, 11, 12 }, .type = EthernetHeader::TYPE_IPv4 };
+    PacketBuffer frame;
+    a.wrap_tcp_in_ip( syn, frame );
+    serialize_in_front( ethernet, frame );
+    const EthernetFrame expected { .header = ethernet, .payload = serialize( a.wrap_tcp_in_ip( syn ) ) };
+    test_should_be( frame.view() == concat( serialize( expected ) ), true );
+
+    // On the way up, each layer's payload is a slice of the frame
+    {
+      Parser parser { frame };
+      EthernetHeader header {};
+      header.parse( parser );
+      PacketBuffer datagram;
+      parser.all_remaining( datagram );
+      test_should_be( parser.has_error(), false );
+      test_should_be( datagram.view().data() == frame.view().data() + EthernetHeader::LENGTH, true );
+
+      const auto got = b.unwrap_tcp_in_ip( datagram );
+      test_should_be( got.has_value(), true );
+      test_should_be( got->sender.payload == "hello, world", true );
+      test_should_be( got->sender.seqno, Wrap32 { 12345 } );
+      test_should_be( got->sender.mss.value_or( 0 ), uint16_t { 1400 } );
+
+      // and the checksum is still checked
+      PacketBuffer corrupt;
+      corrupt.append( datagram.view().substr( 0, datagram.size() - 1 ) );
+      corrupt.append( "?" );
+      test_should_be( b.unwrap_tcp_in_ip( corrupt ).has_value(), false );
+    }
+
+    // Once the pool is warm, serializing a full-sized segment takes nothing from the heap, and parsing it takes
+    // just the std::string the receiver is handed its payload in
+    TCPMessage data;
+    data.sender.seqno = Wrap32 { 12346 };
+    data.sender.payload = string( 1460, 'x' );
+    data.receiver.ackno = Wrap32 { 1000 };
+    data.receiver.window_size = 5000;
+
+    const auto round_trip = [&] {
+      PacketBuffer datagram;
+      a.wrap_tcp_in_ip( data, datagram );
+      if ( not b.unwrap_tcp_in_ip( datagram ).has_value() ) {
+        throw runtime_error( "round trip failed" );
+      }
+    };
+    round_trip();
+    const size_t before = heap_allocations;
+    constexpr size_t round_trips = 1000;
+    for ( size_t i = 0; i < round_trips; i++ ) {
+      round_trip();
+    }
+    test_should_be( heap_allocations - before, round_trips );
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+#include "peer_test_harness.hh"
+#include "random.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+
+using namespace std;
+
+static constexpr uint64_t MSS = TCPConfig::MAX_PAYLOAD_SIZE;
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    // the remote side's ISN, and a handshake that leaves us acknowledging isn + 1
+    const Wrap32 isn( rd() );
+    TCPConfig cfg;
+    cfg.isn = Wrap32 { 1000 };
+    cfg.ack_delay = 100;
+    auto handshake = [&]( TCPPeerTestHarness& test ) {
+      test.execute( SegmentReceived { isn, Wrap32 { 0 } }.with_syn().without_ackno() );
+      test.execute( ExpectOutput {}.with_syn( true ).with_ackno( isn + 1 ) );
+      test.execute( SegmentReceived { isn + 1, Wrap32 { 1001 } } );
+      test.execute( ExpectNoOutput {} );
+      test.execute( ExpectNextDeadline { nullopt } );
+    };
+
+    {
+      TCPPeerTestHarness test { "Every second full segment is acknowledged at once", cfg };
+      handshake( test );
+      test.execute( SegmentReceived { isn + 1, Wrap32 { 1001 } }.with_data( string( MSS, 'a' ) ) );
+      test.execute( ExpectNoOutput {} );
+      test.execute( SegmentReceived { isn + 1 + MSS, Wrap32 { 1001 } }.with_data( string( MSS, 'b' ) ) );
+      test.execute( ExpectOutput {}.with_ackno( isn + 1 + 2 * MSS ) );
+      test.execute( ExpectNoOutput {} );
+      test.execute( PeerTick { 1000 } );
+      test.execute( ExpectNoOutput {} );
+    }
+
+    {
+      TCPPeerTestHarness test { "A full-sized segment is the MSS negotiated in the SYNs", cfg };
+      constexpr uint16_t peer_mss = 536;
+      test.execute( SegmentReceived { isn, Wrap32 { 0 } }.with_syn().with_mss( peer_mss ).without_ackno() );
+      test.execute( ExpectOutput {}.with_syn( true ).with_ackno( isn + 1 ) );
+      test.execute( SegmentReceived { isn + 1, Wrap32 { 1001 } } );
+      test.execute( SegmentReceived { isn + 1, Wrap32 { 1001 } }.with_data( string( peer_mss, 'a' ) ) );
+      test.execute( ExpectNoOutput {} );
+      test.execute( SegmentReceived { isn + 1 + peer_mss, Wrap32 { 1001 } }.with_data( string( peer_mss, 'b' ) ) );
+      test.execute( ExpectOutput {}.with_ackno( isn + 1 + 2 * peer_mss ) );
+    }
+
+    {
+      TCPPeerTestHarness test { "A lone segment is acknowledged when the timer fires", cfg };
+      handshake( test );
+      test.execute( SegmentReceived { isn + 1, Wrap32 { 1001 } }.with_data( "hello" ) );
+      test.execute( ExpectNextDeadline { 100 } );
+      test.execute( PeerTick { 99 } );
+      test.execute( ExpectNoOutput {} );
+      test.execute( SegmentReceived { isn + 6, Wrap32 { 1001 } }.with_data( "world" ) );
+      test.execute( ExpectNextDeadline { 1 } ); // the timer started with the first unacknowledged segment
+      test.execute( PeerTick { 1 } );
+      test.execute( ExpectOutput {}.with_ackno( isn + 11 ) );
+      test.execute( ExpectNoOutput {} );
+      test.execute( ExpectNextDeadline { nullopt } );
+    }
+
+    {
+      TCPPeerTestHarness test { "Out-of-order and gap-filling segments are acknowledged at once", cfg };
+      handshake( test );
+      test.execute( SegmentReceived { isn + 4, Wrap32 { 1001 } }.with_data( "def" ) );
+      test.execute( ExpectOutput {}.with_ackno( isn + 1 ) );
+      test.execute( SegmentReceived { isn + 1, Wrap32 { 1001 } }.with_data( "abc" ) );
+      test.execute( ExpectOutput {}.with_ackno( isn + 7 ) );
+      test.execute( SegmentReceived { isn + 7, Wrap32 { 1001 } }.with_data( "g" ).with_fin() );
+      test.execute( ExpectOutput {}.with_ackno( isn + 9 ) );
+    }
+
+    {
+      TCPPeerTestHarness test { "Outgoing data carries the delayed ACK", cfg };
+      handshake( test );
+      test.execute( SegmentReceived { isn + 1, Wrap32 { 1001 } }.with_data( "request" ) );
+      test.execute( ExpectNoOutput {} );
+      test.execute( PeerWrite { "response" } );
+      test.execute( ExpectOutput {}.with_data( "response" ).with_ackno( isn + 8 ) );
+      test.execute( PeerTick { 100 } );
+      test.execute( ExpectNoOutput {} );
+    }
+
+    {
+      TCPConfig immediate = cfg;
+      immediate.ack_delay = 0;
+      TCPPeerTestHarness test { "Without a delay every segment is acknowledged", immediate };
+      handshake( test );
+      test.execute( SegmentReceived { isn + 1, Wrap32 { 1001 } }.with_data( "x" ) );
+      test.execute( ExpectOutput {}.with_ackno( isn + 2 ) );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
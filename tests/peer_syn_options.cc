@@ -0,0 +1,60 @@
+#include "peer_test_harness.hh"
+#include "random.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+
+using namespace std;
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    TCPConfig cfg;
+    cfg.isn = Wrap32 { 1000 };
+    cfg.window_scaling = true;
+    cfg.sack = true;
+
+    {
+      TCPPeerTestHarness test { "A SYN-ACK doesn't offer options the peer's SYN didn't", cfg };
+      const Wrap32 isn( rd() );
+      test.execute( SegmentReceived { isn, Wrap32 { 0 } }.with_syn().without_ackno() );
+      test.execute( ExpectOutput {}
+                      .with_syn( true )
+                      .with_ackno( isn + 1 )
+                      .with_window_scale( nullopt )
+                      .with_sack_permitted( false ) );
+    }
+
+    {
+      TCPPeerTestHarness test { "A SYN-ACK offers the options the peer's SYN offered", cfg };
+      const Wrap32 isn( rd() );
+      test.execute( SegmentReceived { isn, Wrap32 { 0 } }
+                      .with_syn()
+                      .with_window_scale( 7 )
+                      .with_sack_permitted()
+                      .without_ackno() );
+      test.execute( ExpectOutput {}
+                      .with_syn( true )
+                      .with_ackno( isn + 1 )
+                      .with_window_scale( cfg.window_shift() )
+                      .with_sack_permitted( true ) );
+    }
+
+    {
+      TCPPeerTestHarness test { "An active open offers every option it is configured for", cfg };
+      test.execute( PeerWrite { "" } );
+      test.execute(
+        ExpectOutput {}.with_syn( true ).with_window_scale( cfg.window_shift() ).with_sack_permitted( true ) );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
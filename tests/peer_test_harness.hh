@@ -0,0 +1,234 @@
+#pragma once
+
+#include "common.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+#include "tcp_segment.hh"
+#include "wrapping_integers.hh"
+
+#include <optional>
+#include <queue>
+#include <sstream>
+#include <utility>
+
+struct PeerAndOutput
+{
+  TCPPeer peer;
+  std::queue<TCPMessage> output {};
+
+  auto make_transmit()
+  {
+    return [&]( const TCPMessage& x ) { output.push( x ); };
+  }
+};
+
+inline std::string to_string( const TCPMessage& msg )
+{
+  std::ostringstream o;
+  o << "(seqno=" << msg.sender.seqno;
+  if ( msg.sender.SYN ) {
+    o << " +SYN";
+  }
+  if ( not msg.sender.payload.empty() ) {
+    o << " payload=\"" << Printer::prettify( msg.sender.payload ) << "\"";
+  }
+  if ( msg.sender.FIN ) {
+    o << " +FIN";
+  }
+  if ( msg.receiver.ackno.has_value() ) {
+    o << " ackno=" << msg.receiver.ackno.value();
+  }
+  o << ")";
+  return o.str();
+}
+
+struct SegmentReceived : public Action<PeerAndOutput>
+{
+  TCPMessage msg_ {};
+
+  SegmentReceived( Wrap32 seqno, Wrap32 ackno )
+  {
+    msg_.sender.seqno = seqno;
+    msg_.receiver.ackno = ackno;
+    msg_.receiver.window_size = UINT16_MAX;
+  }
+
+  SegmentReceived& with_syn()
+  {
+    msg_.sender.SYN = true;
+    return *this;
+  }
+
+  SegmentReceived& with_mss( uint16_t mss )
+  {
+    msg_.sender.mss = mss;
+    return *this;
+  }
+
+  SegmentReceived& with_window_scale( uint8_t shift )
+  {
+    msg_.sender.window_scale = shift;
+    return *this;
+  }
+
+  SegmentReceived& with_sack_permitted()
+  {
+    msg_.sender.sack_permitted = true;
+    return *this;
+  }
+
+  SegmentReceived& without_ackno()
+  {
+    msg_.receiver.ackno.reset();
+    return *this;
+  }
+
+  SegmentReceived& with_data( std::string data )
+  {
+    msg_.sender.payload = std::move( data );
+    return *this;
+  }
+
+  SegmentReceived& with_fin()
+  {
+    msg_.sender.FIN = true;
+    return *this;
+  }
+
+  std::string description() const override { return "receive segment " + to_string( msg_ ); }
+  void execute( PeerAndOutput& po ) const override { po.peer.receive( msg_, po.make_transmit() ); }
+};
+
+struct PeerTick : public Action<PeerAndOutput>
+{
+  uint64_t ms_;
+  explicit PeerTick( uint64_t ms ) : ms_( ms ) {}
+  std::string description() const override { return std::to_string( ms_ ) + " ms pass"; }
+  void execute( PeerAndOutput& po ) const override { po.peer.tick( ms_, po.make_transmit() ); }
+};
+
+struct PeerWrite : public Action<PeerAndOutput>
+{
+  std::string data_;
+  explicit PeerWrite( std::string data ) : data_( std::move( data ) ) {}
+  std::string description() const override { return "write \"" + Printer::prettify( data_ ) + "\" and push"; }
+  void execute( PeerAndOutput& po ) const override
+  {
+    po.peer.outbound_writer().push( data_ );
+    po.peer.push( po.make_transmit() );
+  }
+};
+
+struct ExpectNextDeadline : public ExpectNumber<PeerAndOutput, std::optional<uint64_t>>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "next_deadline_ms"; }
+  std::optional<uint64_t> value( PeerAndOutput& po ) const override { return po.peer.next_deadline_ms(); }
+};
+
+struct ExpectNoOutput : public Expectation<PeerAndOutput>
+{
+  std::string description() const override { return "nothing sent"; }
+  void execute( PeerAndOutput& po ) const override
+  {
+    if ( not po.output.empty() ) {
+      throw ExpectationViolation { "TCPPeer sent an unexpected segment: " + to_string( po.output.front() ) };
+    }
+  }
+};
+
+struct ExpectOutput : public Expectation<PeerAndOutput>
+{
+  std::optional<Wrap32> ackno {};
+  std::optional<bool> syn {};
+  std::optional<std::string> data {};
+  std::optional<std::optional<uint8_t>> window_scale {};
+  std::optional<bool> sack_permitted {};
+
+  ExpectOutput& with_ackno( Wrap32 ackno_ )
+  {
+    ackno = ackno_;
+    return *this;
+  }
+
+  ExpectOutput& with_syn( bool syn_ )
+  {
+    syn = syn_;
+    return *this;
+  }
+
+  ExpectOutput& with_data( std::string data_ )
+  {
+    data = std::move( data_ );
+    return *this;
+  }
+
+  ExpectOutput& with_window_scale( std::optional<uint8_t> window_scale_ )
+  {
+    window_scale = window_scale_;
+    return *this;
+  }
+
+  ExpectOutput& with_sack_permitted( bool sack_permitted_ )
+  {
+    sack_permitted = sack_permitted_;
+    return *this;
+  }
+
+  std::string description() const override
+  {
+    std::ostringstream o;
+    o << "segment sent with";
+    if ( ackno.has_value() ) {
+      o << " ackno=" << ackno.value();
+    }
+    if ( syn.has_value() ) {
+      o << ( syn.value() ? " +SYN" : " (no SYN)" );
+    }
+    if ( data.has_value() ) {
+      o << " payload=\"" << Printer::prettify( data.value() ) << "\"";
+    }
+    if ( window_scale.has_value() ) {
+      o << ( window_scale->has_value() ? " wscale=" + std::to_string( window_scale->value() ) : " (no wscale)" );
+    }
+    if ( sack_permitted.has_value() ) {
+      o << ( sack_permitted.value() ? " +SACK-permitted" : " (no SACK-permitted)" );
+    }
+    return o.str();
+  }
+
+  void execute( PeerAndOutput& po ) const override
+  {
+    if ( po.output.empty() ) {
+      throw ExpectationViolation( "expected a segment, but none was sent" );
+    }
+    const TCPMessage& msg = po.output.front();
+    if ( ackno.has_value() and msg.receiver.ackno != ackno ) {
+      throw ExpectationViolation( "ackno", ackno, msg.receiver.ackno );
+    }
+    if ( syn.has_value() and msg.sender.SYN != syn.value() ) {
+      throw ExpectationViolation( "SYN flag", syn.value(), msg.sender.SYN );
+    }
+    if ( data.has_value() and data.value() != msg.sender.payload ) {
+      throw ExpectationViolation( "Expecting payload of \"" + Printer::prettify( data.value() )
+                                  + "\", but instead it was \"" + Printer::prettify( msg.sender.payload ) + "\"" );
+    }
+    if ( window_scale.has_value() and msg.sender.window_scale != window_scale.value() ) {
+      const auto str = []( std::optional<uint8_t> x ) { return x.has_value() ? std::to_string( *x ) : "none"; };
+      throw ExpectationViolation( "Expecting window scale " + str( window_scale.value() ) + ", but instead it was "
+                                  + str( msg.sender.window_scale ) );
+    }
+    if ( sack_permitted.has_value() and msg.sender.sack_permitted != sack_permitted.value() ) {
+      throw ExpectationViolation( "SACK-permitted", sack_permitted.value(), msg.sender.sack_permitted );
+    }
+    po.output.pop();
+  }
+};
+
+class TCPPeerTestHarness : public TestHarness<PeerAndOutput>
+{
+public:
+  TCPPeerTestHarness( std::string name, const TCPConfig& config )
+    : TestHarness( std::move( name ), "ack_delay=" + std::to_string( config.ack_delay ), { TCPPeer { config } } )
+  {}
+};
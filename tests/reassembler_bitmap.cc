@@ -0,0 +1,118 @@
+#include "random.hh"
+#include "reassembler_test_harness.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+static constexpr auto Bitmap = Reassembler::Backend::Bitmap;
+
+int main()
+{
+  try {
+    {
+      ReassemblerTestHarness test { "bitmap pending count", 100, Bitmap };
+      test.execute( Insert { "cd", 2 } );
+      test.execute( BytesPending { 2 } );
+      test.execute( Insert { "bcde", 1 } );
+      test.execute( BytesPending { 4 } );
+      test.execute( Insert { "g", 6 } );
+      test.execute( BytesPending { 5 } );
+      test.execute( Insert { "a", 0 } );
+      test.execute( BytesPending { 1 } );
+      test.execute( ReadAll( "abcde" ) );
+      test.execute( Insert { "f", 5 }.is_last( false ) );
+      test.execute( Insert { "", 7 }.is_last() );
+      test.execute( BytesPending { 0 } );
+      test.execute( ReadAll( "fg" ) );
+      test.execute( IsFinished { true } );
+    }
+
+    {
+      ReassemblerTestHarness test { "bitmap wraps around the ring", 8, Bitmap };
+      test.execute( Insert { "abcdef", 0 } );
+      test.execute( ReadAll( "abcdef" ) );
+      test.execute( Insert { "klmnop", 10 } );
+      test.execute( BytesPending { 4 } );
+      test.execute( Insert { "ghij", 6 } );
+      test.execute( BytesPending { 0 } );
+      test.execute( BytesPushed( 14 ) );
+      test.execute( ReadAll( "ghijklmn" ) );
+      test.execute( Insert { "opqrstuvw", 14 }.is_last() );
+      test.execute( ReadAll( "opqrstuv" ) );
+      test.execute( Insert { "w", 22 }.is_last() );
+      test.execute( ReadAll( "w" ) );
+      test.execute( IsFinished { true } );
+    }
+
+    {
+      ReassemblerTestHarness test { "bitmap spans words", 200, Bitmap };
+      test.execute( Insert { string( 130, 'x' ), 70 } );
+      test.execute( BytesPending { 130 } );
+      test.execute( Insert { string( 70, 'y' ), 0 } );
+      test.execute( BytesPending { 0 } );
+      test.execute( ReadAll( string( 70, 'y' ) + string( 130, 'x' ) ) );
+    }
+
+    for ( const auto backend : { Reassembler::Backend::Intervals, Bitmap } ) {
+      ReassemblerTestHarness test { "pending intervals", 8, backend };
+      test.execute( PendingIntervals { {} } );
+      test.execute( Insert { "c", 2 } );
+      test.execute( Insert { "ef", 4 } );
+      test.execute( PendingIntervals { { { 2, 3 }, { 4, 6 } } } );
+      test.execute( Insert { "d", 3 } );
+      test.execute( PendingIntervals { { { 2, 6 } } } );
+      test.execute( Insert { "ab", 0 } );
+      test.execute( PendingIntervals { {} } );
+      test.execute( ReadAll( "abcdef" ) );
+
+      // the window now wraps around the end of the ring
+      test.execute( Insert { "h", 7 } );
+      test.execute( Insert { "ijk", 8 } );
+      test.execute( Insert { "m", 12 } );
+      test.execute( PendingIntervals { { { 7, 11 }, { 12, 13 } } } );
+    }
+
+    // shuffled, overlapping segments through a small ring that is drained as it fills
+    auto rd = get_random_engine();
+    for ( unsigned rep_no = 0; rep_no < 32; ++rep_no ) {
+      const size_t capacity = 64 + rd() % 512;
+      ReassemblerTestHarness sr { "bitmap random " + to_string( rep_no ), capacity, Bitmap };
+
+      string d( 16 * capacity, 0 );
+      generate( d.begin(), d.end(), [&] { return rd(); } );
+
+      for ( size_t next = 0; next < d.size(); ) {
+        const size_t window_end = min( d.size(), next + capacity );
+        vector<tuple<size_t, size_t>> segs;
+        for ( size_t off = next; off < window_end; ) {
+          const size_t size = 1 + rd() % 100;
+          const size_t back = min( off, static_cast<size_t>( rd() % 16 ) );
+          segs.emplace_back( off - back, size + back );
+          off += size;
+        }
+        shuffle( segs.begin(), segs.end(), rd );
+        for ( auto [off, sz] : segs ) {
+          sz = min( sz, d.size() - off );
+          sr.execute( Insert { d.substr( off, sz ), off }.is_last( off + sz == d.size() ) );
+        }
+        sr.execute( BytesPushed( window_end ) );
+        sr.execute( ReadAll( d.substr( next, window_end - next ) ) );
+        next = window_end;
+      }
+
+      sr.execute( BytesPending { 0 } );
+      sr.execute( IsFinished { true } );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -15,7 +15,8 @@ using namespace std::chrono;
 
 void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-parameters)
                  const size_t capacity,     // NOLINT(bugprone-easily-swappable-parameters)
-                 const size_t random_seed ) // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t random_seed,  // NOLINT(bugprone-easily-swappable-parameters)
+                 const Reassembler::Backend backend = Reassembler::Backend::Intervals )
 {
   // Generate the data to be written
   const string data = [&] {
@@ -36,7 +37,7 @@ void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-
     split_data.emplace( i + 1, data.substr( i + 1, capacity * 2 ), i + 1 + capacity * 2 >= data.size() );
   }
 
-  Reassembler reassembler { ByteStream { capacity } };
+  Reassembler reassembler { ByteStream { capacity }, backend };
 
   string output_data;
   output_data.reserve( data.size() );
@@ -71,7 +72,8 @@ void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-
   fstream debug_output;
   debug_output.open( "/dev/tty" );
 
-  cout << "Reassembler to ByteStream with capacity=" << capacity << " reached " << fixed << setprecision( 2 )
+  cout << "Reassembler" << ( backend == Reassembler::Backend::Bitmap ? " (bitmap)" : "" )
+       << " to ByteStream with capacity=" << capacity << " reached " << fixed << setprecision( 2 )
        << gigabits_per_second << " Gbit/s.\n";
 
   debug_output << "             Reassembler throughput: " << fixed << setprecision( 2 ) << gigabits_per_second
@@ -85,6 +87,7 @@ void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-
 void program_body()
 {
   speed_test( 10000, 1500, 1370 );
+  speed_test( 10000, 1500, 1370, Reassembler::Backend::Bitmap );
 }
 
 int main()
@@ -7,6 +7,7 @@
 #include <optional>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 template<std::derived_from<TestStep<ByteStream>> T>
 struct ReassemblerTestStep : public TestStep<Reassembler>
@@ -27,10 +28,13 @@ struct ReassemblerTestStep : public TestStep<Reassembler>
 class ReassemblerTestHarness : public TestHarness<Reassembler>
 {
 public:
-  ReassemblerTestHarness( std::string test_name, uint64_t capacity )
+  ReassemblerTestHarness( std::string test_name,
+                          uint64_t capacity,
+                          Reassembler::Backend backend = Reassembler::Backend::Intervals )
     : TestHarness( move( test_name ),
-                   "capacity=" + std::to_string( capacity ),
-                   { Reassembler { ByteStream { capacity } } } )
+                   "capacity=" + std::to_string( capacity )
+                     + ( backend == Reassembler::Backend::Bitmap ? ", bitmap" : "" ),
+                   { Reassembler { ByteStream { capacity }, backend } } )
   {}
 
   template<std::derived_from<TestStep<ByteStream>> T>
@@ -49,6 +53,16 @@ struct BytesPending : public ConstExpectNumber<Reassembler, uint64_t>
   uint64_t value( const Reassembler& r ) const override { return r.bytes_pending(); }
 };
 
+struct PendingIntervals : public ConstExpectNumber<Reassembler, std::vector<std::pair<uint64_t, uint64_t>>>
+{
+  using ConstExpectNumber::ConstExpectNumber;
+  std::string name() const override { return "pending_intervals"; }
+  std::vector<std::pair<uint64_t, uint64_t>> value( const Reassembler& r ) const override
+  {
+    return r.pending_intervals();
+  }
+};
+
 struct Insert : public Action<Reassembler>
 {
   std::string data_;
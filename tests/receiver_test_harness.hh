@@ -40,10 +40,15 @@ struct DirectByteStreamTest : public TestStep<TCPReceiver>
 class TCPReceiverTestHarness : public TestHarness<TCPReceiver>
 {
 public:
-  TCPReceiverTestHarness( std::string test_name, uint64_t capacity )
+  TCPReceiverTestHarness( std::string test_name,
+                          uint64_t capacity,
+                          std::optional<uint8_t> window_shift = std::nullopt,
+                          bool sack = false )
     : TestHarness( move( test_name ),
-                   "capacity=" + std::to_string( capacity ),
-                   { TCPReceiver { Reassembler { ByteStream { capacity } } } } )
+                   "capacity=" + std::to_string( capacity )
+                     + ( window_shift ? ", window_shift=" + std::to_string( *window_shift ) : "" )
+                     + ( sack ? ", sack" : "" ),
+                   { TCPReceiver { Reassembler { ByteStream { capacity } }, window_shift, sack } } )
   {}
 
   template<std::derived_from<TestStep<Reassembler>> T>
@@ -61,11 +66,18 @@ public:
   using TestHarness<TCPReceiver>::execute;
 };
 
-struct ExpectWindow : public ExpectNumber<TCPReceiver, uint16_t>
+struct ExpectWindow : public ExpectNumber<TCPReceiver, uint32_t>
 {
   using ExpectNumber::ExpectNumber;
   std::string name() const override { return "window_size"; }
-  uint16_t value( TCPReceiver& rs ) const override { return rs.send().window_size; }
+  uint32_t value( TCPReceiver& rs ) const override { return rs.send().window_size; }
+};
+
+struct ExpectSack : public ExpectNumber<TCPReceiver, std::vector<std::pair<Wrap32, Wrap32>>>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "sack"; }
+  std::vector<std::pair<Wrap32, Wrap32>> value( TCPReceiver& rs ) const override { return rs.send().sack; }
 };
 
 struct ExpectAckno : public ExpectNumber<TCPReceiver, std::optional<Wrap32>>
@@ -155,6 +167,18 @@ struct SegmentArrives : public Action<TCPReceiver>
     return *this;
   }
 
+  SegmentArrives& with_window_scale( uint8_t shift )
+  {
+    msg_.window_scale = shift;
+    return *this;
+  }
+
+  SegmentArrives& with_sack_permitted()
+  {
+    msg_.sack_permitted = true;
+    return *this;
+  }
+
   SegmentArrives& without_ackno()
   {
     ackno_expected_ = HasAckno { false };
@@ -175,6 +199,12 @@ struct SegmentArrives : public Action<TCPReceiver>
     if ( msg_.SYN ) {
       ss << " +SYN";
     }
+    if ( msg_.window_scale.has_value() ) {
+      ss << " wscale=" << static_cast<int>( *msg_.window_scale );
+    }
+    if ( msg_.sack_permitted ) {
+      ss << " +SACK-permitted";
+    }
     if ( not msg_.payload.empty() ) {
       ss << " payload=\"" << Printer::prettify( msg_.payload ) << "\"";
     }
@@ -0,0 +1,71 @@
+#include "receiver_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+int main()
+{
+  try {
+    {
+      const uint32_t isn = 4500;
+      TCPReceiverTestHarness test { "no SACK blocks unless the peer permits them", 4000, nullopt, true };
+      test.execute( SegmentArrives {}.with_syn().with_seqno( isn ) );
+      test.execute( SegmentArrives {}.with_seqno( isn + 3 ).with_data( "cd" ) );
+      test.execute( BytesPending { 2 } );
+      test.execute( ExpectSack { {} } );
+    }
+
+    {
+      const uint32_t isn = 4500;
+      TCPReceiverTestHarness test { "no SACK blocks unless we offer them", 4000 };
+      test.execute( SegmentArrives {}.with_syn().with_sack_permitted().with_seqno( isn ) );
+      test.execute( SegmentArrives {}.with_seqno( isn + 3 ).with_data( "cd" ) );
+      test.execute( ExpectSack { {} } );
+    }
+
+    {
+      const uint32_t isn = 4500;
+      TCPReceiverTestHarness test { "SACK blocks report held data, latest first", 4000, nullopt, true };
+      test.execute( SegmentArrives {}.with_syn().with_sack_permitted().with_seqno( isn ) );
+      test.execute( ExpectSack { {} } );
+      test.execute( SegmentArrives {}.with_seqno( isn + 3 ).with_data( "cd" ) );
+      test.execute( ExpectAckno { Wrap32 { isn + 1 } } );
+      test.execute( ExpectSack { { { Wrap32 { isn + 3 }, Wrap32 { isn + 5 } } } } );
+      test.execute( SegmentArrives {}.with_seqno( isn + 7 ).with_data( "gh" ) );
+      test.execute( ExpectSack { { { Wrap32 { isn + 7 }, Wrap32 { isn + 9 } },
+                                   { Wrap32 { isn + 3 }, Wrap32 { isn + 5 } } } } );
+      test.execute( SegmentArrives {}.with_seqno( isn + 5 ).with_data( "ef" ) );
+      test.execute( ExpectSack { { { Wrap32 { isn + 3 }, Wrap32 { isn + 9 } } } } );
+      test.execute( SegmentArrives {}.with_seqno( isn + 1 ).with_data( "ab" ) );
+      test.execute( ExpectAckno { Wrap32 { isn + 9 } } );
+      test.execute( ExpectSack { {} } );
+      test.execute( ReadAll { "abcdefgh" } );
+    }
+
+    {
+      const uint32_t isn = 0xfffffff0;
+      TCPReceiverTestHarness test { "at most four SACK blocks, wrapping seqnos", 4000, nullopt, true };
+      test.execute( SegmentArrives {}.with_syn().with_sack_permitted().with_seqno( isn ) );
+      for ( const uint32_t offset : { 3, 7, 11, 15, 19, 23 } ) {
+        test.execute( SegmentArrives {}.with_seqno( isn + offset ).with_data( "xx" ) );
+      }
+      test.execute( SegmentArrives {}.with_seqno( isn + 11 ).with_data( "x" ) );
+      // the latest segment's block first, then the most recently received blocks
+      test.execute( ExpectSack { { { Wrap32 { isn + 11 }, Wrap32 { isn + 13 } },
+                                   { Wrap32 { isn + 23 }, Wrap32 { isn + 25 } },
+                                   { Wrap32 { isn + 19 }, Wrap32 { isn + 21 } },
+                                   { Wrap32 { isn + 15 }, Wrap32 { isn + 17 } } } } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return EXIT_SUCCESS;
+}
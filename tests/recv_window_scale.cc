@@ -0,0 +1,61 @@
+#include "receiver_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+int main()
+{
+  try {
+    {
+      const uint32_t isn = 5890;
+      TCPReceiverTestHarness test { "no scaling unless the peer offers it", 10'000'000, 8 };
+      test.execute( SegmentArrives {}.with_syn().with_seqno( isn ) );
+      test.execute( ExpectAckno { Wrap32 { isn + 1 } } );
+      test.execute( ExpectWindow { UINT16_MAX } );
+    }
+
+    {
+      const uint32_t isn = 5890;
+      TCPReceiverTestHarness test { "no scaling unless we offer it", 10'000'000 };
+      test.execute( SegmentArrives {}.with_syn().with_window_scale( 7 ).with_seqno( isn ) );
+      test.execute( ExpectWindow { UINT16_MAX } );
+    }
+
+    {
+      const uint32_t isn = 1230;
+      TCPReceiverTestHarness test { "window beyond 65535 once both sides scale", 1'000'000, 4 };
+      test.execute( ExpectWindow { UINT16_MAX } );
+      test.execute( SegmentArrives {}.with_syn().with_window_scale( 0 ).with_seqno( isn ) );
+      test.execute( ExpectWindow { 1'000'000 } );
+      test.execute( SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abc" ) );
+      test.execute( ExpectAckno { Wrap32 { isn + 4 } } );
+      test.execute( ExpectWindow { 999'984 } ); // rounded down to a multiple of 16
+      test.execute( ReadAll { "abc" } );
+      test.execute( ExpectWindow { 1'000'000 } );
+    }
+
+    {
+      const uint32_t isn = 1230;
+      TCPReceiverTestHarness test { "scaled window is capped at 65535 << shift", 10'000'000, 4 };
+      test.execute( SegmentArrives {}.with_syn().with_window_scale( 2 ).with_seqno( isn ) );
+      test.execute( ExpectWindow { uint32_t { UINT16_MAX } << 4 } );
+    }
+
+    {
+      const uint32_t isn = 1230;
+      TCPReceiverTestHarness test { "window of less than one unit rounds to zero", 10, 4 };
+      test.execute( SegmentArrives {}.with_syn().with_window_scale( 2 ).with_seqno( isn ) );
+      test.execute( ExpectWindow { 0 } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static constexpr uint64_t MSS = TCPConfig::MAX_PAYLOAD_SIZE;
+
+// Push `count` full-sized segments' worth of data and expect them all to go out
+void expect_segments( TCPSenderTestHarness& test, size_t count )
+{
+  for ( size_t i = 0; i < count; ++i ) {
+    test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+  }
+  test.execute( ExpectNoSegment {} );
+}
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "Slow start opens the window by one MSS per MSS acknowledged", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( ExpectCongestionWindow { 10 * MSS } );
+      test.execute( Push( string( 30 * MSS, 'x' ) ) );
+      expect_segments( test, 10 );
+      test.execute( ExpectSeqnosInFlight { 10 * MSS } );
+      test.execute( AckReceived { Wrap32 { isn + 1 + MSS } }.with_win( 60000 ) );
+      test.execute( ExpectCongestionWindow { 11 * MSS } );
+      expect_segments( test, 2 );
+      // a stretch ACK (e.g. from a receiver delaying its ACKs) counts for at most two MSS (RFC 3465)
+      test.execute( AckReceived { Wrap32 { isn + 1 + 12 * MSS } }.with_win( 60000 ) );
+      test.execute( ExpectCongestionWindow { 13 * MSS } );
+      expect_segments( test, 13 );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "Effective window is the smaller of cwnd and rwnd", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 3 * MSS ) );
+      test.execute( Push( string( 30 * MSS, 'x' ) ) );
+      expect_segments( test, 3 );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "Fast recovery halves the window and handles a partial ACK", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 10 * MSS, 'x' ) ) );
+      expect_segments( test, 10 );
+
+      // segments 1 and 3 are lost
+      for ( int i = 0; i < 3; ++i ) {
+        test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      }
+      test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( isn + 1 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectCongestionWindow { 5 * MSS + 3 * MSS } );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( ExpectCongestionWindow { 9 * MSS } );
+
+      // partial ACK: retransmit the next hole right away
+      test.execute( AckReceived { Wrap32 { isn + 1 + 2 * MSS } }.with_win( 60000 ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( isn + 1 + 2 * MSS ) );
+      test.execute( ExpectCongestionWindow { 8 * MSS } );
+
+      // full ACK: leave recovery with cwnd = min(ssthresh, flight size + MSS) to avoid a burst
+      test.execute( AckReceived { Wrap32 { isn + 1 + 10 * MSS } }.with_win( 60000 ) );
+      test.execute( ExpectCongestionWindow { 2 * MSS } );
+      test.execute( ExpectSeqnosInFlight { 0 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      const uint16_t retx_timeout = uniform_int_distribution<uint16_t> { 10, 10000 }( rd );
+      cfg.isn = isn;
+      cfg.rt_timeout = retx_timeout;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "Timeout collapses the window to one MSS", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 20 * MSS, 'x' ) ) );
+      expect_segments( test, 10 );
+      test.execute( Tick { retx_timeout } );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( isn + 1 ) );
+      test.execute( ExpectCongestionWindow { MSS } );
+      test.execute( AckReceived { Wrap32 { isn + 1 + 10 * MSS } }.with_win( 60000 ) );
+      test.execute( ExpectCongestionWindow { 2 * MSS } );
+      expect_segments( test, 2 );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.rt_timeout = 10000;
+      cfg.congestion_control = CongestionControl::Algorithm::Cubic;
+
+      TCPSenderTestHarness test { "CUBIC backs off to 0.7 and regrows with elapsed time", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( Tick { 100 } );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 40 * MSS, 'x' ) ) );
+      expect_segments( test, 10 );
+      test.execute( Tick { 100 } );
+      for ( int i = 0; i < 3; ++i ) {
+        test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      }
+      test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( isn + 1 ) );
+      test.execute( ExpectCongestionWindow { 7 * MSS } );
+      test.execute( AckReceived { Wrap32 { isn + 1 + 10 * MSS } }.with_win( 60000 ) );
+      test.execute( ExpectCongestionWindow { 7 * MSS } );
+      test.execute( ExpectSeqnosInFlight { 7 * MSS } );
+
+      // first RTT of congestion avoidance: still in the Reno-friendly region
+      test.execute( Tick { 100 } );
+      test.execute( AckReceived { Wrap32 { isn + 1 + 17 * MSS } }.with_win( 60000 ) );
+      test.execute( ExpectCongestionWindow { 7529 } );
+
+      // three seconds later the cubic curve is past W_max, so the window grows by half at once
+      test.execute( Tick { 3000 } );
+      test.execute( AckReceived { Wrap32 { isn + 1 + 24 * MSS } }.with_win( 60000 ) );
+      test.execute( ExpectCongestionWindow { 11029 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.send_capacity = 1000 * MSS;
+      cfg.congestion_control = CongestionControl::Algorithm::BBR;
+
+      TCPSenderTestHarness test { "BBR settles at twice the bandwidth-delay product", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( Tick { 100 } );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 65000 ) );
+      test.execute( Push( string( 1000 * MSS, 'x' ) ) );
+      test.execute( ExpectSeqnosInFlight { 10 * MSS } );
+
+      // the bottleneck delivers 20 segments per 100 ms: BDP = 20000 bytes
+      uint64_t acked = 1 + 10 * MSS;
+      test.execute( Tick { 100 } );
+      test.execute( AckReceived { Wrap32 { isn + acked } }.with_win( 65000 ) );
+      test.execute( ExpectCongestionWindow { 20 * MSS } ); // Startup doubles every round
+      for ( int round = 0; round < 20; ++round ) {
+        acked += 20 * MSS;
+        test.execute( Tick { 100 } );
+        test.execute( AckReceived { Wrap32 { isn + acked } }.with_win( 65000 ) );
+      }
+      test.execute( ExpectCongestionWindow { 40 * MSS } );
+      test.execute( ExpectSeqnosInFlight { 40 * MSS } );
+    }
+
+    {
+      TCPConfig cfg;
+      TCPSenderTestHarness test { "No congestion window by default", cfg };
+      test.execute( ExpectCongestionWindow { UINT64_MAX } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,280 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+
+      TCPSenderTestHarness test { "Configured MSS sizes the segments", cfg };
+      test.execute( ExpectMaxSegmentSize { 1460 } );
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ).with_payload_size( 0 ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 3000, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1460 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1460 ).with_seqno( isn + 1461 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 80 ).with_seqno( isn + 2921 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "Peer MSS lowers the segment size during the handshake", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ).with_payload_size( 0 ) );
+      test.execute( PeerMSS { 536 } );
+      test.execute( ExpectMaxSegmentSize { 536 } );
+      test.execute( ExpectCongestionWindow { 10 * 536 } ); // RFC 6928 initial window for the smaller MSS
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 1200, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 536 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 536 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 128 ) );
+      test.execute( PeerMSS { 100 } ); // a duplicate SYN after data has flowed changes nothing
+      test.execute( ExpectMaxSegmentSize { 536 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1000;
+
+      TCPSenderTestHarness test { "A larger peer MSS does not raise the segment size", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( PeerMSS { 8960 } );
+      test.execute( ExpectMaxSegmentSize { 1000 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+      cfg.pmtu_discovery = true;
+
+      TCPSenderTestHarness test { "PMTU discovery starts from the base size and probes for the MSS", cfg };
+      test.execute( ExpectMaxSegmentSize { TCPConfig::PMTU_BASE_MSS } );
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ).with_payload_size( 0 ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 3000, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1460 ).with_seqno( isn + 1 ) ); // the probe
+      test.execute( ExpectMessage {}.with_payload_size( 1024 ).with_seqno( isn + 1461 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 516 ).with_seqno( isn + 2485 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectMaxSegmentSize { 1024 } );
+      test.execute( AckReceived { Wrap32 { isn + 1461 } }.with_win( 60000 ) );
+      test.execute( ExpectMaxSegmentSize { 1460 } );
+      test.execute( AckReceived { Wrap32 { isn + 3001 } }.with_win( 60000 ) );
+      test.execute( Push( string( 3000, 'y' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1460 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1460 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 80 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+      cfg.pmtu_discovery = true;
+      cfg.fast_retransmit = true;
+
+      TCPSenderTestHarness test { "Probes failing while smaller segments get through lower the limit", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+
+      uint64_t acked = 1;
+      // The probe is lost, but the three segments after it arrive. It is resent in pieces of the size that works.
+      const auto probe_lost = [&]( uint64_t size ) {
+        test.execute( Push( string( size + 3 * 1024, 'x' ) ) );
+        test.execute( ExpectMessage {}.with_payload_size( size ).with_seqno( isn + acked ) );
+        for ( int i = 0; i < 3; i++ ) {
+          test.execute( ExpectMessage {}.with_payload_size( 1024 ) );
+        }
+        for ( int i = 0; i < 3; i++ ) {
+          test.execute( AckReceived { Wrap32 { isn + acked } }.with_win( 60000 ) );
+        }
+        test.execute( ExpectMessage {}.with_payload_size( 1024 ).with_seqno( isn + acked ) );
+        test.execute( ExpectNoSegment {} );
+        acked += size + 3 * 1024;
+        test.execute( AckReceived { Wrap32 { isn + acked } }.with_win( 60000 ) );
+      };
+      const auto probe_acked = [&]( uint64_t size ) {
+        test.execute( Push( string( size, 'x' ) ) );
+        test.execute( ExpectMessage {}.with_payload_size( size ).with_seqno( isn + acked ) );
+        acked += size;
+        test.execute( AckReceived { Wrap32 { isn + acked } }.with_win( 60000 ) );
+        test.execute( ExpectMaxSegmentSize { size } );
+      };
+
+      probe_lost( 1460 );
+      probe_lost( 1460 );
+      test.execute( ExpectMaxSegmentSize { 1024 } );
+      probe_lost( 1460 );
+
+      // now 1460 is taken to be too large, and the search halves the range each time
+      for ( const uint64_t size : { 1242, 1351, 1405, 1432, 1446, 1453 } ) {
+        probe_acked( size );
+      }
+      test.execute( Push( string( 3000, 'y' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1453 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1453 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 94 ) );
+      acked += 3000;
+      test.execute( AckReceived { Wrap32 { isn + acked } }.with_win( 60000 ) );
+
+      // until, some time later, the path might have changed
+      test.execute( Tick { TCPConfig::PMTU_REPROBE_MS } );
+      probe_acked( 1460 );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      const uint16_t retx_timeout = uniform_int_distribution<uint16_t> { 10, 10000 }( rd );
+      cfg.isn = isn;
+      cfg.rt_timeout = retx_timeout;
+      cfg.mss = 1024;
+      cfg.pmtu_discovery = true;
+
+      TCPSenderTestHarness test { "Repeated timeouts fall back to the minimum MSS until a probe succeeds", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 2048, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1024 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1024 ).with_seqno( isn + 1025 ) );
+
+      // the first timeout could be ordinary loss
+      test.execute( Tick { retx_timeout } );
+      test.execute( ExpectMessage {}.with_payload_size( 1024 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMaxSegmentSize { 1024 } );
+
+      // the second one could mean the path no longer carries segments this large
+      test.execute( Tick { 2UL * retx_timeout } );
+      test.execute( ExpectMessage {}.with_payload_size( TCPConfig::MIN_MSS ).with_seqno( isn + 1 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectMaxSegmentSize { TCPConfig::MIN_MSS } );
+      test.execute( ExpectSeqnosInFlight { 2048 } );
+      test.execute( AckReceived { Wrap32 { isn + 2049 } }.with_win( 60000 ) );
+
+      // but it was only congestion: the old size is probed at once, and comes back
+      test.execute( Push( string( 2000, 'y' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1024 ).with_seqno( isn + 2049 ) );
+      test.execute( ExpectMessage {}.with_payload_size( TCPConfig::MIN_MSS ) );
+      test.execute( ExpectMessage {}.with_payload_size( 2000 - 1024 - TCPConfig::MIN_MSS ) );
+      test.execute( AckReceived { Wrap32 { isn + 4049 } }.with_win( 60000 ) );
+      test.execute( ExpectMaxSegmentSize { 1024 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      const uint16_t retx_timeout = uniform_int_distribution<uint16_t> { 10, 10000 }( rd );
+      cfg.isn = isn;
+      cfg.rt_timeout = retx_timeout;
+      cfg.mss = 1460;
+
+      TCPSenderTestHarness test { "Without PMTU discovery timeouts keep the segment size", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 1460, 'x' ) ).with_close() );
+      test.execute( ExpectMessage {}.with_payload_size( 1460 ).with_fin( true ) );
+      test.execute( Tick { retx_timeout } );
+      test.execute( Tick { 2UL * retx_timeout } );
+      test.execute( ExpectMessage {}.with_payload_size( 1460 ).with_fin( true ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1460 ).with_fin( true ) );
+      test.execute( ExpectMaxSegmentSize { 1460 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1000;
+      cfg.tso_size = 4500;
+
+      TCPSenderTestHarness test { "TSO sends whole multiples of the MSS in one segment", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 10000, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 4000 ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 4000 ).with_seqno( isn + 4001 ) );
+      test.execute( ExpectMessage {}.with_payload_size( 2000 ).with_seqno( isn + 8001 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectMaxSegmentSize { 1000 } );
+
+      // the window still limits how much goes out
+      test.execute( AckReceived { Wrap32 { isn + 10001 } }.with_win( 2500 ) );
+      test.execute( Push( string( 10000, 'y' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 2500 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1460;
+      cfg.tso_size = 65000;
+
+      TCPSenderTestHarness test { "TSO segments are multiples of the peer's smaller MSS", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( PeerMSS { 1000 } );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 7500, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 7500 ) );
+      test.execute( ExpectMaxSegmentSize { 1000 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.mss = 1000;
+      cfg.tso_size = 4000;
+      cfg.pacing = true;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      TCPSenderTestHarness test { "Pacing sends MSS-sized segments even with TSO", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 1500, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ) );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
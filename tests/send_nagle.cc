@@ -0,0 +1,154 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static constexpr uint64_t MSS = TCPConfig::MAX_PAYLOAD_SIZE;
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.nagle = true;
+
+      TCPSenderTestHarness test { "Nagle holds small segments while data is unacknowledged", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( "a" ) );
+      test.execute( ExpectMessage {}.with_data( "a" ) ); // nothing outstanding: send at once
+      test.execute( Push( "b" ) );
+      test.execute( Push( "c" ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { Wrap32 { isn + 2 } }.with_win( 60000 ) );
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_data( "bc" ).with_seqno( isn + 2 ) );
+      test.execute( ExpectNoSegment {} );
+
+      // full-sized segments are never held; the tail waits for the ACK
+      test.execute( Push( string( 2 * MSS + 10, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { Wrap32 { isn + 4 + 2 * MSS } }.with_win( 60000 ) );
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_payload_size( 10 ) );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.nagle = true;
+
+      TCPSenderTestHarness test { "Closing the stream flushes held data with the FIN", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( "hello" ) );
+      test.execute( ExpectMessage {}.with_data( "hello" ) );
+      test.execute( Push( "world" ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Close {} );
+      test.execute( ExpectMessage {}.with_data( "world" ).with_fin( true ) );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Cork holds partial segments until uncorked", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( SetCork { true } );
+      test.execute( Push( "GET / HTTP/1.1\r\n" ) );
+      test.execute( Push( "Host: example.com\r\n\r\n" ) );
+      test.execute( ExpectNoSegment {} ); // held even with nothing outstanding
+      test.execute( Push( string( MSS, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( isn + 1 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( SetCork { false } );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_payload_size( 37 ).with_seqno( isn + 1 + MSS ) );
+      test.execute( ExpectSeqnosInFlight { MSS + 37 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Cork holds a partial segment for at most MAX_CORK_DELAY", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( SetCork { true } );
+      test.execute( Push( "abc" ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectNextDeadline { TCPConfig::MAX_CORK_DELAY } );
+      test.execute( Tick { TCPConfig::MAX_CORK_DELAY - 1 } );
+      test.execute( Push( "def" ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectNextDeadline { 1 } );
+      test.execute( Tick { 1 } );
+      test.execute( ExpectMessage {}.with_data( "abcdef" ) );
+      test.execute( ExpectNextDeadline { TCPConfig::TIMEOUT_DFLT } );
+
+      // the next partial segment waits its own full delay
+      test.execute( Push( "ghi" ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( Tick { TCPConfig::MAX_CORK_DELAY } );
+      test.execute( ExpectMessage {}.with_data( "ghi" ) );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Cork does not wait for a segment the peer's window cannot take", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( MSS / 2 ) );
+      test.execute( SetCork { true } );
+      test.execute( Push( string( MSS, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS / 2 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { Wrap32 { isn + 1 + MSS / 2 } }.with_win( MSS / 2 ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS / 2 ) );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Cork does not stop zero-window probes", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 0 ) );
+      test.execute( SetCork { true } );
+      test.execute( Push( "abc" ) );
+      test.execute( ExpectMessage {}.with_data( "a" ) );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
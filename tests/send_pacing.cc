@@ -0,0 +1,102 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <string>
+
+using namespace std;
+
+static constexpr uint64_t MSS = TCPConfig::MAX_PAYLOAD_SIZE;
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.rt_timeout = 10000;
+      cfg.pacing = true;
+
+      // rate = 1.2 * window / SRTT = 1.2 * 10000 / 100 = 120 bytes per ms
+      TCPSenderTestHarness test { "Pacing releases segments at about window / SRTT", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( Tick { 100 } );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 10 * MSS ) );
+      test.execute( ExpectPacingDelay { nullopt } );
+      test.execute( Push( string( 10 * MSS, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) ); // the bucket starts with two segments
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectPacingDelay { 9 } );
+      test.execute( Tick { 8 } );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectPacingDelay { 1 } );
+      test.execute( Tick { 1 } );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( isn + 1 + 2 * MSS ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectPacingDelay { 8 } ); // 80 bytes left over
+
+      // a long pause refills the bucket only up to two segments
+      test.execute( Tick { 1000 } );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectSeqnosInFlight { 5 * MSS } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.pacing = true;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      // slow start paces at twice cwnd / SRTT: 2 * 10000 / 50 = 400 bytes per ms
+      TCPSenderTestHarness test { "Slow start paces with a higher gain", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( Tick { 50 } );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 10 * MSS, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectPacingDelay { 3 } );
+      test.execute( Tick { 5 } );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.pacing = true;
+
+      TCPSenderTestHarness test { "A bare FIN is not held by the pacer", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( Tick { 100 } );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 10 * MSS ) );
+      test.execute( Push( string( 2 * MSS, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ) );
+      test.execute( Close {} ); // the bucket is empty
+      test.execute( ExpectMessage {}.with_payload_size( 0 ).with_fin( true ) );
+      test.execute( ExpectPacingDelay { nullopt } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
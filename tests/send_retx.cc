@@ -24,18 +24,22 @@ int main()
       cfg.rt_timeout = retx_timeout;
 
       TCPSenderTestHarness test { "Retx SYN twice at the right times, then ack", cfg };
+      test.execute( ExpectNextDeadline { nullopt } );
       test.execute( Push {} );
       test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
       test.execute( ExpectNoSegment {} );
       test.execute( ExpectSeqno { isn + 1 } );
       test.execute( ExpectSeqnosInFlight { 1 } );
+      test.execute( ExpectNextDeadline { retx_timeout } );
       test.execute( Tick { retx_timeout - 1U } );
       test.execute( ExpectNoSegment {} );
+      test.execute( ExpectNextDeadline { 1 } );
       test.execute( Tick { 1 } );
       test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
       test.execute( ExpectSeqno { isn + 1 } );
       test.execute( ExpectSeqnosInFlight { 1 } );
       // Wait twice as long b/c exponential back-off
+      test.execute( ExpectNextDeadline { 2UL * retx_timeout } );
       test.execute( Tick { 2 * retx_timeout - 1U } );
       test.execute( ExpectNoSegment {} );
       test.execute( Tick { 1 } );
@@ -45,6 +49,7 @@ int main()
       test.execute( AckReceived { Wrap32 { isn + 1 } } );
       test.execute( ExpectSeqno { isn + 1 } );
       test.execute( ExpectSeqnosInFlight { 0 } );
+      test.execute( ExpectNextDeadline { nullopt } );
       test.execute( HasError { false } );
     }
 
@@ -0,0 +1,191 @@
+#include "random.hh"
+#include "sender_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static constexpr uint64_t MSS = TCPConfig::MAX_PAYLOAD_SIZE;
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.fast_retransmit = true;
+
+      // seqno of the first byte of the n-th full-sized segment
+      auto seg = [&]( uint64_t n ) { return isn + 1 + n * MSS; };
+
+      TCPSenderTestHarness test { "Fast retransmit resends only the holes", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 10 * MSS, 'x' ) ) );
+      for ( int i = 0; i < 10; ++i ) {
+        test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( seg( i ) ) );
+      }
+
+      // segments 0 and 2 are lost; the receiver holds segment 1 and segments 3 up to `sacked_end`
+      auto dup_ack = [&]( uint64_t sacked_end ) {
+        AckReceived ack { seg( 0 ) };
+        ack.with_win( 60000 ).with_sack( seg( 3 ), seg( sacked_end ) ).with_sack( seg( 1 ), seg( 2 ) );
+        return ack;
+      };
+      test.execute( AckReceived { seg( 0 ) }.with_win( 60000 ).with_sack( seg( 1 ), seg( 2 ) ) );
+      test.execute( dup_ack( 4 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( dup_ack( 5 ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( seg( 0 ) ) );
+      test.execute( ExpectNoSegment {} ); // too little SACKed above segment 2 to call it lost yet
+
+      test.execute( dup_ack( 6 ) );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( seg( 2 ) ) );
+      test.execute( ExpectNoSegment {} );
+
+      // SACKs for the rest of the flight reveal no further holes
+      test.execute( dup_ack( 10 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { seg( 2 ) }.with_win( 60000 ).with_sack( seg( 3 ), seg( 10 ) ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { seg( 10 ) }.with_win( 60000 ) );
+      test.execute( ExpectSeqnosInFlight { 0 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.fast_retransmit = true;
+      cfg.mss = 1000;
+      cfg.tso_size = 4000;
+
+      auto seg = [&]( uint64_t n ) { return isn + 1 + n * 1000; };
+
+      TCPSenderTestHarness test { "A TSO segment is retransmitted one MSS at a time", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 10000, 'x' ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 4000 ).with_seqno( seg( 0 ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 4000 ).with_seqno( seg( 4 ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 2000 ).with_seqno( seg( 8 ) ) );
+
+      // the device split them into ten segments on the wire; the first and the sixth were lost
+      test.execute( AckReceived { seg( 0 ) }.with_win( 60000 ).with_sack( seg( 1 ), seg( 3 ) ) );
+      test.execute( AckReceived { seg( 0 ) }.with_win( 60000 ).with_sack( seg( 1 ), seg( 4 ) ) );
+      test.execute( AckReceived { seg( 0 ) }.with_win( 60000 ).with_sack( seg( 1 ), seg( 5 ) ) );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( seg( 0 ) ) );
+      test.execute( ExpectNoSegment {} );
+      AckReceived both_holes { seg( 0 ) };
+      both_holes.with_win( 60000 ).with_sack( seg( 6 ), seg( 9 ) ).with_sack( seg( 1 ), seg( 5 ) );
+      test.execute( both_holes );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( seg( 5 ) ) );
+      test.execute( ExpectNoSegment {} );
+
+      // a timeout resends just the segment at the front too
+      test.execute( AckReceived { seg( 5 ) }.with_win( 60000 ).with_sack( seg( 6 ), seg( 9 ) ) );
+      test.execute( Tick { 10 * TCPConfig::TIMEOUT_DFLT } );
+      test.execute( ExpectMessage {}.with_payload_size( 1000 ).with_seqno( seg( 5 ) ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { seg( 10 ) }.with_win( 60000 ) );
+      test.execute( ExpectSeqnosInFlight { 0 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.congestion_control = CongestionControl::Algorithm::NewReno;
+
+      auto seg = [&]( uint64_t n ) { return isn + 1 + n * MSS; };
+
+      TCPSenderTestHarness test { "Partial ACKs without SACKed data above are not losses", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 60000 ) );
+      test.execute( Push( string( 8 * MSS, 'x' ) ) );
+      for ( int i = 0; i < 8; ++i ) {
+        test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( seg( i ) ) );
+      }
+
+      // segment 0 is lost, segments 1 to 3 arrive, the rest are still on their way
+      for ( uint64_t n = 2; n <= 4; ++n ) {
+        test.execute( AckReceived { seg( 0 ) }.with_win( 60000 ).with_sack( seg( 1 ), seg( n ) ) );
+      }
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_payload_size( MSS ).with_seqno( seg( 0 ) ) );
+      test.execute( ExpectNoSegment {} );
+
+      // NewReno would resend segment 4 here; the scoreboard shows nothing missing
+      test.execute( AckReceived { seg( 4 ) }.with_win( 60000 ) );
+      test.execute( Push {} );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { seg( 8 ) }.with_win( 60000 ) );
+      test.execute( ExpectSeqnosInFlight { 0 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      const uint16_t retx_timeout = uniform_int_distribution<uint16_t> { 10, 10000 }( rd );
+      cfg.isn = isn;
+      cfg.rt_timeout = retx_timeout;
+      cfg.go_back_n = true;
+
+      TCPSenderTestHarness test { "Go-back-N timeout skips SACKed segments", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 100 ) );
+      test.execute( Push( "aaaa" ) );
+      test.execute( Push( "bbbb" ) );
+      test.execute( Push( "cccc" ) );
+      test.execute( Push( "dddd" ) );
+      test.execute( ExpectMessage {}.with_data( "aaaa" ) );
+      test.execute( ExpectMessage {}.with_data( "bbbb" ) );
+      test.execute( ExpectMessage {}.with_data( "cccc" ) );
+      test.execute( ExpectMessage {}.with_data( "dddd" ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 100 ).with_sack( isn + 5, isn + 13 ) );
+      test.execute( Tick { retx_timeout } );
+      test.execute( ExpectMessage {}.with_data( "aaaa" ) );
+      test.execute( ExpectMessage {}.with_data( "dddd" ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      const uint16_t retx_timeout = uniform_int_distribution<uint16_t> { 10, 10000 }( rd );
+      cfg.isn = isn;
+      cfg.rt_timeout = retx_timeout;
+      cfg.go_back_n = true;
+
+      TCPSenderTestHarness test { "SACK blocks beyond what was sent are ignored", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_syn( true ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 100 ) );
+      test.execute( Push( "aaaa" ) );
+      test.execute( Push( "bbbb" ) );
+      test.execute( ExpectMessage {}.with_data( "aaaa" ) );
+      test.execute( ExpectMessage {}.with_data( "bbbb" ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 100 ).with_sack( isn + 5, isn + 13 ) );
+      test.execute( Tick { retx_timeout } );
+      test.execute( ExpectMessage {}.with_data( "aaaa" ) );
+      test.execute( ExpectMessage {}.with_data( "bbbb" ) );
+      test.execute( ExpectNoSegment {} );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
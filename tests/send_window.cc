@@ -140,6 +140,24 @@ int main()
       test.execute( ExpectMessage {}.with_fin( true ).with_data( "4567" ) );
       test.execute( ExpectNoSegment {} );
     }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+      cfg.send_capacity = 200'000;
+
+      TCPSenderTestHarness test { "Window larger than 65535 (scaled)", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 100'000 ) );
+      test.execute( Push { string( 150'000, 'x' ) } );
+      for ( unsigned int i = 0; i < 100; i++ ) {
+        test.execute( ExpectMessage {}.with_payload_size( TCPConfig::MAX_PAYLOAD_SIZE ) );
+      }
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectSeqnosInFlight { 100'000 } );
+    }
   } catch ( const exception& e ) {
     cerr << e.what() << endl;
     return 1;
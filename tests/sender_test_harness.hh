@@ -7,6 +7,7 @@
 #include "tcp_sender.hh"
 #include "wrapping_integers.hh"
 
+#include <algorithm>
 #include <optional>
 #include <queue>
 #include <sstream>
@@ -80,6 +81,48 @@ struct ExpectConsecutiveRetransmissions : public ExpectNumber<SenderAndOutput, u
   uint64_t value( SenderAndOutput& ss ) const override { return ss.sender.consecutive_retransmissions(); }
 };
 
+struct ExpectRTO : public ExpectNumber<SenderAndOutput, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "current_RTO_ms"; }
+  uint64_t value( SenderAndOutput& ss ) const override { return ss.sender.current_RTO_ms(); }
+};
+
+struct ExpectSmoothedRTT : public ExpectNumber<SenderAndOutput, double>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "smoothed_RTT_ms"; }
+  double value( SenderAndOutput& ss ) const override { return ss.sender.smoothed_RTT_ms(); }
+};
+
+struct ExpectCongestionWindow : public ExpectNumber<SenderAndOutput, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "congestion_window"; }
+  uint64_t value( SenderAndOutput& ss ) const override { return ss.sender.congestion_window(); }
+};
+
+struct ExpectMaxSegmentSize : public ExpectNumber<SenderAndOutput, uint64_t>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "max_segment_size"; }
+  uint64_t value( SenderAndOutput& ss ) const override { return ss.sender.max_segment_size(); }
+};
+
+struct ExpectPacingDelay : public ExpectNumber<SenderAndOutput, std::optional<uint64_t>>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "pacing_delay_ms"; }
+  std::optional<uint64_t> value( SenderAndOutput& ss ) const override { return ss.sender.pacing_delay_ms(); }
+};
+
+struct ExpectNextDeadline : public ExpectNumber<SenderAndOutput, std::optional<uint64_t>>
+{
+  using ExpectNumber::ExpectNumber;
+  std::string name() const override { return "next_deadline_ms"; }
+  std::optional<uint64_t> value( SenderAndOutput& ss ) const override { return ss.sender.next_deadline_ms(); }
+};
+
 struct ExpectNoSegment : public Expectation<SenderAndOutput>
 {
   std::string description() const override { return "nothing to send"; }
@@ -91,6 +134,22 @@ struct ExpectNoSegment : public Expectation<SenderAndOutput>
   }
 };
 
+struct PeerMSS : public Action<SenderAndOutput>
+{
+  uint16_t mss_;
+  explicit PeerMSS( uint16_t mss ) : mss_( mss ) {}
+  std::string description() const override { return "peer advertises MSS " + std::to_string( mss_ ); }
+  void execute( SenderAndOutput& ss ) const override { ss.sender.set_peer_mss( mss_ ); }
+};
+
+struct SetCork : public Action<SenderAndOutput>
+{
+  bool corked_;
+  explicit SetCork( bool corked ) : corked_( corked ) {}
+  std::string description() const override { return corked_ ? "cork" : "uncork"; }
+  void execute( SenderAndOutput& ss ) const override { ss.sender.set_cork( corked_ ); }
+};
+
 struct SetError : public Action<SenderAndOutput>
 {
   std::string description() const override { return "set_error"; }
@@ -187,27 +246,47 @@ struct Receive : public Action<SenderAndOutput>
 {
   TCPReceiverMessage msg_;
   bool push_ = true;
+  bool carries_data_ = false;
 
   explicit Receive( TCPReceiverMessage msg ) : msg_( msg ) {}
   std::string description() const override
   {
     std::ostringstream desc;
-    desc << "receive(ack=" << to_string( msg_.ackno ) << ", win=" << msg_.window_size << ")";
+    desc << "receive(ack=" << to_string( msg_.ackno ) << ", win=" << msg_.window_size;
+    if ( not msg_.sack.empty() ) {
+      desc << ", sack=" << to_string( msg_.sack );
+    }
+    desc << ")";
+    if ( carries_data_ ) {
+      desc << " on a segment carrying data";
+    }
     if ( push_ ) {
       desc << ", then push stream to TCPSender";
     }
     return desc.str();
   }
 
-  Receive& with_win( uint16_t win )
+  Receive& with_win( uint32_t win )
   {
     msg_.window_size = win;
     return *this;
   }
 
+  Receive& with_sack( Wrap32 begin, Wrap32 end )
+  {
+    msg_.sack.emplace_back( begin, end );
+    return *this;
+  }
+
+  Receive& with_data()
+  {
+    carries_data_ = true;
+    return *this;
+  }
+
   void execute( SenderAndOutput& ss ) const override
   {
-    ss.sender.receive( msg_ );
+    ss.sender.receive( msg_, carries_data_ );
     if ( push_ ) {
       ss.sender.push( ss.make_transmit() );
     }
@@ -340,7 +419,7 @@ struct ExpectMessage : public Expectation<SenderAndOutput>
     if ( payload_size.has_value() and seg.payload.size() != payload_size.value() ) {
       throw ExpectationViolation( "payload_size", payload_size.value(), seg.payload.size() );
     }
-    if ( seg.payload.size() > TCPConfig::MAX_PAYLOAD_SIZE ) {
+    if ( seg.payload.size() > std::max( ss.sender.max_send_size(), ss.sender.pmtu_probe_size() ) ) {
       throw ExpectationViolation( "payload has length (" + std::to_string( seg.payload.size() )
                                   + ") greater than the maximum" );
     }
@@ -359,6 +438,6 @@ public:
   TCPSenderTestHarness( std::string name, TCPConfig config )
     : TestHarness( move( name ),
                    "initial_RTO_ms=" + to_string( config.rt_timeout ),
-                   { TCPSender { ByteStream { config.send_capacity }, config.isn, config.rt_timeout } } )
+                   { TCPSender { ByteStream { config.send_capacity }, config } } )
   {}
 };
@@ -0,0 +1,77 @@
+#include "spsc_queue.hh"
+#include "test_should_be.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+int main()
+{
+  try {
+    // Capacity rounds up to a power of two; values come out in order, and a full queue refuses more
+    {
+      SPSCQueue<string> queue { 3 };
+      test_should_be( queue.capacity(), size_t { 4 } );
+      test_should_be( queue.empty(), true );
+      test_should_be( queue.pop().has_value(), false );
+
+      for ( int i = 0; i < 4; i++ ) {
+        test_should_be( queue.push( to_string( i ) ), true );
+      }
+      string extra = "extra";
+      test_should_be( queue.push( std::move( extra ) ), false );
+      test_should_be( extra == "extra", true ); // a refused value is left alone
+
+      test_should_be( queue.pop().value_or( "" ) == "0", true );
+      test_should_be( queue.push( "4" ), true ); // wraps around the ring
+      for ( int i = 1; i <= 4; i++ ) {
+        test_should_be( queue.pop().value_or( "" ) == to_string( i ), true );
+      }
+      test_should_be( queue.empty(), true );
+    }
+
+    // One producer and one consumer thread: everything arrives, once and in order
+    {
+      constexpr uint64_t N_VALUES = 200000;
+      SPSCQueue<uint64_t> queue { 64 };
+
+      thread producer( [&] {
+        for ( uint64_t i = 0; i < N_VALUES; ) {
+          uint64_t value = i;
+          if ( queue.push( std::move( value ) ) ) {
+            i++;
+          } else {
+            this_thread::yield();
+          }
+        }
+      } );
+
+      uint64_t expected = 0;
+      bool in_order = true;
+      while ( expected < N_VALUES ) {
+        if ( const auto value = queue.pop() ) {
+          in_order &= value.value() == expected;
+          expected++;
+        } else {
+          this_thread::yield();
+        }
+      }
+      producer.join();
+
+      test_should_be( in_order, true );
+      test_should_be( queue.empty(), true );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return EXIT_SUCCESS;
+}
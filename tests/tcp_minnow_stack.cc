@@ -0,0 +1,179 @@
+#include "address.hh"
+#include "exception.hh"
+#include "socket.hh"
+#include "tcp_config.hh"
+#include "tcp_minnow_stack.hh"
+#include "test_should_be.hh"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+string read_all( LocalStreamSocket& socket )
+{
+  string all;
+  while ( not socket.eof() ) {
+    string buf;
+    socket.read( buf );
+    all += buf;
+  }
+  return all;
+}
+
+// Two stacks joined by socket pairs that carry datagrams: one pair shared by all the shards, or (as with a
+// multi-queue device) one per shard, crossed so that most datagrams arrive on a shard that must forward them
+pair<unique_ptr<TCPMinnowStack>, unique_ptr<TCPMinnowStack>> make_stacks( size_t shards, bool queues )
+{
+  if ( not queues ) {
+    array<int, 2> fds {};
+    CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_SEQPACKET, 0, fds.data() ) );
+    return { make_unique<TCPMinnowStack>( FileDescriptor { fds[0] }, shards ),
+             make_unique<TCPMinnowStack>( FileDescriptor { fds[1] }, shards ) };
+  }
+
+  vector<array<int, 2>> pairs( shards );
+  for ( auto& fds : pairs ) {
+    CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_SEQPACKET, 0, fds.data() ) );
+  }
+  vector<FileDescriptor> a_queues;
+  vector<FileDescriptor> b_queues;
+  for ( size_t i = 0; i < shards; i++ ) {
+    a_queues.emplace_back( pairs.at( i )[0] );
+    b_queues.emplace_back( pairs.at( ( i + shards - 1 ) % shards )[1] );
+  }
+  return { make_unique<TCPMinnowStack>( std::move( a_queues ) ),
+           make_unique<TCPMinnowStack>( std::move( b_queues ) ) };
+}
+
+// Each stack connects to the other with the same four-tuple, so every connection is a simultaneous open
+void simultaneous_open( size_t shards, bool queues )
+{
+  constexpr size_t N_CONNECTIONS = 100;
+
+  auto stacks = make_stacks( shards, queues );
+  TCPMinnowStack& a = *stacks.first;
+  TCPMinnowStack& b = *stacks.second;
+
+  TCPConfig config;
+  config.rt_timeout = 10;
+
+  const string a_ip = "10.0.0.1";
+  const string b_ip = "10.0.0.2";
+  vector<LocalStreamSocket> a_sockets;
+  vector<LocalStreamSocket> b_sockets;
+  for ( uint16_t i = 0; i < N_CONNECTIONS; i++ ) {
+    const Address a_address { a_ip, static_cast<uint16_t>( 1000 + i ) };
+    const Address b_address { b_ip, static_cast<uint16_t>( 2000 + i % 3 ) }; // ports are shared across
+    a_sockets.push_back( a.connect( config, a_address, b_address ) );
+    b_sockets.push_back( b.connect( config, b_address, a_address ) );
+  }
+
+  // each side sends its own message on every connection, and gets the other side's on the same one
+  for ( size_t i = 0; i < N_CONNECTIONS; i++ ) {
+    a_sockets.at( i ).write( "from a to b #" + to_string( i ) + string( i * 5, 'x' ) );
+    a_sockets.at( i ).shutdown( SHUT_WR );
+    b_sockets.at( i ).write( "from b to a #" + to_string( i ) );
+    b_sockets.at( i ).shutdown( SHUT_WR );
+  }
+  for ( size_t i = 0; i < N_CONNECTIONS; i++ ) {
+    test_should_be( read_all( b_sockets.at( i ) ) == "from a to b #" + to_string( i ) + string( i * 5, 'x' ),
+                    true );
+    test_should_be( read_all( a_sockets.at( i ) ) == "from b to a #" + to_string( i ), true );
+  }
+
+  // once both sides have finished (and the lingering side has waited), every connection is removed
+  for ( int i = 0; i < 200 and a.connection_count() + b.connection_count() > 0; i++ ) {
+    this_thread::sleep_for( chrono::milliseconds( 10 ) );
+  }
+  test_should_be( a.connection_count(), size_t { 0 } );
+  test_should_be( b.connection_count(), size_t { 0 } );
+}
+
+// A listener hands each client its own connection, and holds no more than its backlog allows
+void listen_and_accept( size_t shards, bool queues )
+{
+  constexpr size_t N_CLIENTS = 20;
+  constexpr size_t BACKLOG = 4;
+
+  auto stacks = make_stacks( shards, queues );
+  TCPMinnowStack& client = *stacks.first;
+  TCPMinnowStack& server = *stacks.second;
+
+  TCPConfig config;
+  config.rt_timeout = 10;
+
+  const Address server_address { "10.0.0.2", 80 };
+  server.listen( config, Address { "0", 80 }, BACKLOG );
+
+  vector<LocalStreamSocket> clients;
+  for ( uint16_t i = 0; i < N_CLIENTS; i++ ) {
+    const Address client_address { "10.0.0.1", static_cast<uint16_t>( 5000 + i ) };
+    clients.push_back( client.connect( config, client_address, server_address ) );
+    clients.back().write( "request " + to_string( i ) );
+    clients.back().shutdown( SHUT_WR );
+  }
+
+  // nothing is accepted yet, so the server holds at most a full SYN queue and a full accept queue
+  this_thread::sleep_for( chrono::milliseconds( 50 ) );
+  test_should_be( server.connection_count() <= 2 * BACKLOG, true );
+
+  // the rest get in as the accept queue drains
+  vector<bool> seen( N_CLIENTS );
+  for ( size_t n = 0; n < N_CLIENTS; n++ ) {
+    auto [socket, peer] = server.accept( Address { "0", 80 } );
+    test_should_be( peer.ip() == "10.0.0.1", true );
+    const size_t i = peer.port() - 5000;
+    test_should_be( read_all( socket ) == "request " + to_string( i ), true );
+    socket.write( "response " + to_string( i ) );
+    socket.shutdown( SHUT_WR );
+    seen.at( i ) = true;
+  }
+  for ( size_t i = 0; i < N_CLIENTS; i++ ) {
+    test_should_be( static_cast<bool>( seen.at( i ) ), true );
+    test_should_be( read_all( clients.at( i ) ) == "response " + to_string( i ), true );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    // the verification suite from Microsoft's RSS specification (IPv4 with TCP)
+    test_should_be( TCPMinnowStack::flow_hash( { .local_ip = Address { "161.142.100.80" }.ipv4_numeric(),
+                                                 .local_port = 1766,
+                                                 .remote_ip = Address { "66.9.149.187" }.ipv4_numeric(),
+                                                 .remote_port = 2794 } ),
+                    uint32_t { 0x51ccc178 } );
+    test_should_be( TCPMinnowStack::flow_hash( { .local_ip = Address { "65.69.140.83" }.ipv4_numeric(),
+                                                 .local_port = 4739,
+                                                 .remote_ip = Address { "199.92.111.2" }.ipv4_numeric(),
+                                                 .remote_port = 14230 } ),
+                    uint32_t { 0xc626b0ea } );
+
+    // one thread for everything, then four shards with an I/O thread, then four shards with a queue each
+    const vector<pair<size_t, bool>> setups { { 1, false }, { 4, false }, { 4, true } };
+    for ( const auto& [shards, queues] : setups ) {
+      simultaneous_open( shards, queues );
+      listen_and_accept( shards, queues );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return EXIT_SUCCESS;
+}
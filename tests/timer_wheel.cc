@@ -0,0 +1,141 @@
+#include "random.hh"
+#include "test_should_be.hh"
+#include "timer_wheel.hh"
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main()
+{
+  try {
+    // A single timer fires exactly at its deadline, and only once
+    {
+      TimerWheel wheel;
+      wheel.schedule( 7, 5 );
+      test_should_be( wheel.size(), size_t { 1 } );
+      test_should_be( wheel.next_expiry().value_or( 0 ), uint64_t { 5 } );
+      test_should_be( wheel.expire( 4 ).size(), size_t { 0 } );
+      const auto fired = wheel.expire( 5 );
+      test_should_be( fired.size(), size_t { 1 } );
+      test_should_be( fired.at( 0 ), uint64_t { 7 } );
+      test_should_be( wheel.size(), size_t { 0 } );
+      test_should_be( wheel.next_expiry().has_value(), false );
+      test_should_be( wheel.expire( 100 ).size(), size_t { 0 } );
+    }
+
+    // Rescheduling replaces the old deadline; cancelling removes it
+    {
+      TimerWheel wheel;
+      wheel.schedule( 1, 1000 );
+      wheel.schedule( 1, 10 );
+      wheel.schedule( 2, 20 );
+      wheel.cancel( 2 );
+      wheel.cancel( 3 );
+      test_should_be( wheel.size(), size_t { 1 } );
+      test_should_be( wheel.next_expiry().value_or( 0 ), uint64_t { 10 } );
+      test_should_be( wheel.expire( 10 ).size(), size_t { 1 } );
+      test_should_be( wheel.expire( 2000 ).size(), size_t { 0 } );
+    }
+
+    // Far deadlines cascade down through the levels without firing early, and a long jump fires
+    // everything that was passed over, earliest first
+    {
+      TimerWheel wheel { 123 };
+      wheel.schedule( 1, 123 + 70 );
+      wheel.schedule( 2, 123 + 5000 );
+      wheel.schedule( 3, 123 + 300000 );
+      wheel.schedule( 4, 123 + 40000000 ); // beyond the top level
+      test_should_be( wheel.next_expiry().value_or( 0 ), uint64_t { 123 + 70 } );
+      test_should_be( wheel.expire( 123 + 69 ).size(), size_t { 0 } );
+      test_should_be( wheel.expire( 123 + 4999 ).size(), size_t { 1 } );
+      test_should_be( wheel.next_expiry().value_or( 0 ), uint64_t { 123 + 5000 } );
+      test_should_be( wheel.expire( 123 + 299999 ).size(), size_t { 1 } );
+      test_should_be( wheel.next_expiry().value_or( 0 ), uint64_t { 123 + 300000 } );
+      wheel.schedule( 5, 123 + 300001 );
+      const auto fired = wheel.expire( 123 + 50000000 );
+      test_should_be( fired.size(), size_t { 3 } );
+      test_should_be( fired.at( 0 ), uint64_t { 3 } );
+      test_should_be( fired.at( 1 ), uint64_t { 5 } );
+      test_should_be( fired.at( 2 ), uint64_t { 4 } );
+    }
+
+    // A deadline that has already passed fires on the next expire(), even without advancing the clock
+    {
+      TimerWheel wheel { 50 };
+      wheel.schedule( 9, 10 );
+      test_should_be( wheel.next_expiry().value_or( 0 ), uint64_t { 50 } );
+      test_should_be( wheel.expire( 50 ).size(), size_t { 1 } );
+    }
+
+    // Compare against a simple ordered map under random schedules, cancels, and clock jumps
+    {
+      constexpr size_t N_REPS = 20000;
+      constexpr uint64_t N_KEYS = 64;
+
+      auto rd = get_random_engine();
+      TimerWheel wheel { 1000 };
+      map<uint64_t, uint64_t> deadlines; // key -> deadline
+      uint64_t now = 1000;
+
+      for ( size_t i = 0; i < N_REPS; i++ ) {
+        const uint64_t key = rd() % N_KEYS;
+        switch ( rd() % 4 ) {
+          case 0:
+          case 1: {
+            // mostly near deadlines, sometimes far ones
+            const uint64_t range = rd() % 8 == 0 ? 1000000 : 200;
+            const uint64_t deadline = now + rd() % range;
+            wheel.schedule( key, deadline );
+            deadlines[key] = deadline;
+            break;
+          }
+          case 2:
+            wheel.cancel( key );
+            deadlines.erase( key );
+            break;
+          default: {
+            now += rd() % 8 == 0 ? rd() % 100000 : rd() % 50;
+            set<uint64_t> expected;
+            for ( auto it = deadlines.begin(); it != deadlines.end(); ) {
+              if ( it->second <= now ) {
+                expected.insert( it->first );
+                it = deadlines.erase( it );
+              } else {
+                ++it;
+              }
+            }
+            const auto fired = wheel.expire( now );
+            test_should_be( fired.size(), expected.size() );
+            for ( const auto k : fired ) {
+              test_should_be( expected.contains( k ), true );
+            }
+          }
+        }
+
+        optional<uint64_t> earliest;
+        for ( const auto& [k, deadline] : deadlines ) {
+          earliest = min( earliest.value_or( deadline ), deadline );
+        }
+        test_should_be( wheel.size(), deadlines.size() );
+        test_should_be( wheel.next_expiry().has_value(), earliest.has_value() );
+        if ( earliest.has_value() ) {
+          test_should_be( max( wheel.next_expiry().value(), now ), max( earliest.value(), now ) );
+        }
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return EXIT_SUCCESS;
+}
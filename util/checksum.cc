@@ -0,0 +1,150 @@
+#include "checksum.hh"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+
+#if defined( __x86_64__ )
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// Each kernel returns the sum (not yet folded) of the native-endian 16-bit words in `data`, a last odd byte
+// being the first byte of a word whose second is zero. The one's complement sum doesn't depend on the order the
+// words are added in, and swapping the bytes of the folded sum gives the sum of the big-endian words (RFC 1071).
+using Kernel = uint64_t ( * )( const char* data, size_t len );
+
+// Pairs of words at a time; the sum can't overflow before 16 GiB
+uint64_t sum_words( const char* data, size_t len )
+{
+  uint64_t sum = 0;
+  for ( ; len >= sizeof( uint64_t ); data += sizeof( uint64_t ), len -= sizeof( uint64_t ) ) {
+    uint64_t word {};
+    memcpy( &word, data, sizeof( word ) );
+    sum += ( word & 0xffff'ffff ) + ( word >> 32 );
+  }
+  uint64_t tail {};
+  memcpy( &tail, data, len );
+  return sum + ( tail & 0xffff'ffff ) + ( tail >> 32 );
+}
+
+#if defined( __x86_64__ )
+
+// Blocks summed into the 32-bit vector lanes before they are flushed: each block adds at most 2 * 0xffff
+// to a lane
+constexpr size_t MAX_BLOCKS = size_t { 1 } << 14;
+
+__attribute__( ( target( "sse2" ) ) ) uint64_t sum_words_sse2( const char* data, size_t len )
+{
+  constexpr size_t BLOCK = sizeof( __m128i );
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t sum = 0;
+  while ( len >= BLOCK ) {
+    const size_t blocks = min( len / BLOCK, MAX_BLOCKS );
+    __m128i acc = zero;
+    for ( size_t i = 0; i < blocks; i++, data += BLOCK ) {
+      const auto* block = reinterpret_cast<const __m128i*>( data ); // NOLINT(*-reinterpret-cast)
+      const __m128i v = _mm_loadu_si128( block );
+      acc = _mm_add_epi32( acc, _mm_unpacklo_epi16( v, zero ) );
+      acc = _mm_add_epi32( acc, _mm_unpackhi_epi16( v, zero ) );
+    }
+    len -= blocks * BLOCK;
+
+    array<uint32_t, BLOCK / sizeof( uint32_t )> lanes {};
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes.data() ), acc ); // NOLINT(*-reinterpret-cast)
+    for ( const uint32_t lane : lanes ) {
+      sum += lane;
+    }
+  }
+  return sum + sum_words( data, len );
+}
+
+__attribute__( ( target( "avx2" ) ) ) uint64_t sum_words_avx2( const char* data, size_t len )
+{
+  constexpr size_t BLOCK = sizeof( __m256i );
+  const __m256i zero = _mm256_setzero_si256();
+  uint64_t sum = 0;
+  while ( len >= BLOCK ) {
+    const size_t blocks = min( len / BLOCK, MAX_BLOCKS );
+    __m256i acc = zero;
+    for ( size_t i = 0; i < blocks; i++, data += BLOCK ) {
+      const auto* block = reinterpret_cast<const __m256i*>( data ); // NOLINT(*-reinterpret-cast)
+      const __m256i v = _mm256_loadu_si256( block );
+      acc = _mm256_add_epi32( acc, _mm256_unpacklo_epi16( v, zero ) );
+      acc = _mm256_add_epi32( acc, _mm256_unpackhi_epi16( v, zero ) );
+    }
+    len -= blocks * BLOCK;
+
+    array<uint32_t, BLOCK / sizeof( uint32_t )> lanes {};
+    _mm256_storeu_si256( reinterpret_cast<__m256i*>( lanes.data() ), acc ); // NOLINT(*-reinterpret-cast)
+    for ( const uint32_t lane : lanes ) {
+      sum += lane;
+    }
+  }
+  return sum + sum_words( data, len );
+}
+
+#endif
+
+Kernel choose_kernel()
+{
+#if defined( __x86_64__ )
+  __builtin_cpu_init(); // in case this runs before the static constructors that would do it
+  if ( __builtin_cpu_supports( "avx2" ) ) {
+    return sum_words_avx2;
+  }
+  if ( __builtin_cpu_supports( "sse2" ) ) {
+    return sum_words_sse2;
+  }
+#endif
+  return sum_words;
+}
+
+Kernel kernel()
+{
+  static const Kernel chosen = choose_kernel();
+  return chosen;
+}
+
+} // namespace
+
+void InternetChecksum::add( string_view data )
+{
+  if ( data.empty() ) {
+    return;
+  }
+
+  // finish the word that the last piece left halfway
+  if ( parity_ ) {
+    sum_ += static_cast<uint8_t>( data.front() );
+    data.remove_prefix( 1 );
+  }
+
+  uint64_t sum = kernel()( data.data(), data.size() );
+  while ( sum > 0xffff ) {
+    sum = ( sum >> 16 ) + static_cast<uint16_t>( sum );
+  }
+  if constexpr ( endian::native == endian::little ) {
+    sum = static_cast<uint16_t>( sum << 8 | sum >> 8 );
+  }
+  sum_ += sum;
+  parity_ = data.size() % 2;
+}
+
+string_view InternetChecksum::implementation()
+{
+#if defined( __x86_64__ )
+  if ( kernel() == sum_words_avx2 ) {
+    return "avx2";
+  }
+  if ( kernel() == sum_words_sse2 ) {
+    return "sse2";
+  }
+#endif
+  return "64-bit";
+}
@@ -2,32 +2,27 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 //! The internet checksum algorithm
+//! \details The data is summed as big-endian 16-bit words, in pieces that may have any length and alignment:
+//! a piece that ends halfway through a word is continued by the next. The bulk of each piece is summed by the
+//! widest kernel the CPU supports (AVX2 or SSE2 on x86-64, else 64-bit words), chosen once at run time.
 class InternetChecksum
 {
 private:
-  uint32_t sum_;
-  bool parity_ {};
+  uint64_t sum_;
+  bool parity_ {}; //!< Has an odd number of bytes been added, so the next one is the low byte of a word?
 
 public:
   explicit InternetChecksum( const uint32_t sum = 0 ) : sum_( sum ) {}
-  void add( std::string_view data )
-  {
-    for ( const uint8_t i : data ) {
-      uint16_t val = i;
-      if ( not parity_ ) {
-        val <<= 8;
-      }
-      sum_ += val;
-      parity_ = !parity_;
-    }
-  }
+
+  void add( std::string_view data );
 
   uint16_t value() const
   {
-    uint32_t ret = sum_;
+    uint64_t ret = sum_;
 
     while ( ret > 0xffff ) {
       ret = ( ret >> 16 ) + static_cast<uint16_t>( ret );
@@ -49,4 +44,7 @@ public:
       add( x );
     }
   }
+
+  //! Name of the kernel in use ("avx2", "sse2" or "64-bit")
+  static std::string_view implementation();
 };
@@ -1,7 +1,9 @@
 #include "eventloop.hh"
 #include "exception.hh"
+#include "io_uring.hh"
 #include "socket.hh"
 
+#include <algorithm>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
@@ -13,6 +15,15 @@ unsigned int EventLoop::FDRule::service_count() const
   return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+EventLoop::EventLoop( const Backend backend, const InterestUpdates updates )
+  : _backend( backend ), _interest_updates( updates )
+{
+  _rule_categories.reserve( 64 );
+  if ( _backend == Backend::Epoll ) {
+    _epoll.emplace( CheckSystemCall( "epoll_create1", ::epoll_create1( EPOLL_CLOEXEC ) ) );
+  }
+}
+
 size_t EventLoop::add_category( const string& name )
 {
   if ( _rule_categories.size() >= _rule_categories.capacity() ) {
@@ -31,17 +42,20 @@ EventLoop::FDRule::FDRule( BasicRule&& base,
                            FileDescriptor&& s_fd,
                            Direction s_direction,
                            CallbackT s_cancel,
-                           CallbackT s_error )
+                           CallbackT s_error,
+                           Trigger s_trigger )
   : BasicRule( base )
   , fd( move( s_fd ) )
   , direction( s_direction )
   , cancel( move( s_cancel ) )
   , error( move( s_error ) )
+  , trigger( s_trigger )
 {}
 
 EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
                                            FileDescriptor& fd,
                                            Direction direction,
+                                           Trigger trigger,
                                            const CallbackT& callback,
                                            const InterestT& interest,
                                            const CallbackT& cancel, // NOLINT(*-easily-swappable-*)
@@ -51,10 +65,47 @@ EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
     throw out_of_range( "bad category_id" );
   }
 
-  _fd_rules.emplace_back( make_shared<FDRule>(
-    BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, error ) );
+  auto rule = make_shared<FDRule>(
+    BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, error, trigger );
+
+  if ( _backend == Backend::Epoll ) {
+    // Register every fd right away, with no events: epoll still reports errors and hangups.
+    auto [reg, inserted] = _registrations.try_emplace( fd.fd_num() );
+    if ( not inserted
+         and ranges::all_of( reg->second.rules, []( const auto& x ) { return x->fd.closed(); } ) ) {
+      // The fd number was closed and reused before the next wait cleaned up its rules. Closing the old fd took it
+      // out of the epoll set, so start over; the stale rules are dropped on the next wait as usual.
+      for ( const auto& x : reg->second.rules ) {
+        _mark_stale( x );
+      }
+      reg->second = {};
+      inserted = true;
+    }
+    if ( inserted ) {
+      epoll_event ev { trigger == Trigger::Edge ? static_cast<uint32_t>( EPOLLET ) : 0, { .fd = fd.fd_num() } };
+      CheckSystemCall( "epoll_ctl", ::epoll_ctl( _epoll->fd_num(), EPOLL_CTL_ADD, fd.fd_num(), &ev ) );
+      reg->second.events = ev.events;
+    } else if ( reg->second.rules.front()->trigger != trigger ) {
+      throw runtime_error( "EventLoop: rules on the same fd must all be level- or all edge-triggered" );
+    }
+    reg->second.rules.push_back( rule );
+  }
+
+  _fd_rules.push_back( move( rule ) );
+  _fd_rules.back()->position = prev( _fd_rules.end() );
+  _mark_stale( _fd_rules.back() );
+  return RuleHandle { *this, _fd_rules.back() };
+}
 
-  return RuleHandle { _fd_rules.back() };
+EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
+                                           FileDescriptor& fd,
+                                           Direction direction,
+                                           const CallbackT& callback,
+                                           const InterestT& interest,
+                                           const CallbackT& cancel, // NOLINT(*-easily-swappable-*)
+                                           const CallbackT& error )
+{
+  return add_rule( category_id, fd, direction, Trigger::Level, callback, interest, cancel, error );
 }
 
 EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
@@ -67,7 +118,13 @@ EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
 
   _non_fd_rules.emplace_back( make_shared<BasicRule>( category_id, interest, callback ) );
 
-  return RuleHandle { _non_fd_rules.back() };
+  return RuleHandle { *this, _non_fd_rules.back() };
+}
+
+EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id, IoUring& ring, const InterestT& interest )
+{
+  _rings.push_back( &ring );
+  return add_rule( category_id, ring.completion_fd(), Direction::In, [&ring] { ring.reap(); }, interest );
 }
 
 void EventLoop::RuleHandle::cancel()
@@ -75,45 +132,153 @@ void EventLoop::RuleHandle::cancel()
   const shared_ptr<BasicRule> rule_shared_ptr = rule_weak_ptr_.lock();
   if ( rule_shared_ptr ) {
     rule_shared_ptr->cancel_requested = true;
+    update_interest(); // so that a loop with on-demand updates drops it
   }
 }
 
-// NOLINTBEGIN(*-cognitive-complexity)
-// NOLINTBEGIN(*-signed-bitwise)
-EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
+void EventLoop::RuleHandle::update_interest()
 {
-  // first, handle the non-file-descriptor-related rules
-  {
-    for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
-      auto& this_rule = **it;
-      bool rule_fired = false;
+  if ( const auto rule = fd_rule_weak_ptr_.lock() ) {
+    loop_.get()._mark_stale( rule );
+  }
+}
 
-      if ( this_rule.cancel_requested ) {
-        it = _non_fd_rules.erase( it );
-        continue;
-      }
+void EventLoop::_mark_stale( const shared_ptr<FDRule>& rule )
+{
+  if ( _backend == Backend::Epoll and _interest_updates == InterestUpdates::OnDemand and not rule->stale ) {
+    rule->stale = true;
+    _stale_rules.push_back( rule );
+  }
+}
 
-      uint8_t iterations = 0;
-      while ( this_rule.interest() ) {
-        if ( iterations++ >= 128 ) {
-          throw runtime_error( "EventLoop: busy wait detected: rule \""
-                               + _rule_categories.at( this_rule.category_id ).name + "\" is still interested after "
-                               + to_string( iterations ) + " iterations" );
-        }
+void EventLoop::_unregister( const FDRule& rule )
+{
+  if ( _backend != Backend::Epoll ) {
+    return;
+  }
+  const auto reg = _registrations.find( rule.fd.fd_num() );
+  if ( reg == _registrations.end() ) {
+    return;
+  }
+  auto& rules = reg->second.rules;
+  if ( erase_if( rules, [&]( const auto& x ) { return x.get() == &rule; } ) == 0 ) {
+    return; // the rule's fd was closed and its number now belongs to a newer registration
+  }
+  if ( rules.empty() ) {
+    // a closed fd has already left the epoll set
+    if ( not rule.fd.closed() ) {
+      CheckSystemCall( "epoll_ctl", ::epoll_ctl( _epoll->fd_num(), EPOLL_CTL_DEL, rule.fd.fd_num(), nullptr ) );
+    }
+    _registrations.erase( reg );
+  } else if ( not reg->second.dirty ) {
+    reg->second.dirty = true;
+    _dirty_fds.push_back( reg->first );
+  }
+}
 
-        rule_fired = true;
-        this_rule.callback();
+bool EventLoop::_refresh( FDRule& rule )
+{
+  if ( rule.cancel_requested ) {
+    // cancelled by its owner (no callback, as with the poll backend), or after an error or hangup
+  } else if ( ( rule.direction == Direction::In && rule.fd.eof() ) or rule.fd.closed() ) {
+    rule.cancel();
+  } else {
+    const bool interested = rule.interest();
+    if ( interested != rule.interested ) {
+      rule.interested = interested;
+      if ( interested ) {
+        _interested_rules++;
+      } else {
+        _interested_rules--;
+      }
+      auto& reg = _registrations.at( rule.fd.fd_num() );
+      if ( not reg.dirty ) {
+        reg.dirty = true;
+        _dirty_fds.push_back( rule.fd.fd_num() );
       }
+    }
+    return true;
+  }
+
+  if ( rule.interested ) {
+    rule.interested = false;
+    _interested_rules--;
+  }
+  _unregister( rule );
+  rule.stale = true; // never queued again
+  return false;
+}
+
+void EventLoop::_report_error( const FDRule& rule ) const
+{
+  /* see if fd is a socket */
+  int socket_error = 0;
+  socklen_t optlen = sizeof( socket_error );
+  const int ret = getsockopt( rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
+  if ( ret == -1 and errno == ENOTSOCK ) {
+    cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( rule.category_id ).name << "\"\n";
+  } else if ( ret == -1 ) {
+    throw unix_error( "getsockopt" );
+  } else if ( optlen != sizeof( socket_error ) ) {
+    throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
+  } else if ( socket_error ) {
+    cerr << "error on polled socket for rule \"" << _rule_categories.at( rule.category_id ).name
+         << "\": " << strerror( socket_error ) << "\n";
+  }
+}
+
+bool EventLoop::_serve_non_fd_rules()
+{
+  for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
+    auto& this_rule = **it;
+    bool rule_fired = false;
 
-      if ( rule_fired ) {
-        return Result::Success; /* only serve one rule on each iteration */
+    if ( this_rule.cancel_requested ) {
+      it = _non_fd_rules.erase( it );
+      continue;
+    }
+
+    uint8_t iterations = 0;
+    while ( this_rule.interest() ) {
+      if ( iterations++ >= 128 ) {
+        throw runtime_error( "EventLoop: busy wait detected: rule \""
+                             + _rule_categories.at( this_rule.category_id ).name + "\" is still interested after "
+                             + to_string( iterations ) + " iterations" );
       }
 
-      ++it;
+      rule_fired = true;
+      this_rule.callback();
+    }
+
+    if ( rule_fired ) {
+      return true; /* only serve one rule on each iteration */
     }
+
+    ++it;
+  }
+  return false;
+}
+
+EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
+{
+  // first, handle the non-file-descriptor-related rules
+  if ( _serve_non_fd_rules() ) {
+    return Result::Success;
   }
 
-  // now the file-descriptor-related rules. poll any "interested" file descriptors
+  // hand the kernel every I/O request queued since the last wait, in one system call per ring
+  for ( auto* ring : _rings ) {
+    ring->submit();
+  }
+
+  return _backend == Backend::Epoll ? _wait_epoll( timeout_ms ) : _wait_poll( timeout_ms );
+}
+
+// NOLINTBEGIN(*-cognitive-complexity)
+// NOLINTBEGIN(*-signed-bitwise)
+EventLoop::Result EventLoop::_wait_poll( const int timeout_ms )
+{
+  // poll any "interested" file descriptors
   vector<pollfd> pollfds {};
   pollfds.reserve( _fd_rules.size() );
   bool something_to_poll = false;
@@ -158,9 +323,11 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
   }
 
   // call poll -- wait until one of the fds satisfies one of the rules (writeable/readable)
-  if ( 0 == CheckSystemCall( "poll", ::poll( pollfds.data(), pollfds.size(), timeout_ms ) ) ) {
-    return Result::Timeout;
+  const int num_ready = ::poll( pollfds.data(), pollfds.size(), timeout_ms );
+  if ( num_ready == 0 or ( num_ready < 0 and errno == EINTR ) ) {
+    return Result::Timeout; // a signal counts as a timeout: nothing was triggered
   }
+  CheckSystemCall( "poll", num_ready );
 
   // go through the poll results
   for ( auto [it, idx] = make_pair( _fd_rules.begin(), static_cast<size_t>( 0 ) ); it != _fd_rules.end(); ++idx ) {
@@ -169,22 +336,7 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
 
     const auto poll_error = static_cast<bool>( this_pollfd.revents & ( POLLERR | POLLNVAL ) );
     if ( poll_error ) {
-      /* see if fd is a socket */
-      int socket_error = 0;
-      socklen_t optlen = sizeof( socket_error );
-      const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
-      if ( ret == -1 and errno == ENOTSOCK ) {
-        cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\"\n";
-      } else if ( ret == -1 ) {
-        throw unix_error( "getsockopt" );
-      } else if ( optlen != sizeof( socket_error ) ) {
-        throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
-      } else if ( socket_error ) {
-        cerr << "error on polled socket for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\": " << strerror( socket_error ) << "\n";
-      }
-
+      _report_error( this_rule );
       this_rule.error();
       this_rule.cancel();
       it = _fd_rules.erase( it );
@@ -222,5 +374,115 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
 
   return Result::Success;
 }
+
+EventLoop::Result EventLoop::_wait_epoll( const int timeout_ms )
+{
+  // Bring the registrations up to date: only fds where a rule's interest changed need an epoll_ctl() call.
+  if ( _interest_updates == InterestUpdates::EveryWait ) {
+    for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) {
+      it = _refresh( **it ) ? next( it ) : _fd_rules.erase( it );
+    }
+  } else {
+    // a cancellation callback may change other rules' interest, and queue them again
+    while ( not _stale_rules.empty() ) {
+      swap( _checking, _stale_rules );
+      for ( const auto& rule : _checking ) {
+        if ( _refresh( *rule ) ) {
+          rule->stale = false;
+        } else {
+          _fd_rules.erase( rule->position );
+        }
+      }
+      _checking.clear();
+    }
+  }
+
+  for ( const int fd_num : _dirty_fds ) {
+    const auto reg = _registrations.find( fd_num );
+    if ( reg == _registrations.end() ) {
+      continue;
+    }
+    reg->second.dirty = false;
+    uint32_t events = reg->second.events & EPOLLET;
+    for ( const auto& rule : reg->second.rules ) {
+      events |= rule->interested ? static_cast<uint32_t>( rule->direction ) : 0;
+    }
+    if ( events != reg->second.events ) {
+      epoll_event ev { events, { .fd = fd_num } };
+      CheckSystemCall( "epoll_ctl", ::epoll_ctl( _epoll->fd_num(), EPOLL_CTL_MOD, fd_num, &ev ) );
+      reg->second.events = events;
+    }
+  }
+  _dirty_fds.clear();
+
+  // quit if there is nothing left to poll
+  if ( _interested_rules == 0 ) {
+    return Result::Exit;
+  }
+
+  _ready.resize( clamp<size_t>( _registrations.size(), 1, 1024 ) );
+  const int num_ready
+    = ::epoll_wait( _epoll->fd_num(), _ready.data(), static_cast<int>( _ready.size() ), timeout_ms );
+  if ( num_ready == 0 or ( num_ready < 0 and errno == EINTR ) ) {
+    return Result::Timeout;
+  }
+  CheckSystemCall( "epoll_wait", num_ready );
+
+  // dispatch every ready fd, with the same error and hangup handling as the poll backend
+  for ( int i = 0; i < num_ready; i++ ) {
+    const epoll_event event = _ready.at( i );
+    const auto reg = _registrations.find( event.data.fd );
+    if ( reg == _registrations.end() ) {
+      continue;
+    }
+
+    // callbacks may add rules to the registration (which wait for the next event), but only _refresh() removes any
+    auto& rules = reg->second.rules;
+    const size_t count = rules.size();
+    for ( size_t j = 0; j < min( count, rules.size() ); j++ ) {
+      auto& this_rule = *rules[j];
+      if ( this_rule.cancel_requested or this_rule.fd.closed() ) {
+        continue;
+      }
+
+      if ( event.events & EPOLLERR ) {
+        _report_error( this_rule );
+        this_rule.error();
+        this_rule.cancel();
+        this_rule.cancel_requested = true; // erased (without calling cancel again) on the next call
+        continue;
+      }
+
+      const uint32_t wanted = this_rule.interested ? static_cast<uint32_t>( this_rule.direction ) : 0;
+      const auto ready = static_cast<bool>( event.events & wanted );
+      const auto hup = static_cast<bool>( event.events & EPOLLHUP );
+      if ( hup && ( ( wanted && !ready ) or ( this_rule.direction == Direction::Out ) ) ) {
+        this_rule.cancel();
+        this_rule.cancel_requested = true;
+        continue;
+      }
+
+      // an earlier callback in this batch may have taken away the rule's interest
+      if ( ready and this_rule.interest() ) {
+        const auto count_before = this_rule.service_count();
+        this_rule.callback();
+
+        if ( this_rule.trigger == Trigger::Level and count_before == this_rule.service_count()
+             and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
+          throw runtime_error( "EventLoop: busy wait detected: rule \""
+                               + _rule_categories.at( this_rule.category_id ).name
+                               + "\" did not read/write fd and is still interested" );
+        }
+      }
+    }
+
+    // the callbacks may have changed the interest of the fd's rules
+    for ( const auto& rule : rules ) {
+      _mark_stale( rule );
+    }
+  }
+
+  return Result::Success;
+}
 // NOLINTEND(*-signed-bitwise)
 // NOLINTEND(*-cognitive-complexity)
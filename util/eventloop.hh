@@ -3,12 +3,19 @@
 #include <functional>
 #include <list>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <poll.h>
 #include <string_view>
+#include <sys/epoll.h>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include "file_descriptor.hh"
 
+class IoUring;
+
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop
 {
@@ -20,6 +27,36 @@ public:
     Out = POLLOUT //!< Callback will be triggered when Rule::fd is writable.
   };
 
+  //! How the kernel is asked to wait for events.
+  enum class Backend
+  {
+    Poll, //!< Rebuild a [poll(2)](\ref man2::poll) set on every call; works with any fd, including regular files.
+    Epoll //!< Keep fds registered with [epoll(7)](\ref man7::epoll) and only visit the ones that are ready.
+  };
+
+  //! When an epoll rule is triggered (the poll backend is always level-triggered).
+  enum class Trigger
+  {
+    Level, //!< Whenever the fd is ready and the rule is interested.
+    Edge   //!< Only when the fd becomes ready (or interest is regained); the callback should drain the fd.
+  };
+
+  //! Which rules the epoll backend asks for their interest() before each wait (the poll backend asks them all).
+  enum class InterestUpdates
+  {
+    EveryWait, //!< Every rule, so interest() may depend on anything.
+    OnDemand   //!< Only new rules, rules whose fd was just ready, and rules passed to RuleHandle::update_interest
+  };
+
+  //! Returned by each call to EventLoop::wait_next_event.
+  enum class Result
+  {
+    Success, //!< At least one Rule was triggered.
+    Timeout, //!< No rules were triggered before timeout.
+    Exit     //!< All rules have been canceled or were uninterested; make no further calls to
+             //!< EventLoop::wait_next_event.
+  };
+
 private:
   using CallbackT = std::function<void( void )>;
   using InterestT = std::function<bool( void )>;
@@ -45,48 +82,101 @@ private:
     Direction direction; //!< Direction::In for reading from fd, Direction::Out for writing to fd.
     CallbackT cancel;    //!< A callback that is called when the rule is cancelled (e.g. on EOF or hangup)
     CallbackT error;     //!< A callback that is called when the fd has an error before cancellation
-
-    FDRule( BasicRule&& base, FileDescriptor&& s_fd, Direction s_direction, CallbackT s_cancel, CallbackT s_error );
+    Trigger trigger;     //!< Level- or edge-triggered (epoll backend only).
+    bool interested {};  //!< Result of interest() when it was last checked.
+    bool stale {};       //!< Queued in _stale_rules, or removed from the loop (on-demand updates only).
+    std::list<std::shared_ptr<FDRule>>::iterator position {}; //!< The rule's place in _fd_rules.
+
+    FDRule( BasicRule&& base,
+            FileDescriptor&& s_fd,
+            Direction s_direction,
+            CallbackT s_cancel,
+            CallbackT s_error,
+            Trigger s_trigger );
 
     //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
     //! \details This function is used internally by EventLoop; you will not need to call it
     unsigned int service_count() const;
   };
 
+  //! All the rules watching one fd, which epoll can only register once.
+  struct Registration
+  {
+    uint32_t events {}; //!< Events currently registered with epoll.
+    bool dirty {};      //!< A rule's interest changed since `events` was last updated.
+    std::vector<std::shared_ptr<FDRule>> rules {};
+  };
+
   std::vector<RuleCategory> _rule_categories {};
   std::list<std::shared_ptr<FDRule>> _fd_rules {};
   std::list<std::shared_ptr<BasicRule>> _non_fd_rules {};
 
+  Backend _backend;
+  InterestUpdates _interest_updates;
+  std::optional<FileDescriptor> _epoll {};                //!< The epoll instance (epoll backend only).
+  std::unordered_map<int, Registration> _registrations {}; //!< Keyed by fd number (epoll backend only).
+  std::vector<epoll_event> _ready {};                     //!< Buffer for epoll_wait() results.
+  std::vector<int> _dirty_fds {};                         //!< Registrations whose events need updating.
+  std::vector<std::shared_ptr<FDRule>> _stale_rules {};   //!< Rules to check before the next wait (on demand).
+  std::vector<std::shared_ptr<FDRule>> _checking {};      //!< The _stale_rules being checked.
+  size_t _interested_rules {};                            //!< Rules whose `interested` is set (epoll backend).
+  std::vector<IoUring*> _rings {};                        //!< Submitted before every wait.
+
+  //! Run interested non-fd rules; returns true if any rule fired.
+  bool _serve_non_fd_rules();
+
+  //! Print the error on a rule's fd, if it can be found.
+  void _report_error( const FDRule& rule ) const;
+
+  //! Remove a rule from its fd's epoll registration, deregistering the fd if no rules remain.
+  void _unregister( const FDRule& rule );
+
+  //! Have the next wait check a rule's interest (epoll backend with on-demand updates only).
+  void _mark_stale( const std::shared_ptr<FDRule>& rule );
+
+  //! Before an epoll wait: drop a cancelled or finished rule, or bring its interest up to date. Returns false
+  //! if the rule has left its registration, and should be erased from _fd_rules.
+  bool _refresh( FDRule& rule );
+
+  Result _wait_poll( int timeout_ms );
+  Result _wait_epoll( int timeout_ms );
+
 public:
-  EventLoop() { _rule_categories.reserve( 64 ); }
+  explicit EventLoop( Backend backend = Backend::Poll, InterestUpdates updates = InterestUpdates::EveryWait );
 
-  //! Returned by each call to EventLoop::wait_next_event.
-  enum class Result
-  {
-    Success, //!< At least one Rule was triggered.
-    Timeout, //!< No rules were triggered before timeout.
-    Exit     //!< All rules have been canceled or were uninterested; make no further calls to
-             //!< EventLoop::wait_next_event.
-  };
+  // RuleHandles point back to the loop
+  EventLoop( const EventLoop& other ) = delete;
+  EventLoop& operator=( const EventLoop& other ) = delete;
 
   size_t add_category( const std::string& name );
 
   class RuleHandle
   {
     std::weak_ptr<BasicRule> rule_weak_ptr_;
+    std::weak_ptr<FDRule> fd_rule_weak_ptr_ {}; //!< Empty unless the rule watches an fd.
+    std::reference_wrapper<EventLoop> loop_;
 
   public:
     template<class RuleType>
-    explicit RuleHandle( const std::shared_ptr<RuleType> x ) : rule_weak_ptr_( x )
-    {}
+    RuleHandle( EventLoop& loop, const std::shared_ptr<RuleType>& x ) : rule_weak_ptr_( x ), loop_( loop )
+    {
+      if constexpr ( std::is_same_v<RuleType, FDRule> ) {
+        fd_rule_weak_ptr_ = x;
+      }
+    }
 
     void cancel();
+
+    //! Tell a loop with on-demand interest updates that the rule's interest() may have changed. Call it from
+    //! the loop's thread, after any change made outside the rule's own callback (or its fd's other rules').
+    void update_interest();
   };
 
   RuleHandle add_rule(
     size_t category_id,
     FileDescriptor& fd,
     Direction direction,
+    Trigger trigger,
     const CallbackT& callback,
     const InterestT& interest = [] { return true; },
     const CallbackT& cancel = [] {},
@@ -94,10 +184,27 @@ public:
 
   RuleHandle add_rule(
     size_t category_id,
+    FileDescriptor& fd,
+    Direction direction,
     const CallbackT& callback,
+    const InterestT& interest = [] { return true; },
+    const CallbackT& cancel = [] {},
+    const CallbackT& error = [] {} );
+
+  RuleHandle add_rule(
+    size_t category_id,
+    const CallbackT& callback,
+    const InterestT& interest = [] { return true; } );
+
+  //! Run an IoUring's completion callbacks when its requests finish, and hand its queued requests to the
+  //! kernel in one batch before each wait. The ring must outlive the EventLoop.
+  RuleHandle add_rule(
+    size_t category_id,
+    IoUring& ring,
     const InterestT& interest = [] { return true; } );
 
-  //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+  //! Waits with [poll(2)](\ref man2::poll) or [epoll_wait(2)](\ref man2::epoll_wait), then executes the
+  //! callback for the first ready fd (poll) or for every ready fd (epoll).
   Result wait_next_event( int timeout_ms );
 
   // convenience function to add category and rule at the same time
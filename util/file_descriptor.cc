@@ -36,6 +36,10 @@ T FileDescriptor::CheckSystemCall( std::string_view s_attempt, T return_value )
   return internal_fd_->CheckSystemCall( s_attempt, return_value );
 }
 
+// used by subclasses in other files, where the template isn't visible
+template int FileDescriptor::CheckSystemCall( string_view, int ) const;
+template ssize_t FileDescriptor::CheckSystemCall( string_view, ssize_t ) const;
+
 // fd is the file descriptor number returned by [open(2)](\ref man2::open) or similar
 FileDescriptor::FDWrapper::FDWrapper( int fd ) : fd_( fd )
 {
@@ -86,11 +90,15 @@ void FileDescriptor::read( string& buffer )
     buffer.resize( kReadBufferSize );
   }
 
+  buffer.resize( read( span { buffer } ) );
+}
+
+size_t FileDescriptor::read( span<char> buffer )
+{
   const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
   if ( bytes_read < 0 ) {
     if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
-      buffer.clear();
-      return;
+      return 0;
     }
     throw unix_error { "read" };
   }
@@ -105,7 +113,7 @@ void FileDescriptor::read( string& buffer )
     throw runtime_error( "read() read more than requested" );
   }
 
-  buffer.resize( bytes_read );
+  return bytes_read;
 }
 
 void FileDescriptor::read( vector<string>& buffers )
@@ -114,8 +122,9 @@ void FileDescriptor::read( vector<string>& buffers )
     return;
   }
 
-  buffers.back().clear();
-  buffers.back().resize( kReadBufferSize );
+  if ( buffers.back().size() < kReadBufferSize ) {
+    buffers.back().resize( kReadBufferSize );
+  }
 
   vector<iovec> iovecs;
   iovecs.reserve( buffers.size() );
@@ -153,7 +162,8 @@ void FileDescriptor::read( vector<string>& buffers )
 
 size_t FileDescriptor::write( string_view buffer )
 {
-  return write( vector<string_view> { buffer } );
+  const iovec iov { const_cast<char*>( buffer.data() ), buffer.size() }; // NOLINT(*-const-cast)
+  return writev( { &iov, 1 }, buffer.size() );
 }
 
 size_t FileDescriptor::write( const vector<std::string>& buffers )
@@ -175,12 +185,17 @@ size_t FileDescriptor::write( const vector<string_view>& buffers )
     iovecs.push_back( { const_cast<char*>( x.data() ), x.size() } ); // NOLINT(*-const-cast)
     total_size += x.size();
   }
+  return writev( iovecs, total_size );
+}
 
+size_t FileDescriptor::writev( span<const iovec> iovecs, size_t total_size )
+{
   const ssize_t bytes_written
     = CheckSystemCall( "writev", ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) ) );
   register_write();
 
-  if ( bytes_written == 0 and total_size != 0 ) {
+  // a non-blocking fd that isn't ready reports 0 bytes written (as CheckSystemCall returns 0 for EAGAIN)
+  if ( bytes_written == 0 and total_size != 0 and not internal_fd_->non_blocking_ ) {
     throw runtime_error( "write returned 0 given non-empty input buffer" );
   }
 
@@ -3,6 +3,8 @@
 #include <cstddef>
 #include <limits>
 #include <memory>
+#include <span>
+#include <sys/uio.h>
 #include <vector>
 
 // A reference-counted handle to a file descriptor
@@ -43,6 +45,9 @@ class FileDescriptor
   // private constructor used to duplicate the FileDescriptor (increase the reference count)
   explicit FileDescriptor( std::shared_ptr<FDWrapper> other_shared_ptr );
 
+  // write() the buffers `iovecs` point to, which hold `total_size` bytes
+  size_t writev( std::span<const iovec> iovecs, size_t total_size );
+
 protected:
   // size of buffer to allocate for read()
   static constexpr size_t kReadBufferSize = 16384;
@@ -63,6 +68,11 @@ public:
 
   // Read into `buffer`
   void read( std::string& buffer );
+
+  // Read into `buffer`, returning how many bytes were read (0 at EOF, or if a non-blocking fd had none)
+  size_t read( std::span<char> buffer );
+
+  // Scatter one read across `buffers`; the last one is grown to at least kReadBufferSize
   void read( std::vector<std::string>& buffers );
 
   // Attempt to write a buffer
@@ -0,0 +1,208 @@
+#include "io_uring.hh"
+
+#include "exception.hh"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+IoUring::Mapping::Mapping( int fd, size_t length, uint64_t offset )
+  : addr_( mmap( nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset ) )
+  , length_( length )
+{
+  if ( addr_ == MAP_FAILED ) { // NOLINT(*-cstyle-cast)
+    throw unix_error( "mmap" );
+  }
+}
+
+IoUring::Mapping::~Mapping()
+{
+  munmap( addr_, length_ );
+}
+
+namespace {
+int setup_ring( unsigned entries, io_uring_params& params )
+{
+  params = {};
+  params.flags = IORING_SETUP_COOP_TASKRUN; // don't interrupt the thread's other waits to run completions
+  const auto ret = static_cast<int>( syscall( __NR_io_uring_setup, entries, &params ) );
+  if ( ret >= 0 or errno != EINVAL ) {
+    return CheckSystemCall( "io_uring_setup", ret );
+  }
+
+  // kernels before 5.19 don't know the flag
+  params = {};
+  return CheckSystemCall( "io_uring_setup", static_cast<int>( syscall( __NR_io_uring_setup, entries, &params ) ) );
+}
+} // namespace
+
+IoUring::IoUring( unsigned entries )
+  : ring_fd_( setup_ring( entries, params_ ) )
+  , event_fd_( CheckSystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) )
+{
+  // the submission and completion rings, and the array of submission queue entries
+  const size_t sq_size = params_.sq_off.array + params_.sq_entries * sizeof( uint32_t );
+  const size_t cq_size = params_.cq_off.cqes + params_.cq_entries * sizeof( io_uring_cqe );
+  sq_ring_.emplace( ring_fd_.fd_num(), sq_size, IORING_OFF_SQ_RING );
+  cq_ring_.emplace( ring_fd_.fd_num(), cq_size, IORING_OFF_CQ_RING );
+  sqes_.emplace( ring_fd_.fd_num(), params_.sq_entries * sizeof( io_uring_sqe ), IORING_OFF_SQES );
+
+  int event_fd_num = event_fd_.fd_num();
+  CheckSystemCall(
+    "io_uring_register",
+    syscall( __NR_io_uring_register, ring_fd_.fd_num(), IORING_REGISTER_EVENTFD, &event_fd_num, 1 ) );
+
+  completions_.resize( params_.cq_entries );
+  for ( uint32_t slot = params_.cq_entries; slot > 0; slot-- ) {
+    free_slots_.push_back( slot - 1 );
+  }
+}
+
+void IoUring::register_buffers( const vector<span<char>>& buffers )
+{
+  vector<iovec> iovecs;
+  iovecs.reserve( buffers.size() );
+  for ( const auto& buffer : buffers ) {
+    iovecs.push_back( { buffer.data(), buffer.size() } );
+  }
+  CheckSystemCall( "io_uring_register",
+                   syscall( __NR_io_uring_register,
+                            ring_fd_.fd_num(),
+                            IORING_REGISTER_BUFFERS,
+                            iovecs.data(),
+                            static_cast<unsigned>( iovecs.size() ) ) );
+}
+
+io_uring_sqe& IoUring::next_sqe( CompletionT done )
+{
+  // Without a free slot the completion queue could overflow: wait for a request to finish.
+  while ( free_slots_.empty() ) {
+    wait();
+  }
+
+  auto& tail = *sq_ring_->at<uint32_t>( params_.sq_off.tail );
+  const uint32_t head = atomic_ref( *sq_ring_->at<uint32_t>( params_.sq_off.head ) ).load( memory_order_acquire );
+  if ( tail - head == params_.sq_entries ) {
+    submit();
+  }
+
+  const uint32_t slot = free_slots_.back();
+  free_slots_.pop_back();
+  completions_.at( slot ) = move( done );
+
+  const uint32_t index = tail & *sq_ring_->at<uint32_t>( params_.sq_off.ring_mask );
+  io_uring_sqe& sqe = sqes_->at<io_uring_sqe>( 0 )[index];
+  memset( &sqe, 0, sizeof( sqe ) );
+  sqe.user_data = slot;
+  sq_ring_->at<uint32_t>( params_.sq_off.array )[index] = index;
+
+  // the kernel may read the entry as soon as it sees the new tail (on the next io_uring_enter)
+  atomic_ref<uint32_t>( tail ).store( tail + 1, memory_order_release );
+  queued_++;
+  return sqe;
+}
+
+void IoUring::read( const FileDescriptor& fd, span<char> buffer, CompletionT done, optional<uint16_t> fixed_index )
+{
+  io_uring_sqe& sqe = next_sqe( move( done ) );
+  sqe.opcode = fixed_index.has_value() ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe.fd = fd.fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = static_cast<uint32_t>( buffer.size() );
+  sqe.off = -1; // current position (for a file), ignored by sockets and TUN devices
+  sqe.buf_index = fixed_index.value_or( 0 );
+}
+
+void IoUring::write( const FileDescriptor& fd,
+                     string_view buffer,
+                     CompletionT done,
+                     optional<uint16_t> fixed_index )
+{
+  io_uring_sqe& sqe = next_sqe( move( done ) );
+  sqe.opcode = fixed_index.has_value() ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe.fd = fd.fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = static_cast<uint32_t>( buffer.size() );
+  sqe.off = -1;
+  sqe.buf_index = fixed_index.value_or( 0 );
+}
+
+void IoUring::enter( unsigned to_submit, unsigned min_complete )
+{
+  const unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  while ( true ) {
+    const auto ret = syscall( __NR_io_uring_enter, ring_fd_.fd_num(), to_submit, min_complete, flags, nullptr, 0 );
+    if ( ret >= 0 or errno != EINTR ) {
+      CheckSystemCall( "io_uring_enter", ret );
+      return;
+    }
+  }
+}
+
+size_t IoUring::submit()
+{
+  const size_t count = queued_;
+  if ( count > 0 ) {
+    queued_ = 0;
+    enter( count, 0 );
+  }
+  return count;
+}
+
+size_t IoUring::reap()
+{
+  // reset the eventfd first, so a completion that lands after this point wakes the EventLoop again
+  string counter( sizeof( uint64_t ), 0 );
+  event_fd_.read( counter );
+
+  // copy the completions out and release their entries before running any callback, since a callback
+  // may queue (or even wait for) more requests
+  auto& head = *cq_ring_->at<uint32_t>( params_.cq_off.head );
+  const uint32_t tail = atomic_ref( *cq_ring_->at<uint32_t>( params_.cq_off.tail ) ).load( memory_order_acquire );
+  const uint32_t mask = *cq_ring_->at<uint32_t>( params_.cq_off.ring_mask );
+  vector<pair<CompletionT, int32_t>> finished;
+  for ( uint32_t i = head; i != tail; i++ ) {
+    const io_uring_cqe& cqe = cq_ring_->at<io_uring_cqe>( params_.cq_off.cqes )[i & mask];
+    const auto slot = static_cast<uint32_t>( cqe.user_data );
+    finished.emplace_back( move( completions_.at( slot ) ), cqe.res );
+    completions_.at( slot ) = nullptr;
+    free_slots_.push_back( slot );
+  }
+  atomic_ref<uint32_t>( head ).store( tail, memory_order_release );
+
+  // every callback runs even if one throws (the rest may be releasing buffers or posting reads); the first
+  // exception is rethrown afterwards
+  exception_ptr error;
+  for ( auto& [done, result] : finished ) {
+    if ( not done ) {
+      continue;
+    }
+    try {
+      done( result );
+    } catch ( ... ) {
+      if ( not error ) {
+        error = current_exception();
+      }
+    }
+  }
+  if ( error ) {
+    rethrow_exception( error );
+  }
+  return finished.size();
+}
+
+size_t IoUring::wait()
+{
+  const unsigned to_submit = queued_;
+  queued_ = 0;
+  enter( to_submit, 1 );
+  return reap();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <linux/io_uring.h>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// A submission/completion queue pair shared with the kernel ([io_uring(7)](\ref man7::io_uring)).
+// Reads and writes are queued without a system call and handed to the kernel in one batch by submit();
+// each completion runs the callback that was given with its request.
+class IoUring
+{
+public:
+  // Called with the request's result: bytes transferred, or -errno
+  using CompletionT = std::function<void( int32_t )>;
+
+  // Create a ring with room for `entries` queued requests (rounded up to a power of two by the kernel)
+  explicit IoUring( unsigned entries );
+
+  // Register buffers that requests may then refer to by index, sparing the kernel from mapping them each time.
+  // The buffers must stay valid, and this may be called only once.
+  void register_buffers( const std::vector<std::span<char>>& buffers );
+
+  // Queue a read into `buffer` (or into the first `buffer.size()` bytes of registered buffer `fixed_index`)
+  void read( const FileDescriptor& fd,
+             std::span<char> buffer,
+             CompletionT done,
+             std::optional<uint16_t> fixed_index = {} );
+
+  // Queue a write of `buffer`, which must stay valid until `done` runs
+  void write( const FileDescriptor& fd,
+              std::string_view buffer,
+              CompletionT done,
+              std::optional<uint16_t> fixed_index = {} );
+
+  // Hand every queued request to the kernel; returns how many were submitted
+  size_t submit();
+
+  // Run the callbacks of all finished requests (without blocking); returns how many ran. If a callback throws,
+  // the others still run, and the first exception is rethrown after them.
+  size_t reap();
+
+  // Block until at least one request finishes, then reap()
+  size_t wait();
+
+  // Becomes readable when requests finish; a level-triggered EventLoop rule that calls reap() can watch it
+  FileDescriptor& completion_fd() { return event_fd_; }
+
+  size_t queued() const { return queued_; }                                 // requests not yet submitted
+  size_t in_flight() const { return completions_.size() - free_slots_.size(); } // requests not yet reaped
+
+  IoUring( const IoUring& other ) = delete;
+  IoUring& operator=( const IoUring& other ) = delete;
+  IoUring( IoUring&& other ) = delete;
+  IoUring& operator=( IoUring&& other ) = delete;
+
+private:
+  // A shared memory region set up by io_uring_setup
+  class Mapping
+  {
+    void* addr_;
+    size_t length_;
+
+  public:
+    Mapping( int fd, size_t length, uint64_t offset );
+    ~Mapping();
+    template<typename T>
+    T* at( uint32_t offset ) const
+    {
+      return reinterpret_cast<T*>( static_cast<char*>( addr_ ) + offset ); // NOLINT(*-reinterpret-cast)
+    }
+
+    Mapping( const Mapping& other ) = delete;
+    Mapping& operator=( const Mapping& other ) = delete;
+    Mapping( Mapping&& other ) = delete;
+    Mapping& operator=( Mapping&& other ) = delete;
+  };
+
+  io_uring_params params_ {};
+  FileDescriptor ring_fd_; // from io_uring_setup(), which also fills in params_
+  std::optional<Mapping> sq_ring_ {};
+  std::optional<Mapping> cq_ring_ {};
+  std::optional<Mapping> sqes_ {};
+  FileDescriptor event_fd_;
+
+  // Each request's user_data is its slot in completions_; CQ overflow is impossible while every slot
+  // is in use, because the completion queue has at least as many entries.
+  std::vector<CompletionT> completions_ {};
+  std::vector<uint32_t> free_slots_ {};
+  size_t queued_ {};
+
+  // Fill in the next submission queue entry, submitting first if the queue is full
+  io_uring_sqe& next_sqe( CompletionT done );
+
+  // Enter the kernel to submit `to_submit` requests and/or wait for `min_complete` completions
+  void enter( unsigned to_submit, unsigned min_complete );
+};
@@ -11,25 +11,28 @@ using namespace std;
 // Parse from string.
 void IPv4Header::parse( Parser& parser )
 {
-  uint8_t first_byte {};
-  parser.integer( first_byte );
+  const auto header = parser.header<LENGTH>();
+  if ( parser.has_error() ) {
+    return;
+  }
+
+  const uint8_t first_byte = header[0];
   ver = first_byte >> 4;    // version
   hlen = first_byte & 0x0f; // header length
-  parser.integer( tos );    // type of service
-  parser.integer( len );
-  parser.integer( id );
+  tos = header[1];          // type of service
+  len = read_big_endian<uint16_t>( header.subspan<2>() );
+  id = read_big_endian<uint16_t>( header.subspan<4>() );
 
-  uint16_t fo_val {};
-  parser.integer( fo_val );
+  const uint16_t fo_val = read_big_endian<uint16_t>( header.subspan<6>() );
   df = static_cast<bool>( fo_val & 0x4000 ); // don't fragment
   mf = static_cast<bool>( fo_val & 0x2000 ); // more fragments
   offset = fo_val & 0x1fff;                  // offset
 
-  parser.integer( ttl );
-  parser.integer( proto );
-  parser.integer( cksum );
-  parser.integer( src );
-  parser.integer( dst );
+  ttl = header[8];
+  proto = header[9];
+  cksum = read_big_endian<uint16_t>( header.subspan<10>() );
+  src = read_big_endian<uint32_t>( header.subspan<12>() );
+  dst = read_big_endian<uint32_t>( header.subspan<16>() );
 
   if ( ver != 4 ) {
     parser.set_error();
@@ -107,12 +110,13 @@ uint32_t IPv4Header::pseudo_checksum() const
 void IPv4Header::compute_checksum()
 {
   cksum = 0;
-  Serializer s;
+  array<char, LENGTH> header {};
+  Serializer s { header };
   serialize( s );
 
   // calculate checksum -- taken over header only
   InternetChecksum check;
-  check.add( s.output() );
+  check.add( string_view { header.data(), header.size() } );
   cksum = check.value();
 }
 
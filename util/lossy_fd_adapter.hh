@@ -7,7 +7,9 @@
 
 #include <optional>
 #include <random>
+#include <span>
 #include <utility>
+#include <vector>
 
 //! An adapter class that adds random dropping behavior to an FD adapter
 template<typename AdapterT>
@@ -59,6 +61,26 @@ public:
     return _adapter.write( seg );
   }
 
+  //! \brief Read a batch from the underlying AdapterT instance, dropping each segment with the read loss rate
+  std::vector<TCPMessage> read_batch( size_t max )
+  {
+    std::vector<TCPMessage> segs = _adapter.read_batch( max );
+    std::erase_if( segs, [&]( const TCPMessage& ) { return _should_drop( false ); } );
+    return segs;
+  }
+
+  //! \brief Write a batch to the underlying AdapterT instance, dropping each segment with the write loss rate
+  void write_batch( std::span<const TCPMessage> segs )
+  {
+    std::vector<TCPMessage> kept;
+    for ( const auto& seg : segs ) {
+      if ( not _should_drop( true ) ) {
+        kept.push_back( seg );
+      }
+    }
+    _adapter.write_batch( kept );
+  }
+
   //! \name
   //! Passthrough functions to the underlying AdapterT instance
 
@@ -0,0 +1,260 @@
+#include "packet_buffer.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//! The free blocks of one thread, and the blocks it took from the heap that other threads have given back.
+//! \details The pool outlives its thread for as long as any of its blocks do: each block holds a reference to
+//! it. Once the thread has exited, blocks that come back are freed instead.
+struct PacketBuffer::Pool
+{
+  std::array<vector<Block*>, 2> free {}; // small and large blocks ready for reuse, touched only by the thread
+  atomic<Block*> returned { nullptr };   // pushed by other threads, taken all at once by this one (or CLOSED)
+  atomic<size_t> refs { 1 };             // the thread, and every block taken from the heap for it
+  size_t heap_allocations {};
+
+  static inline Block closed_marker {};
+  static constexpr Block* CLOSED = &closed_marker; // `returned` after the thread has exited
+
+  static inline thread_local Pool* current = nullptr; // this thread's pool, while the thread is alive
+
+  // Frees the pool when the thread exits, or once the last of its blocks is gone if that is later
+  struct Holder
+  {
+    Pool* pool { new Pool };
+    Holder() = default;
+    Holder( const Holder& ) = delete;
+    Holder& operator=( const Holder& ) = delete;
+    ~Holder() { pool->close(); }
+  };
+
+  static Pool& get()
+  {
+    thread_local Holder holder;
+    current = holder.pool;
+    return *holder.pool;
+  }
+
+  static size_t size_class( size_t capacity ) { return capacity <= SMALL_CAPACITY ? 0 : 1; }
+
+  Block* take( size_t capacity )
+  {
+    auto& blocks = free.at( size_class( capacity ) );
+    if ( blocks.empty() ) {
+      reclaim();
+    }
+    if ( blocks.empty() ) {
+      heap_allocations++;
+      refs.fetch_add( 1, memory_order_relaxed );
+      return allocate( size_class( capacity ) == 0 ? SMALL_CAPACITY : CAPACITY );
+    }
+    Block* block = blocks.back();
+    blocks.pop_back();
+    block->refs.store( 1, memory_order_relaxed );
+    return block;
+  }
+
+  // Called by whichever thread let go of the block last
+  static void give( Block* block )
+  {
+    Pool* owner = block->owner;
+    if ( owner == current ) {
+      owner->keep( block );
+      return;
+    }
+
+    block->next = owner->returned.load( memory_order_relaxed );
+    do {
+      if ( block->next == CLOSED ) {
+        destroy( block );
+        return;
+      }
+    } while ( not owner->returned.compare_exchange_weak( block->next, block, memory_order_release ) );
+  }
+
+private:
+  // The storage is left uninitialized: every byte of it is written before it is read
+  Block* allocate( size_t capacity )
+  {
+    void* memory = ::operator new( sizeof( Block ) + capacity );
+    auto* block = new ( memory ) Block { .owner = this };
+    block->data = { reinterpret_cast<char*>( block + 1 ), capacity }; // NOLINT(*-reinterpret-cast)
+    return block;
+  }
+
+  static void destroy( Block* block )
+  {
+    Pool* owner = block->owner;
+    block->~Block();
+    ::operator delete( block );
+    owner->unref();
+  }
+
+  void unref()
+  {
+    if ( refs.fetch_sub( 1, memory_order_acq_rel ) == 1 ) {
+      delete this; // NOLINT(*-owning-memory)
+    }
+  }
+
+  void keep( Block* block )
+  {
+    auto& blocks = free.at( size_class( block->data.size() ) );
+    if ( blocks.size() < MAX_POOLED ) {
+      blocks.push_back( block );
+    } else {
+      destroy( block );
+    }
+  }
+
+  // Move the blocks that other threads gave back into the free lists
+  void reclaim()
+  {
+    for ( Block* block = returned.exchange( nullptr, memory_order_acquire ); block != nullptr; ) {
+      keep( exchange( block, block->next ) );
+    }
+  }
+
+  void close()
+  {
+    current = nullptr;
+    for ( Block* block = returned.exchange( CLOSED, memory_order_acquire ); block != nullptr; ) {
+      destroy( exchange( block, block->next ) );
+    }
+    for ( auto& blocks : free ) {
+      for ( Block* block : blocks ) {
+        destroy( block );
+      }
+      blocks.clear();
+    }
+    unref();
+  }
+};
+
+PacketBuffer::~PacketBuffer()
+{
+  _release();
+}
+
+PacketBuffer::PacketBuffer( const PacketBuffer& other )
+  : _block( other._block ), _begin( other._begin ), _end( other._end )
+{
+  if ( _block ) {
+    _block->refs.fetch_add( 1, memory_order_relaxed );
+  }
+}
+
+PacketBuffer& PacketBuffer::operator=( const PacketBuffer& other )
+{
+  if ( this != &other ) {
+    PacketBuffer copy { other };
+    *this = std::move( copy );
+  }
+  return *this;
+}
+
+PacketBuffer::PacketBuffer( PacketBuffer&& other ) noexcept
+  : _block( exchange( other._block, nullptr ) ), _begin( other._begin ), _end( other._end )
+{
+  other._begin = other._end = 0;
+}
+
+PacketBuffer& PacketBuffer::operator=( PacketBuffer&& other ) noexcept
+{
+  if ( this != &other ) {
+    _release();
+    _block = exchange( other._block, nullptr );
+    _begin = exchange( other._begin, 0 );
+    _end = exchange( other._end, 0 );
+  }
+  return *this;
+}
+
+string_view PacketBuffer::view() const
+{
+  if ( not _block ) {
+    return {};
+  }
+  return { _block->data.data() + _begin, size() };
+}
+
+span<char> PacketBuffer::prepend( size_t len )
+{
+  if ( len > headroom() ) {
+    throw length_error( "PacketBuffer::prepend: not enough headroom" );
+  }
+  _own( _block ? _block->data.size() : SMALL_CAPACITY );
+  _begin -= len;
+  return _block->data.subspan( _begin, len );
+}
+
+span<char> PacketBuffer::append( size_t len )
+{
+  const size_t end = ( _block ? _end : HEADROOM ) + len;
+  if ( end > CAPACITY ) {
+    throw length_error( "PacketBuffer::append: not enough room" );
+  }
+  _own( end );
+  _end += len;
+  return _block->data.subspan( _end - len, len );
+}
+
+void PacketBuffer::append( string_view data )
+{
+  const span<char> room = append( data.size() );
+  copy( data.begin(), data.end(), room.begin() );
+}
+
+void PacketBuffer::remove_prefix( size_t len )
+{
+  _begin += min( len, size() );
+}
+
+void PacketBuffer::remove_suffix( size_t len )
+{
+  _end -= min( len, size() );
+}
+
+PacketBuffer PacketBuffer::slice( size_t offset, size_t len ) const
+{
+  PacketBuffer ret { *this };
+  ret.remove_prefix( offset );
+  ret.remove_suffix( ret.size() - min( len, ret.size() ) );
+  return ret;
+}
+
+size_t PacketBuffer::heap_allocations()
+{
+  return Pool::get().heap_allocations;
+}
+
+void PacketBuffer::_own( size_t capacity )
+{
+  if ( not _block ) {
+    _block = Pool::get().take( capacity );
+    _begin = _end = HEADROOM;
+    return;
+  }
+
+  if ( _block->refs.load( memory_order_acquire ) > 1 or capacity > _block->data.size() ) {
+    Block* copy = Pool::get().take( max( capacity, _block->data.size() ) );
+    memcpy( copy->data.data() + _begin, _block->data.data() + _begin, size() );
+    _release();
+    _block = copy;
+  }
+}
+
+void PacketBuffer::_release()
+{
+  if ( _block and _block->refs.fetch_sub( 1, memory_order_acq_rel ) == 1 ) {
+    Pool::give( _block );
+  }
+  _block = nullptr;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+//! A reference-counted view of a pooled block of memory that holds one packet.
+//! \details The contents start HEADROOM bytes into the block, so that on the way down each layer can prepend
+//! its header in place, and on the way up each layer can hand the next one its payload as a slice of the same
+//! block instead of a copy. Copies and slices share the block, which goes back to the pool of the thread that
+//! took it from the heap when the last of them is gone, whichever thread that happens on; a thread that keeps a
+//! steady number of packets in flight stops allocating once its pool has warmed up. Blocks come in two sizes:
+//! one for packets up to an Ethernet MTU, which is what ACKs and most segments need, and one for anything up to
+//! a 64 KiB datagram. Growing a shared block (prepend() or append()), or growing past the end of a small one,
+//! first copies the contents to a block of its own, so that no other view sees the change.
+class PacketBuffer
+{
+public:
+  static constexpr size_t HEADROOM = 256;        //!< Room for virtio-net, Ethernet, IPv4 and TCP headers
+  static constexpr size_t SMALL_CAPACITY = 2048; //!< The headroom, then a 1500-byte datagram and a vnet header
+  static constexpr size_t CAPACITY = 69632;      //!< 68 KiB: the headroom, then a 64 KiB datagram and a vnet header
+  static constexpr size_t MAX_POOLED = 64;       //!< Free blocks of each size each thread keeps for reuse
+
+  PacketBuffer() = default;
+  ~PacketBuffer();
+
+  PacketBuffer( const PacketBuffer& other );
+  PacketBuffer& operator=( const PacketBuffer& other );
+  PacketBuffer( PacketBuffer&& other ) noexcept;
+  PacketBuffer& operator=( PacketBuffer&& other ) noexcept;
+
+  size_t size() const { return _end - _begin; }
+  bool empty() const { return size() == 0; }
+  std::string_view view() const;
+
+  //! Bytes that can be prepended or appended without moving the contents
+  size_t headroom() const { return _block ? _begin : HEADROOM; }
+  size_t tailroom() const { return _block ? _block->data.size() - _end : CAPACITY - HEADROOM; }
+
+  //! Grow the contents by `len` bytes at the front (or back), for the caller to fill in; append() moves the
+  //! contents to a large block if a small one is too short
+  //! \throws std::length_error if there is not enough room even so
+  std::span<char> prepend( size_t len );
+  std::span<char> append( size_t len );
+  void append( std::string_view data );
+
+  //! Shrink the contents, leaving the block as it is
+  void remove_prefix( size_t len );
+  void remove_suffix( size_t len );
+
+  //! A view of part of the contents that shares this block
+  PacketBuffer slice( size_t offset, size_t len = std::string_view::npos ) const;
+
+  //! Blocks this thread has taken from the heap, rather than from its pool
+  static size_t heap_allocations();
+
+private:
+  struct Pool;
+
+  struct Block
+  {
+    std::atomic<size_t> refs { 1 };
+    Pool* owner {};          //!< The pool of the thread that took this block from the heap, and gets it back
+    Block* next {};          //!< The next block in the owner's list of blocks that other threads gave back
+    std::span<char> data {}; //!< The block's storage, which follows it in the same allocation (uninitialized)
+  };
+
+  Block* _block {};
+  size_t _begin {};
+  size_t _end {};
+
+  //! Make sure this is the only view of a block with at least `capacity` bytes, before growing into it
+  void _own( size_t capacity );
+  void _release();
+};
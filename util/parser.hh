@@ -1,10 +1,14 @@
 #pragma once
 
+#include "packet_buffer.hh"
+
 #include <algorithm>
+#include <array>
 #include <concepts>
 #include <cstdint>
 #include <cstring>
 #include <deque>
+#include <endian.h>
 #include <numeric>
 #include <span>
 #include <stdexcept>
@@ -12,44 +16,85 @@
 #include <string_view>
 #include <vector>
 
+// Read a big-endian integer from the first sizeof( T ) bytes of `bytes`, with a single load
+template<std::unsigned_integral T>
+T read_big_endian( std::span<const char> bytes )
+{
+  T val {};
+  std::memcpy( &val, bytes.data(), sizeof( T ) );
+  if constexpr ( sizeof( T ) == 2 ) {
+    return be16toh( val );
+  } else if constexpr ( sizeof( T ) == 4 ) {
+    return be32toh( val );
+  } else if constexpr ( sizeof( T ) == 8 ) {
+    return be64toh( val );
+  } else {
+    return val;
+  }
+}
+
 class Parser
 {
+  // The input, as views of buffers that the caller keeps alive for as long as the Parser
   class BufferList
   {
     uint64_t size_ {};
-    std::deque<std::string> buffer_ {};
-    uint64_t skip_ {};
+    std::string_view front_ {};            // what is left of the current buffer
+    std::span<const std::string> rest_ {}; // the buffers after it
+
+    // Make the next non-empty buffer current, if the current one is used up
+    void advance()
+    {
+      while ( front_.empty() and not rest_.empty() ) {
+        front_ = rest_.front();
+        rest_ = rest_.subspan( 1 );
+      }
+    }
 
   public:
-    explicit BufferList( const std::vector<std::string>& buffers )
+    explicit BufferList( const std::vector<std::string>& buffers ) : rest_( buffers )
     {
       for ( const auto& x : buffers ) {
-        append( x );
+        size_ += x.size();
       }
+      advance();
     }
 
+    explicit BufferList( std::string_view buffer ) : size_( buffer.size() ), front_( buffer ) {}
+
     uint64_t size() const { return size_; }
     uint64_t serialized_length() const { return size(); }
     bool empty() const { return size_ == 0; }
 
     std::string_view peek() const
     {
-      if ( buffer_.empty() ) {
+      if ( empty() ) {
         throw std::runtime_error( "peek on empty BufferList" );
       }
-      return std::string_view { buffer_.front() }.substr( skip_ );
+      return front_;
     }
 
     void remove_prefix( uint64_t len )
     {
-      while ( len and not buffer_.empty() ) {
-        const uint64_t to_pop_now = std::min( len, peek().size() );
-        skip_ += to_pop_now;
+      while ( len and not empty() ) {
+        const uint64_t to_pop_now = std::min( len, front_.size() );
+        front_.remove_prefix( to_pop_now );
         len -= to_pop_now;
         size_ -= to_pop_now;
-        if ( skip_ == buffer_.front().size() ) {
-          buffer_.pop_front();
-          skip_ = 0;
+        advance();
+      }
+    }
+
+    // Call `f` on each remaining piece of the input, in order
+    template<typename F>
+    void for_each( F&& f ) const
+    {
+      if ( not front_.empty() ) {
+        f( front_ );
+      }
+      for ( const auto& x : rest_ ) {
+        if ( not x.empty() ) {
+          f( std::string_view { x } );
         }
       }
     }
@@ -57,58 +102,31 @@ class Parser
     void dump_all( std::vector<std::string>& out )
     {
       out.clear();
-      if ( empty() ) {
-        return;
-      }
-      std::string first_str = std::move( buffer_.front() );
-      if ( skip_ ) {
-        first_str = first_str.substr( skip_ );
-      }
-      out.emplace_back( std::move( first_str ) );
-      buffer_.pop_front();
-      for ( auto&& x : buffer_ ) {
-        out.emplace_back( std::move( x ) );
-      }
+      for_each( [&]( std::string_view x ) { out.emplace_back( x ); } );
+      remove_prefix( size() );
     }
 
     void dump_all( std::string& out )
     {
-      std::vector<std::string> concat;
-      dump_all( concat );
-      if ( concat.size() == 1 ) {
-        out = std::move( concat.front() );
-        return;
-      }
-
       out.clear();
-      for ( const auto& s : concat ) {
-        out.append( s );
-      }
+      out.reserve( size() );
+      for_each( [&]( std::string_view x ) { out.append( x ); } );
+      remove_prefix( size() );
     }
 
     std::vector<std::string_view> buffer() const
     {
-      if ( empty() ) {
-        return {};
-      }
       std::vector<std::string_view> ret;
-      ret.reserve( buffer_.size() );
-      auto tmp_skip = skip_;
-      for ( const auto& x : buffer_ ) {
-        ret.push_back( std::string_view { x }.substr( tmp_skip ) );
-        tmp_skip = 0;
-      }
+      for_each( [&]( std::string_view x ) { ret.push_back( x ); } );
       return ret;
     }
-
-    void append( std::string str )
-    {
-      size_ += str.size();
-      buffer_.push_back( std::move( str ) );
-    }
   };
 
+  static constexpr size_t MAX_HEADER = 60; // the longest IPv4 or TCP header, with options
+
   BufferList input_;
+  PacketBuffer source_ {};                  // the input, if it came as a PacketBuffer, so that it can be sliced
+  std::array<char, MAX_HEADER> scratch_ {}; // a header that straddles two buffers, copied out by header()
   bool error_ {};
 
   void check_size( const size_t size )
@@ -119,7 +137,12 @@ class Parser
   }
 
 public:
+  // The Parser reads `input` where it lies, so the strings must outlive it; a temporary would leave it dangling
   explicit Parser( const std::vector<std::string>& input ) : input_( input ) {}
+  explicit Parser( std::vector<std::string>&& input ) = delete;
+
+  // The Parser shares the block of `input`, which may be a temporary
+  explicit Parser( const PacketBuffer& input ) : input_( input.view() ), source_( input ) {}
 
   const BufferList& input() const { return input_; }
 
@@ -135,20 +158,44 @@ public:
       return;
     }
 
-    if constexpr ( sizeof( T ) == 1 ) {
-      out = static_cast<uint8_t>( input_.peek().front() );
-      input_.remove_prefix( 1 );
+    // fast path: the whole integer is in the current buffer
+    const std::string_view front = input_.peek();
+    if ( front.size() >= sizeof( T ) ) {
+      out = read_big_endian<T>( front );
+      input_.remove_prefix( sizeof( T ) );
       return;
-    } else {
-      out = static_cast<T>( 0 );
-      for ( size_t i = 0; i < sizeof( T ); i++ ) {
-        out <<= 8;
-        out |= static_cast<uint8_t>( input_.peek().front() );
-        input_.remove_prefix( 1 );
-      }
+    }
+
+    out = static_cast<T>( 0 );
+    for ( size_t i = 0; i < sizeof( T ); i++ ) {
+      out <<= 8;
+      out |= static_cast<uint8_t>( input_.peek().front() );
+      input_.remove_prefix( 1 );
     }
   }
 
+  // Consume the next N bytes at once, for the caller to decode (e.g. with read_big_endian). The span views the
+  // input where it is contiguous, or else a copy that lasts until the next call; it is all zeros on error.
+  template<size_t N>
+  std::span<const char, N> header()
+  {
+    static_assert( N <= MAX_HEADER );
+    check_size( N );
+    if ( has_error() ) {
+      scratch_.fill( 0 );
+      return std::span<const char, N> { scratch_.data(), N };
+    }
+
+    const std::string_view front = input_.peek();
+    if ( front.size() >= N ) {
+      input_.remove_prefix( N );
+      return std::span<const char, N> { front.data(), N };
+    }
+
+    string( std::span { scratch_ }.first<N>() );
+    return std::span<const char, N> { scratch_.data(), N };
+  }
+
   void string( std::span<char> out )
   {
     check_size( out.size() );
@@ -166,6 +213,19 @@ public:
 
   void all_remaining( std::vector<std::string>& out ) { input_.dump_all( out ); }
   void all_remaining( std::string& out ) { input_.dump_all( out ); }
+
+  // The rest of the input as a slice of the same block, if it came as a PacketBuffer, or else a copy
+  void all_remaining( PacketBuffer& out )
+  {
+    if ( not source_.empty() ) {
+      out = source_.slice( source_.size() - input_.size() );
+    } else {
+      out = {};
+      input_.for_each( [&]( std::string_view x ) { out.append( x ); } );
+    }
+    input_.remove_prefix( input_.size() );
+  }
+
   std::vector<std::string_view> buffer() const { return input_.buffer(); }
 };
 
@@ -174,15 +234,37 @@ class Serializer
   std::vector<std::string> output_ {};
   std::string buffer_ {};
 
+  // Instead of the above, a fixed span to fill (such as the room for a header in front of a PacketBuffer)
+  std::span<char> out_ {};
+  size_t out_size_ {};
+
+  std::span<char> take( const size_t len )
+  {
+    if ( len > out_.size() - out_size_ ) {
+      throw std::runtime_error( "Serializer: output span is too small" );
+    }
+    out_size_ += len;
+    return out_.subspan( out_size_ - len, len );
+  }
+
 public:
   Serializer() = default;
   explicit Serializer( std::string&& buffer ) : buffer_( std::move( buffer ) ) {}
+  explicit Serializer( std::span<char> out ) : out_( out ) {}
 
   template<std::unsigned_integral T>
   void integer( const T val )
   {
     constexpr uint64_t len = sizeof( T );
 
+    if ( out_.data() ) {
+      const std::span<char> out = take( len );
+      for ( uint64_t i = 0; i < len; ++i ) {
+        out[i] = static_cast<char>( val >> ( ( len - i - 1 ) * 8 ) );
+      }
+      return;
+    }
+
     for ( uint64_t i = 0; i < len; ++i ) {
       const uint8_t byte_val = val >> ( ( len - i - 1 ) * 8 );
       buffer_.push_back( byte_val );
@@ -191,6 +273,11 @@ public:
 
   void buffer( std::string buf )
   {
+    if ( out_.data() ) {
+      std::copy( buf.begin(), buf.end(), take( buf.size() ).begin() );
+      return;
+    }
+
     flush();
     if ( not buf.empty() ) {
       output_.push_back( std::move( buf ) );
@@ -236,3 +323,11 @@ bool parse( T& obj, const std::vector<std::string>& buffers, Targs&&... Fargs )
   obj.parse( p, std::forward<Targs>( Fargs )... );
   return not p.has_error();
 }
+
+// Helper to serialize a fixed-length header into the headroom in front of a PacketBuffer's contents
+template<class T>
+void serialize_in_front( const T& header, PacketBuffer& buffer )
+{
+  Serializer s { buffer.prepend( T::LENGTH ) };
+  header.serialize( s );
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+//! Bounded lock-free queue between exactly one producer thread and one consumer thread.
+//! \details A ring of slots with a head index written only by the consumer and a tail index written only by
+//! the producer. Each side publishes its index with a release store and reads the other's with an acquire
+//! load, so a slot is never read before it is filled or refilled before it is read. The two indices sit on
+//! separate cache lines so the threads don't contend for one.
+template<typename T>
+class SPSCQueue
+{
+public:
+  //! \param[in] capacity is rounded up to a power of two
+  explicit SPSCQueue( size_t capacity ) : _slots( std::bit_ceil( capacity ) ), _mask( _slots.size() - 1 ) {}
+
+  //! Producer only: append `value`, unless the queue is full
+  //! \returns false if the queue was full (and `value` is untouched)
+  bool push( T&& value )
+  {
+    const size_t tail = _tail.load( std::memory_order_relaxed );
+    if ( tail - _head.load( std::memory_order_acquire ) == _slots.size() ) {
+      return false;
+    }
+    _slots[tail & _mask] = std::move( value );
+    _tail.store( tail + 1, std::memory_order_release );
+    return true;
+  }
+
+  //! Consumer only: remove the oldest value, or return empty if there is none
+  std::optional<T> pop()
+  {
+    const size_t head = _head.load( std::memory_order_relaxed );
+    if ( head == _tail.load( std::memory_order_acquire ) ) {
+      return {};
+    }
+    std::optional<T> value { std::move( _slots[head & _mask] ) };
+    _head.store( head + 1, std::memory_order_release );
+    return value;
+  }
+
+  //! Either side: whether the queue looked empty at the time of the call
+  bool empty() const { return _head.load( std::memory_order_acquire ) == _tail.load( std::memory_order_acquire ); }
+
+  size_t capacity() const { return _slots.size(); }
+
+private:
+  static constexpr size_t CACHE_LINE = 64;
+
+  std::vector<T> _slots;
+  size_t _mask;
+  alignas( CACHE_LINE ) std::atomic<size_t> _head { 0 }; //!< Next slot to pop; written by the consumer
+  alignas( CACHE_LINE ) std::atomic<size_t> _tail { 0 }; //!< Next slot to fill; written by the producer
+};
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "address.hh"
+#include "byte_stream.hh"
+#include "congestion_control.hh"
+#include "reassembler.hh"
 #include "wrapping_integers.hh"
 
 #include <cstddef>
@@ -11,15 +14,60 @@
 class TCPConfig
 {
 public:
-  static constexpr size_t DEFAULT_CAPACITY = 64000; //!< Default capacity
-  static constexpr size_t MAX_PAYLOAD_SIZE = 1000;  //!< Conservative max payload size for real Internet
-  static constexpr uint16_t TIMEOUT_DFLT = 1000;    //!< Default re-transmit timeout is 1 second
-  static constexpr unsigned MAX_RETX_ATTEMPTS = 8;  //!< Maximum re-transmit attempts before giving up
-
-  uint16_t rt_timeout = TIMEOUT_DFLT;      //!< Initial value of the retransmission timeout, in milliseconds
-  size_t recv_capacity = DEFAULT_CAPACITY; //!< Receive capacity, in bytes
-  size_t send_capacity = DEFAULT_CAPACITY; //!< Sender capacity, in bytes
-  Wrap32 isn { 137 };                      //!< Default initial sequence number
+  static constexpr size_t DEFAULT_CAPACITY = 64000;   //!< Default capacity
+  static constexpr size_t MAX_PAYLOAD_SIZE = 1000;    //!< Conservative max payload size for real Internet
+  static constexpr uint16_t TIMEOUT_DFLT = 1000;      //!< Default re-transmit timeout is 1 second
+  static constexpr uint16_t MIN_TIMEOUT_DFLT = 10;    //!< Default floor for an adaptive re-transmit timeout
+  static constexpr unsigned MAX_RETX_ATTEMPTS = 8;    //!< Maximum re-transmit attempts before giving up
+  static constexpr unsigned DUP_ACK_THRESHOLD = 3;    //!< Duplicate ACKs that trigger a fast retransmit
+  static constexpr uint8_t MAX_WINDOW_SHIFT = 14;     //!< Largest window scale allowed by RFC 7323
+  static constexpr uint16_t MIN_MSS = 536;            //!< Smallest segment size path MTU discovery falls back to
+  static constexpr uint16_t PMTU_BASE_MSS = 1024;     //!< Segment size path MTU discovery starts from (as Linux)
+  static constexpr unsigned PMTU_TIMEOUTS = 2;        //!< Timeouts of one segment before its size is suspected
+  static constexpr unsigned PMTU_MAX_PROBES = 3;      //!< Lost probes of one size before it is given up (RFC 4821)
+  static constexpr uint16_t PMTU_SEARCH_STEP = 8;     //!< The probe search ends this close to the size that failed
+  static constexpr unsigned PMTU_REPROBE_MS = 600000; //!< Wait before probing again above a failed size (10 min)
+  static constexpr uint16_t MAX_ACK_DELAY = 500;      //!< Longest an ACK may be delayed (RFC 1122 4.2.3.2)
+  static constexpr uint16_t MAX_CORK_DELAY = 200;     //!< Longest cork holds back a partial segment (as Linux)
+  static constexpr size_t MAX_TSO_SIZE = 65455;       //!< 65535-byte IPv4 datagram, less the largest headers
+
+  uint16_t rt_timeout = TIMEOUT_DFLT;         //!< Initial value of the retransmission timeout, in milliseconds
+  uint16_t min_rt_timeout = MIN_TIMEOUT_DFLT; //!< Lower bound of the adaptive retransmission timeout, in ms
+  size_t recv_capacity = DEFAULT_CAPACITY;    //!< Receive capacity, in bytes
+  size_t send_capacity = DEFAULT_CAPACITY;    //!< Sender capacity, in bytes
+  Wrap32 isn { 137 };                         //!< Default initial sequence number
+  uint16_t ack_delay = 0;                     //!< Delay ACKs of in-order data by up to this many ms (0: never)
+  uint16_t mss = MAX_PAYLOAD_SIZE;            //!< Largest payload per segment, advertised in the SYN
+  size_t tso_size = 0;                        //!< Payload limit of segments the device splits (TSO); 0: none
+
+  ByteStream::Storage send_storage = ByteStream::Storage::Ring;       //!< Storage mode of the outbound stream
+  ByteStream::Storage recv_storage = ByteStream::Storage::Ring;       //!< Storage mode of the inbound stream
+  Reassembler::Backend reassembler = Reassembler::Backend::Intervals; //!< How out-of-order data is held
+
+  bool fast_retransmit = false; //!< Retransmit the oldest segment after DUP_ACK_THRESHOLD duplicate ACKs
+  bool go_back_n = false;       //!< On timeout, retransmit every outstanding segment instead of only the oldest
+  bool adaptive_rto = false;    //!< Derive the retransmission timeout from measured RTT (RFC 6298)
+  bool window_scaling = false;  //!< Offer RFC 7323 window scaling, so windows can exceed 65535 bytes
+  bool sack = false;            //!< Offer selective acknowledgments (RFC 2018)
+  bool pmtu_discovery = false;  //!< Probe for the largest segment size the path carries (RFC 4821)
+  bool nagle = false;           //!< Hold back sub-MSS segments while data is unacknowledged (RFC 896)
+  bool pacing = false;          //!< Spread each window over the RTT instead of sending it in one burst
+
+  //! Congestion control algorithm; anything but None also enables fast retransmit
+  CongestionControl::Algorithm congestion_control = CongestionControl::Algorithm::None;
+
+  //! Largest segment size that fits a link MTU, leaving room for IPv4 and TCP headers and options
+  static constexpr uint16_t mss_for_mtu( uint16_t mtu ) { return mtu - 20 - 20 - 40; }
+
+  //! Smallest window scale that lets the whole receive capacity be advertised
+  uint8_t window_shift() const
+  {
+    uint8_t shift = 0;
+    while ( shift < MAX_WINDOW_SHIFT and ( uint64_t { UINT16_MAX } << shift ) < recv_capacity ) {
+      ++shift;
+    }
+    return shift;
+  }
 };
 
 //! Config for classes derived from FdAdapter
@@ -6,9 +6,11 @@
 #include "socket.hh"
 #include "tcp_config.hh"
 #include "tcp_peer.hh"
+#include "timer_wheel.hh"
 #include "tuntap_adapter.hh"
 
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <thread>
@@ -55,6 +57,9 @@ public:
   void set_reuseaddr() = delete;
   //!@}
 
+  //! Like TCP_CORK: while corked, only full-sized segments are sent
+  void set_cork( bool corked );
+
   // Return peer address from underlying datagram adapter
   const Address& peer_address() const { return _datagram_adapter.config().destination; }
 
@@ -66,6 +71,12 @@ private:
   //! Stream socket for reads and writes between owner and TCP thread
   LocalStreamSocket _thread_data;
 
+  //! eventfd the owner writes to when it needs the TCPPeer thread to notice a change (cork, abort)
+  FileDescriptor _wakeup;
+
+  //! Tell the TCPPeer thread to wake up, even if it has nothing else to do
+  void _wake();
+
   //! Set up the TCPPeer and the event loop
   void _initialize_TCP( const TCPConfig& config );
 
@@ -73,7 +84,23 @@ private:
   std::optional<TCPPeer> _tcp {};
 
   //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes)
-  EventLoop _eventloop {};
+  EventLoop _eventloop { EventLoop::Backend::Epoll };
+
+  //! Holds when the TCPPeer next needs a tick (retransmission, pacing, delayed ACK, linger), in timestamp_ms()
+  //! time. The event loop sleeps until the earliest deadline in the wheel, or indefinitely if it's empty.
+  TimerWheel _timers {};
+
+  //! Most datagrams read per wakeup, so a flood can't hold off the other rules
+  static constexpr size_t READ_BATCH = 64;
+
+  //! Segments the TCPPeer has sent since the loop last waited; written in one batch before it waits again
+  std::vector<TCPMessage> _outgoing {};
+
+  //! Send one of the TCPPeer's segments, or queue it for _flush() if the adapter takes batches
+  void _send( TCPMessage&& msg );
+
+  //! Write the queued segments
+  void _flush();
 
   //! Process events while specified condition is true
   void _tcp_loop( const std::function<bool()>& condition );
@@ -89,6 +116,8 @@ private:
 
   std::atomic_bool _abort { false }; //!< Flag used by the owner to force the TCPPeer thread to shut down
 
+  std::atomic_bool _cork { false }; //!< Set by the owner, applied to the TCPSender by the TCPPeer thread
+
   bool _inbound_shutdown { false }; //!< Has TCPMinnowSocket shut down the incoming data to the owner?
 
   bool _outbound_shutdown { false }; //!< Has the owner shut down the outbound data to the TCP connection?
@@ -98,6 +127,7 @@ private:
 
 using TCPOverIPv4MinnowSocket = TCPMinnowSocket<TCPOverIPv4OverTunFdAdapter>;
 using LossyTCPOverIPv4MinnowSocket = TCPMinnowSocket<LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>>;
+using TCPOverIPv4UringMinnowSocket = TCPMinnowSocket<TCPOverIPv4OverTunUringAdapter>;
 
 //! \class TCPMinnowSocket
 //! This class involves the simultaneous operation of two threads.
@@ -128,6 +158,9 @@ public:
   {
     TCPConfig tcp_config;
     tcp_config.rt_timeout = 100;
+    tcp_config.adaptive_rto = true;
+    tcp_config.window_scaling = true;
+    tcp_config.mss = TCPConfig::mss_for_mtu( 1500 ); // tun144 uses the Ethernet MTU
 
     FdAdapterConfig multiplexer_config;
     multiplexer_config.source = { "169.254.144.9", std::to_string( uint16_t( std::random_device()() ) ) };
@@ -4,18 +4,20 @@
 #include "parser.hh"
 #include "tun.hh"
 
+#include <algorithm>
 #include <cstddef>
 #include <exception>
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <utility>
 
-static constexpr size_t TCP_TICK_MS = 10;
+static constexpr uint64_t CONNECTION_TIMER = 0; //!< Key of the TCPPeer's deadline in the timer wheel
 
 inline uint64_t timestamp_ms()
 {
@@ -30,7 +32,24 @@ void TCPMinnowSocket<AdaptT>::_tcp_loop( const std::function<bool()>& condition
 {
   auto base_time = timestamp_ms();
   while ( condition() ) {
-    auto ret = _eventloop.wait_next_event( TCP_TICK_MS );
+    // everything the TCPPeer sent since the last wait goes out together
+    _flush();
+
+    // sleep until something happens or the TCPPeer's next deadline, whichever is first
+    if ( _tcp.has_value() ) {
+      if ( const auto deadline = _tcp->next_deadline_ms() ) {
+        _timers.schedule( CONNECTION_TIMER, base_time + deadline.value() );
+      } else {
+        _timers.cancel( CONNECTION_TIMER );
+      }
+    }
+    int timeout = -1;
+    if ( const auto next_expiry = _timers.next_expiry() ) {
+      const auto now = timestamp_ms();
+      timeout = static_cast<int>( next_expiry.value() > now ? next_expiry.value() - now : 0 );
+    }
+
+    auto ret = _eventloop.wait_next_event( timeout );
     if ( ret == EventLoop::Result::Exit or _abort ) {
       break;
     }
@@ -40,14 +59,55 @@ void TCPMinnowSocket<AdaptT>::_tcp_loop( const std::function<bool()>& condition
     }
 
     if ( _tcp.value().active() ) {
+      if ( _tcp->sender().corked() != _cork ) {
+        _tcp->set_cork( _cork, [&]( auto x ) { _send( std::move( x ) ); } );
+      }
+      // Tick on every wakeup, not just when the timer fires, so the TCPPeer's clock stays current.
       const auto next_time = timestamp_ms();
-      _tcp.value().tick( next_time - base_time, [&]( auto x ) { _datagram_adapter.write( x ); } );
+      _tcp.value().tick( next_time - base_time, [&]( auto x ) { _send( std::move( x ) ); } );
       _datagram_adapter.tick( next_time - base_time );
       base_time = next_time;
     }
+    _timers.expire( base_time );
+  }
+  _flush();
+}
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_send( TCPMessage&& msg )
+{
+  if constexpr ( TCPDatagramBatchAdapter<AdaptT> ) {
+    _outgoing.push_back( std::move( msg ) );
+  } else {
+    _datagram_adapter.write( msg );
+  }
+}
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_flush()
+{
+  if constexpr ( TCPDatagramBatchAdapter<AdaptT> ) {
+    if ( not _outgoing.empty() ) {
+      _datagram_adapter.write_batch( _outgoing );
+      _outgoing.clear();
+    }
   }
 }
 
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_wake()
+{
+  const uint64_t one = 1;
+  _wakeup.write( std::string_view { reinterpret_cast<const char*>( &one ), sizeof( one ) } );
+}
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::set_cork( bool corked )
+{
+  _cork.store( corked );
+  _wake();
+}
+
 //! \param[in] data_socket_pair is a pair of connected AF_UNIX SOCK_STREAM sockets
 //! \param[in] datagram_interface is the interface for reading and writing datagrams
 template<TCPDatagramAdapter AdaptT>
@@ -56,6 +116,7 @@ TCPMinnowSocket<AdaptT>::TCPMinnowSocket( std::pair<FileDescriptor, FileDescript
   : LocalStreamSocket( std::move( data_socket_pair.first ) )
   , _datagram_adapter( std::move( datagram_interface ) )
   , _thread_data( std::move( data_socket_pair.second ) )
+  , _wakeup( CheckSystemCall( "eventfd", ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) )
 {
   _thread_data.set_blocking( false );
   set_blocking( false );
@@ -68,7 +129,7 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
 
   // Set up the event loop
 
-  // There are three events to handle:
+  // There are four events to handle:
   //
   // 1) Incoming datagram received (needs to be given to TCPPeer::receive method)
   //
@@ -79,25 +140,57 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
   // 3) Incoming bytes reassembled by the Reassembler
   //    (needs to be read from the inbound_stream and written
   //    to the local stream socket back to the application)
+  //
+  // 4) The owner woke this thread (to apply set_cork() or to abort)
 
   // rule 1: read from filtered packet stream and dump into TCPConnection
-  _eventloop.add_rule(
-    "receive TCP segment from the network",
-    _datagram_adapter.fd(),
-    Direction::In,
-    [&] {
-      if ( auto seg = _datagram_adapter.read() ) {
-        _tcp->receive( std::move( seg.value() ), [&]( auto x ) { _datagram_adapter.write( x ); } );
-      }
+  const auto receive = [&]( std::optional<TCPMessage> seg ) {
+    if ( seg ) {
+      _tcp->receive( std::move( seg.value() ), [&]( auto x ) { _send( std::move( x ) ); } );
+    }
 
-      // debugging output:
-      if ( _thread_data.eof() and _tcp.value().sender().sequence_numbers_in_flight() == 0 and not _fully_acked ) {
-        std::cerr << "DEBUG: minnow outbound stream to " << _datagram_adapter.config().destination.to_string()
-                  << " has been fully acknowledged.\n";
-        _fully_acked = true;
-      }
-    },
-    [&] { return _tcp->active(); } );
+    // debugging output:
+    if ( _thread_data.eof() and _tcp.value().sender().sequence_numbers_in_flight() == 0 and not _fully_acked ) {
+      std::cerr << "DEBUG: minnow outbound stream to " << _datagram_adapter.config().destination.to_string()
+                << " has been fully acknowledged.\n";
+      _fully_acked = true;
+    }
+  };
+
+  if constexpr ( requires { _datagram_adapter.ring(); } ) {
+    // With io_uring, finished reads are collected by the ring's rule and queued in the adapter.
+    _eventloop.add_rule( "io_uring completions", _datagram_adapter.ring(), [&] { return _tcp->active(); } );
+    _eventloop.add_rule(
+      "receive TCP segment from the network",
+      [&, receive] {
+        while ( _datagram_adapter.pending() and _tcp->active() ) {
+          receive( _datagram_adapter.read() );
+        }
+      },
+      [&] { return _tcp->active() and _datagram_adapter.pending(); } );
+  } else if constexpr ( TCPDatagramBatchAdapter<AdaptT> ) {
+    // drain everything the device has ready, rather than one datagram per wakeup
+    _eventloop.add_rule(
+      "receive TCP segment from the network",
+      _datagram_adapter.fd(),
+      Direction::In,
+      [&, receive] {
+        for ( auto& seg : _datagram_adapter.read_batch( READ_BATCH ) ) {
+          if ( not _tcp->active() ) {
+            break;
+          }
+          receive( std::move( seg ) );
+        }
+      },
+      [&] { return _tcp->active(); } );
+  } else {
+    _eventloop.add_rule(
+      "receive TCP segment from the network",
+      _datagram_adapter.fd(),
+      Direction::In,
+      [&, receive] { receive( _datagram_adapter.read() ); },
+      [&] { return _tcp->active(); } );
+  }
 
   // rule 2: read from pipe into outbound buffer
   _eventloop.add_rule(
@@ -121,7 +214,7 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
                   << " still in flight).\n";
       }
 
-      _tcp->push( [&]( auto x ) { _datagram_adapter.write( x ); } );
+      _tcp->push( [&]( auto x ) { _send( std::move( x ) ); } );
     },
     [&] {
       return ( _tcp->active() ) and ( not _outbound_shutdown )
@@ -171,6 +264,17 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
       std::cerr << "DEBUG: minnow inbound stream had error.\n";
       _tcp->inbound_reader().set_error();
     } );
+
+  // rule 4: drain the wakeup counter (the loop then applies the new cork setting, or exits on abort)
+  _eventloop.add_rule(
+    "wake up TCPPeer thread",
+    _wakeup,
+    Direction::In,
+    [&] {
+      std::string counter( sizeof( uint64_t ), 0 );
+      _wakeup.read( counter );
+    },
+    [&] { return _tcp->active(); } );
 }
 
 //! \brief Call [socketpair](\ref man2::socketpair) and return connected Unix-domain sockets of specified type
@@ -199,6 +303,7 @@ TCPMinnowSocket<AdaptT>::~TCPMinnowSocket()
       std::cerr << "Warning: unclean shutdown of TCPMinnowSocket\n";
       // force the other side to exit
       _abort.store( true );
+      _wake();
       _tcp_thread.join();
     }
   } catch ( const std::exception& e ) {
@@ -236,7 +341,7 @@ void TCPMinnowSocket<AdaptT>::connect( const TCPConfig& c_tcp, const FdAdapterCo
     throw std::runtime_error( "TCPPeer not successfully initialized" );
   }
 
-  _tcp->push( [&]( auto x ) { _datagram_adapter.write( x ); } );
+  _tcp->push( [&]( auto x ) { _send( std::move( x ) ); } );
 
   if ( _tcp->sender().sequence_numbers_in_flight() != 1 ) {
     throw std::runtime_error( "After TCPConnection::connect(), expected sequence_numbers_in_flight() == 1" );
@@ -0,0 +1,319 @@
+#pragma once
+
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "ipv4_datagram.hh"
+#include "packet_buffer.hh"
+#include "random.hh"
+#include "socket.hh"
+#include "spsc_queue.hh"
+#include "tcp_config.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_peer.hh"
+#include "timer_wheel.hh"
+
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//! Many TCP connections served by a few threads, over one device that carries IPv4 datagrams (e.g. a TunFD) or
+//! the queues of a multi-queue one
+class TCPMinnowStack
+{
+public:
+  //! Identifies a connection: our address and port, and the remote peer's
+  struct FourTuple
+  {
+    uint32_t local_ip;
+    uint16_t local_port;
+    uint32_t remote_ip;
+    uint16_t remote_port;
+
+    bool operator==( const FourTuple& other ) const = default;
+  };
+
+  //! Take over `datagram_fd` (each read or write is one IPv4 datagram) and start the stack's threads
+  //! \param[in] shards is the number of worker threads, each serving its own share of the connections. With
+  //! more than one, an extra thread does all reads and writes of `datagram_fd`.
+  explicit TCPMinnowStack( FileDescriptor&& datagram_fd, size_t shards = 1 );
+
+  //! Take over the queues of a multi-queue device (e.g. from TunFD::open_queues()), and start one worker
+  //! thread per queue. Each worker reads and writes its own queue, with no I/O thread between them.
+  template<std::derived_from<FileDescriptor> QueueT>
+  explicit TCPMinnowStack( std::vector<QueueT>&& queues );
+
+  //! Stop the stack's threads; connections that are still open are abandoned without a RST, and threads
+  //! blocked in accept() get an exception
+  ~TCPMinnowStack();
+
+  //! Open a connection from `local` to `remote` and return the application's end of it right away.
+  //! Bytes written to the returned socket are sent once the handshake allows, and it reads EOF when the
+  //! remote peer finishes (or the connection fails).
+  LocalStreamSocket connect( const TCPConfig& config, const Address& local, const Address& remote );
+
+  static constexpr size_t DEFAULT_BACKLOG = 128;
+
+  //! Accept connections to `local` (an address of 0.0.0.0 accepts them on any address), each using `config`
+  //! with its own random ISN. At most `backlog` connections may be mid-handshake (the SYN queue) and at most
+  //! `backlog` more may be waiting for accept() (the accept queue); SYNs beyond either limit are dropped, and
+  //! the client will retry them.
+  void listen( const TCPConfig& config, const Address& local, size_t backlog = DEFAULT_BACKLOG );
+
+  //! Wait for a connection to `local` (as given to listen()) to complete its handshake
+  //! \returns the application's end of the connection, and the remote peer's address
+  std::pair<LocalStreamSocket, Address> accept( const Address& local );
+
+  //! Number of connections the stack is serving, including those still connecting or closing
+  size_t connection_count() const;
+
+  size_t shard_count() const { return _shards.size(); }
+
+  //! Receive-side scaling (RSS) hash of a connection: the Toeplitz hash that NICs use to spread flows across
+  //! queues, over the remote address, local address, remote port and local port (an incoming datagram's source
+  //! address, destination address, source port and destination port), with the usual default key
+  static uint32_t flow_hash( const FourTuple& t );
+
+  //! \name
+  //! The stack's thread refers to this object, so it cannot be moved or copied
+
+  //!@{
+  TCPMinnowStack( const TCPMinnowStack& ) = delete;
+  TCPMinnowStack( TCPMinnowStack&& ) = delete;
+  TCPMinnowStack& operator=( const TCPMinnowStack& ) = delete;
+  TCPMinnowStack& operator=( TCPMinnowStack&& ) = delete;
+  //!@}
+
+private:
+  struct FourTupleHash
+  {
+    size_t operator()( const FourTuple& t ) const noexcept;
+  };
+
+  //! One TCP connection: its TCPPeer, the adapter that (un)wraps its segments, and its end of the socket
+  //! pair shared with the application
+  struct Connection
+  {
+    Connection( uint64_t s_id,
+                const TCPConfig& config,
+                TCPOverIPv4Adapter&& s_adapter,
+                LocalStreamSocket&& s_data );
+
+    uint64_t id;                                 //!< Key of the connection's timer
+    TCPOverIPv4Adapter adapter;                  //!< Also holds the connection's window-scaling state
+    TCPPeer peer;                                //!< The TCP state machine
+    LocalStreamSocket data;                      //!< Stack's end of the socket pair
+    std::vector<EventLoop::RuleHandle> rules {}; //!< Cancelled when the connection is removed
+    uint64_t last_tick {};                       //!< timestamp_ms() the TCPPeer was last ticked to
+    bool inbound_shutdown {};  //!< Has the stack shut down the incoming data to the application?
+    bool outbound_shutdown {}; //!< Has the application shut down the outbound data?
+    bool closing {};           //!< Queued for removal
+
+    //! For an inbound connection still in its listener's SYN queue: the listener, and the application's end
+    //! of the socket pair, which accept() will hand out
+    std::optional<uint64_t> listener {};
+    std::optional<LocalStreamSocket> application {};
+  };
+
+  //! Inbound connections to one local address, shared with the threads calling accept()
+  struct Listener
+  {
+    TCPConfig config;
+    size_t backlog;
+    size_t handshaking {}; //!< Size of the SYN queue: connections that have not completed their handshake
+    std::deque<std::pair<LocalStreamSocket, Address>> accepted {}; //!< The accept queue
+  };
+
+  //! A connect() call, handed from the owner's thread to a shard's thread
+  struct ConnectRequest
+  {
+    TCPConfig config;
+    FdAdapterConfig addresses;
+    LocalStreamSocket data;
+  };
+
+  //! A device (or one queue of a multi-queue device) that carries IPv4 datagrams
+  struct Device
+  {
+    FileDescriptor fd;
+
+    //! Datagrams waiting for fd to become writable (a device that never fills, like a TUN, needs none)
+    std::deque<PacketBuffer> unsent {};
+
+    //! The rule that writes them, told when unsent stops being empty
+    std::optional<EventLoop::RuleHandle> send_rule {};
+  };
+
+  //! One worker thread and the connections it owns. A connection lives on the shard its flow_hash() picks.
+  struct Shard
+  {
+    Shard();
+
+    //! eventfd written when the shard has something new to do: connect() requests, or datagrams from the
+    //! I/O thread or from another shard's queue
+    FileDescriptor wakeup;
+
+    //! Index in _devices of the device the shard reads and writes itself, or empty if the I/O thread does that
+    std::optional<size_t> device {};
+
+    //! Asks a rule for its interest only when its fd was ready, or when _update() or _write_datagram() has
+    //! changed what it depends on, not every connection's rules on every wait
+    EventLoop eventloop { EventLoop::Backend::Epoll, EventLoop::InterestUpdates::OnDemand };
+    size_t push_category {};    //!< Category of every connection's "push bytes to TCPPeer" rule
+    size_t inbound_category {}; //!< Category of every connection's "read bytes from inbound stream" rule
+
+    //! Every connection's next deadline, keyed by Connection::id
+    TimerWheel timers {};
+
+    std::unordered_map<FourTuple, std::unique_ptr<Connection>, FourTupleHash> connections {};
+    std::unordered_map<uint64_t, FourTuple> timer_keys {}; //!< Connection::id -> key in connections
+    std::vector<FourTuple> finished {};                    //!< Removed once the current event has been handled
+    uint64_t next_id {};
+    std::default_random_engine random { get_random_engine() }; //!< Picks each inbound connection's ISN
+    uint64_t now {}; //!< timestamp_ms() when the current wait returned
+
+    std::mutex requests_mutex {};
+    std::vector<ConnectRequest> requests {}; //!< Guarded by requests_mutex
+
+    //! Datagrams for this shard's connections that arrived on another shard's queue; guarded by requests_mutex
+    std::vector<std::pair<FourTuple, InternetDatagram>> forwarded {};
+
+    //! When sharded: parsed datagrams from the I/O thread, and serialized ones for it to write
+    SPSCQueue<std::pair<FourTuple, InternetDatagram>> inbound { QUEUE_DEPTH };
+    SPSCQueue<PacketBuffer> outbound { QUEUE_DEPTH };
+    bool wrote {}; //!< Pushed onto outbound since the I/O thread was last woken
+
+    std::atomic<size_t> connection_count { 0 };
+    std::thread thread {};
+  };
+
+  static constexpr size_t QUEUE_DEPTH = 4096; //!< Datagrams each queue holds before more are dropped
+
+  //! One device, or one per shard for a multi-queue device
+  std::vector<Device> _devices {};
+
+  std::mutex _listeners_mutex {};
+  std::condition_variable _accepted {};                  //!< Signalled when an accept queue grows (or on abort)
+  std::unordered_map<uint64_t, Listener> _listeners {}; //!< Keyed by _listen_key(); guarded by _listeners_mutex
+
+  std::atomic_bool _abort { false };
+
+  std::vector<std::unique_ptr<Shard>> _shards {};
+
+  //! With more than one shard but only one device, the I/O thread alone reads and writes it: it hands each
+  //! datagram to its shard's inbound queue, and writes what the shards leave in their outbound queues.
+  FileDescriptor _io_wakeup { _new_eventfd() };
+  EventLoop _io_eventloop { EventLoop::Backend::Epoll };
+  std::vector<bool> _io_delivered {}; //!< Which shards were handed datagrams since they were last woken
+  std::thread _io_thread {};
+
+  bool _has_io_thread() const { return _devices.size() == 1 and _shards.size() > 1; }
+
+  //! Create the shards, the rules that serve the devices, and the threads
+  void _start( size_t shards );
+
+  //! Main loop of a shard's thread
+  void _shard_main( Shard& s );
+
+  //! Main loop of the I/O thread
+  void _io_main();
+
+  static FileDescriptor _new_eventfd();
+
+  //! Write one to an eventfd, waking the thread that watches it
+  static void _wake( FileDescriptor& eventfd );
+
+  //! Have `eventloop` read datagrams from `device` and pass each to `deliver`, and write its unsent datagrams
+  //! when it can
+  static void _add_device_rules( EventLoop& eventloop,
+                                 Device& device,
+                                 const std::function<void( const FourTuple&, InternetDatagram&& )>& deliver );
+
+  //! Write a datagram to a device, or queue it if the device is full
+  static void _write_datagram( Device& device, PacketBuffer&& datagram );
+
+  //! The connection a datagram is addressed to, from our side
+  static std::optional<FourTuple> _four_tuple( const InternetDatagram& dgram );
+
+  Shard& _shard_for( const FourTuple& key ) { return *_shards.at( flow_hash( key ) % _shards.size() ); }
+
+  //! Hand a datagram to the connection it belongs to, or start one if it's a SYN for a listener
+  void _deliver( Shard& s, const FourTuple& key, const InternetDatagram& dgram );
+
+  //! Pass a datagram read from another shard's queue to the shard that owns its connection
+  static void _forward( Shard& owner, const FourTuple& key, InternetDatagram&& dgram );
+
+  //! Create a connection, register its rules, and send its SYN
+  void _open( Shard& s, ConnectRequest&& request );
+
+  //! Add a connection to the shard's table and register its rules
+  Connection& _add( Shard& s,
+                    const FourTuple& key,
+                    const TCPConfig& config,
+                    TCPOverIPv4Adapter&& adapter,
+                    LocalStreamSocket&& data );
+
+  static uint64_t _listen_key( uint32_t ip, uint16_t port ) { return ( uint64_t { ip } << 16 ) | port; }
+
+  //! Start an inbound connection if `dgram` is a SYN for a listener with room in its queues
+  void _accept_syn( Shard& s, const FourTuple& key, const InternetDatagram& dgram );
+
+  //! Move an inbound connection that has completed its handshake to its listener's accept queue
+  void _establish( Connection& c );
+
+  //! Send one of a connection's segments
+  void _transmit( Shard& s, Connection& c, const TCPMessage& msg );
+
+  //! Bring a connection's clock up to the shard's time
+  void _advance( Shard& s, Connection& c );
+
+  //! After a connection has handled an event: have its rules checked, and re-arm its timer or queue it for
+  //! removal once it's done
+  void _update( Shard& s, Connection& c );
+
+  //! Remove a finished connection
+  void _remove( Shard& s, const FourTuple& key );
+};
+
+//! \class TCPMinnowStack
+//! Where a TCPMinnowSocket spends a thread and a datagram device on each connection, a TCPMinnowStack keeps
+//! its connections in hash tables keyed by their FourTuple and serves them from as few threads as asked for.
+//! Each incoming datagram is demultiplexed by its addresses and ports to the connection it belongs to (and
+//! dropped if there is none); each connection keeps its own local stream socket to the application, and its
+//! own timer in a shared TimerWheel, so a connection costs nothing while it is idle.
+//!
+//! Unlike TCPMinnowSocket::listen_and_accept(), which serves only the first SYN it sees, a listener on a
+//! TCPMinnowStack starts a new TCPPeer for each SYN to its address, and queues each connection for accept()
+//! once its handshake completes.
+//!
+//! With several shards, each has its own thread, EventLoop, TimerWheel and connection table, and shares
+//! nothing with the others but the listeners. The I/O thread parses each incoming datagram's header and ports,
+//! and passes it through a lock-free SPSCQueue to the shard that flow_hash() picks; the shards pass their
+//! outgoing datagrams back through another SPSCQueue each, and wake the I/O thread once per batch.
+//!
+//! Given the queues of a multi-queue device instead, each shard reads and writes its own queue. The kernel
+//! picks a queue for each incoming datagram by its own hash, so the first datagrams of a connection that the
+//! remote peer starts may arrive on a queue whose shard doesn't own it; that shard forwards them to the owner.
+//! Once the owner has written one of the connection's datagrams, the kernel sends the rest to the owner's queue
+//! too.
+
+template<std::derived_from<FileDescriptor> QueueT>
+TCPMinnowStack::TCPMinnowStack( std::vector<QueueT>&& queues )
+{
+  for ( auto& queue : queues ) {
+    _devices.push_back( { std::move( queue ) } );
+  }
+  _start( _devices.size() );
+}
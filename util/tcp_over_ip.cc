@@ -4,6 +4,7 @@
 #include "ipv4_header.hh"
 #include "parser.hh"
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <stdexcept>
 #include <unistd.h>
@@ -23,27 +24,57 @@ using namespace std;
 //! `_listen` flag and records the source and destination addresses and port numbers
 //! from the TCP header; it uses this information to filter future reads.
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
-optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagram& ip_dgram )
+optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagram& ip_dgram,
+                                                           const bool checksum_offload )
+{
+  Parser payload { ip_dgram.payload };
+  return _unwrap( ip_dgram.header, payload, checksum_offload );
+}
+
+//! \details As above, but the datagram is parsed where it lies, and the TCP segment is parsed from a slice of it
+optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const PacketBuffer& datagram,
+                                                           const bool checksum_offload )
+{
+  IPv4Header header;
+  Parser parser { datagram };
+  header.parse( parser );
+  if ( parser.has_error() ) {
+    return {};
+  }
+
+  PacketBuffer segment;
+  parser.all_remaining( segment );
+  Parser payload { segment };
+  return _unwrap( header, payload, checksum_offload );
+}
+
+optional<TCPMessage> TCPOverIPv4Adapter::_unwrap( const IPv4Header& header,
+                                                  Parser& payload,
+                                                  const bool checksum_offload )
 {
   // is the IPv4 datagram for us?
   // Note: it's valid to bind to address "0" (INADDR_ANY) and reply from actual address contacted
-  if ( not listening() and ( ip_dgram.header.dst != config().source.ipv4_numeric() ) ) {
+  if ( not listening() and ( header.dst != config().source.ipv4_numeric() ) ) {
     return {};
   }
 
   // is the IPv4 datagram from our peer?
-  if ( not listening() and ( ip_dgram.header.src != config().destination.ipv4_numeric() ) ) {
+  if ( not listening() and ( header.src != config().destination.ipv4_numeric() ) ) {
     return {};
   }
 
   // does the IPv4 datagram claim that its payload is a TCP segment?
-  if ( ip_dgram.header.proto != IPv4Header::PROTO_TCP ) {
+  if ( header.proto != IPv4Header::PROTO_TCP ) {
     return {};
   }
 
   // is the payload a valid TCP segment?
-  TCPSegment tcp_seg;
-  if ( not parse( tcp_seg, ip_dgram.payload, ip_dgram.header.pseudo_checksum() ) ) {
+  TCPSegment tcp_seg { .checksum_offload = checksum_offload };
+  if ( _local_window_shift.has_value() and _remote_window_shift.has_value() ) {
+    tcp_seg.window_shift = _remote_window_shift.value();
+  }
+  tcp_seg.parse( payload, header.pseudo_checksum() );
+  if ( payload.has_error() ) {
     return {};
   }
 
@@ -55,9 +86,8 @@ optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagra
   // should we target this source addr/port (and use its destination addr as our source) in reply?
   if ( listening() ) {
     if ( tcp_seg.message.sender.SYN and not tcp_seg.message.sender.RST ) {
-      config_mutable().source = Address { inet_ntoa( { htobe32( ip_dgram.header.dst ) } ), config().source.port() };
-      config_mutable().destination
-        = Address { inet_ntoa( { htobe32( ip_dgram.header.src ) } ), tcp_seg.udinfo.src_port };
+      config_mutable().source = Address { inet_ntoa( { htobe32( header.dst ) } ), config().source.port() };
+      config_mutable().destination = Address { inet_ntoa( { htobe32( header.src ) } ), tcp_seg.udinfo.src_port };
       set_listening( false );
     } else {
       return {};
@@ -69,23 +99,22 @@ optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagra
     return {};
   }
 
-  return tcp_seg.message;
+  // remember whether the peer offered window scaling (RFC 7323), and the segment size it takes
+  if ( tcp_seg.message.sender.SYN ) {
+    _remote_window_shift = tcp_seg.message.sender.window_scale;
+    _remote_mss = tcp_seg.message.sender.mss;
+  }
+
+  return move( tcp_seg.message );
 }
 
 //! Takes a TCP segment, sets port numbers as necessary, and wraps it in an IPv4 datagram
 //! \param[in] seg is the TCP segment to convert
-InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg )
+InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg, const bool checksum_offload )
 {
-  TCPSegment seg { .message = msg };
-  // set the port numbers in the TCP segment
-  seg.udinfo.src_port = config().source.port();
-  seg.udinfo.dst_port = config().destination.port();
-
-  // create an Internet Datagram and set its addresses and length
-  InternetDatagram ip_dgram;
-  ip_dgram.header.src = config().source.ipv4_numeric();
-  ip_dgram.header.dst = config().destination.ipv4_numeric();
-  ip_dgram.header.len = ip_dgram.header.hlen * 4 + 20 /* tcp header len */ + seg.message.sender.payload.size();
+  TCPSegment seg = _segment_for( msg, checksum_offload );
+  seg.message = msg; // this form serializes into a fresh string anyway
+  InternetDatagram ip_dgram { .header = _header_for( msg ) };
 
   // set payload, calculating TCP checksum using information from IP header
   seg.compute_checksum( ip_dgram.header.pseudo_checksum() );
@@ -94,3 +123,52 @@ InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg )
 
   return ip_dgram;
 }
+
+//! \details As above, but serialized in place: the payload is copied (once) into `datagram` (which should be
+//! empty), and the TCP and IPv4 headers go into its headroom.
+void TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg,
+                                         PacketBuffer& datagram,
+                                         const bool checksum_offload )
+{
+  TCPSegment seg = _segment_for( msg, checksum_offload );
+  IPv4Header header = _header_for( msg );
+  seg.serialize( msg, datagram, header.pseudo_checksum() );
+  header.compute_checksum();
+  serialize_in_front( header, datagram );
+}
+
+TCPSegment TCPOverIPv4Adapter::_segment_for( const TCPMessage& msg, const bool checksum_offload )
+{
+  TCPSegment seg { .checksum_offload = checksum_offload };
+  // set the port numbers in the TCP segment
+  seg.udinfo.src_port = config().source.port();
+  seg.udinfo.dst_port = config().destination.port();
+
+  // scale the advertised window once both SYNs have offered window scaling
+  if ( msg.sender.SYN ) {
+    _local_window_shift = msg.sender.window_scale;
+    _local_mss = msg.sender.mss;
+  }
+  if ( _local_window_shift.has_value() and _remote_window_shift.has_value() ) {
+    seg.window_shift = _local_window_shift.value();
+  }
+  return seg;
+}
+
+IPv4Header TCPOverIPv4Adapter::_header_for( const TCPMessage& msg ) const
+{
+  // set the addresses and length of the datagram that carries `msg`
+  IPv4Header header;
+  header.src = config().source.ipv4_numeric();
+  header.dst = config().destination.ipv4_numeric();
+  header.len = header.hlen * 4 + TCPSegment::header_length( msg ) + msg.sender.payload.size();
+  return header;
+}
+
+optional<uint16_t> TCPOverIPv4Adapter::segment_size() const
+{
+  if ( not _local_mss.has_value() or not _remote_mss.has_value() ) {
+    return _local_mss;
+  }
+  return min( _local_mss.value(), _remote_mss.value() );
+}
@@ -2,15 +2,47 @@
 
 #include "fd_adapter.hh"
 #include "ipv4_datagram.hh"
+#include "packet_buffer.hh"
 #include "tcp_segment.hh"
 
+#include <cstdint>
 #include <optional>
 
 //! \brief A converter from TCP segments to serialized IPv4 datagrams
 class TCPOverIPv4Adapter : public FdAdapterBase
 {
 public:
-  std::optional<TCPMessage> unwrap_tcp_in_ip( const InternetDatagram& ip_dgram );
+  //! \param[in] checksum_offload skips verifying the TCP checksum, which the device has checked
+  std::optional<TCPMessage> unwrap_tcp_in_ip( const InternetDatagram& ip_dgram, bool checksum_offload = false );
 
-  InternetDatagram wrap_tcp_in_ip( const TCPMessage& msg );
+  //! \param[in] checksum_offload leaves the TCP checksum for the device to complete
+  InternetDatagram wrap_tcp_in_ip( const TCPMessage& msg, bool checksum_offload = false );
+
+  //! The same, for a datagram in a PacketBuffer: it is parsed in place, and its payload is a slice of it
+  std::optional<TCPMessage> unwrap_tcp_in_ip( const PacketBuffer& datagram, bool checksum_offload = false );
+
+  //! The same, serialized into the (empty) `datagram`, with the headers prepended in its headroom
+  void wrap_tcp_in_ip( const TCPMessage& msg, PacketBuffer& datagram, bool checksum_offload = false );
+
+  //! Largest payload the peer takes in one segment: the smaller of the MSS options in the two SYNs (or ours
+  //! alone, if the peer's had none), or empty before our SYN
+  std::optional<uint16_t> segment_size() const;
+
+private:
+  //! Checks and bookkeeping shared by both forms of unwrap_tcp_in_ip(), given the IPv4 header and a Parser
+  //! positioned at its payload
+  std::optional<TCPMessage> _unwrap( const IPv4Header& header, Parser& payload, bool checksum_offload );
+
+  //! The header fields of the segment that carries `msg` (whose `message` is left empty, so `msg` isn't copied),
+  //! and the header of the datagram that carries it (without its checksum)
+  TCPSegment _segment_for( const TCPMessage& msg, bool checksum_offload );
+  IPv4Header _header_for( const TCPMessage& msg ) const;
+
+  //! Window scales offered in our SYN and in the peer's SYN; scaling is on only if both were offered
+  std::optional<uint8_t> _local_window_shift {};
+  std::optional<uint8_t> _remote_window_shift {};
+
+  //! MSS options of our SYN and the peer's SYN
+  std::optional<uint16_t> _local_mss {};
+  std::optional<uint16_t> _remote_mss {};
 };
@@ -7,6 +7,7 @@
 #include "tcp_sender.hh"
 #include "tcp_sender_message.hh"
 
+#include <algorithm>
 #include <functional>
 #include <optional>
 
@@ -32,8 +33,16 @@ public:
   {
     cumulative_time_ += t;
     sender_.tick( t, make_send( transmit ) );
+    if ( ack_deadline_.has_value() and cumulative_time_ >= ack_deadline_.value() ) {
+      send( sender_.make_empty_message(), transmit );
+    }
   }
   bool has_ackno() const { return receiver_.send().ackno.has_value(); }
+  void set_cork( bool corked, const TransmitFunction& transmit )
+  {
+    sender_.set_cork( corked );
+    push( transmit );
+  }
 
   /* Is the peer still active? */
   bool active() const
@@ -47,6 +56,29 @@ public:
     return ( not any_errors ) and ( sender_active or receiver_active or lingering );
   }
 
+  /* How long until tick() has work to do: a retransmission, a paced segment, a delayed ACK, or the end of
+     lingering. Empty if nothing is scheduled, in which case only a new segment or new data can change that. */
+  std::optional<uint64_t> next_deadline_ms() const
+  {
+    auto deadline = sender_.next_deadline_ms();
+    const auto consider = [&]( uint64_t when ) {
+      const uint64_t remaining = when > cumulative_time_ ? when - cumulative_time_ : 0;
+      deadline = std::min( deadline.value_or( remaining ), remaining );
+    };
+
+    if ( ack_deadline_.has_value() ) {
+      consider( ack_deadline_.value() );
+    }
+
+    // Only the linger timer keeps a peer with finished streams active.
+    const bool streams_finished = not sender_.sequence_numbers_in_flight() and sender_.reader().is_finished()
+                                  and receiver_.writer().is_closed();
+    if ( active() and streams_finished and linger_after_streams_finish_ ) {
+      consider( time_of_last_receipt_ + 10UL * cfg_.rt_timeout );
+    }
+    return deadline;
+  }
+
   void receive( TCPMessage msg, const TransmitFunction& transmit )
   {
     if ( not active() ) {
@@ -69,11 +101,25 @@ public:
       linger_after_streams_finish_ = false;
     }
 
+    // Limit our segments to what the peer said it can accept.
+    if ( msg.sender.SYN and msg.sender.mss.has_value() ) {
+      sender_.set_peer_mss( msg.sender.mss.value() );
+    }
+
     // Give incoming TCPSenderMessage to receiver.
+    const auto ackno_before = receiver_.send().ackno;
+    const uint64_t payload_size = msg.sender.payload.size();
+    const bool carries_data = msg.sender.sequence_length() > 0;
+    const bool data_only = payload_size > 0 and not msg.sender.SYN and not msg.sender.FIN and not msg.sender.RST;
     receiver_.receive( std::move( msg.sender ) );
 
-    // Give incoming TCPReceiverMessage to sender.
-    sender_.receive( msg.receiver );
+    // Let the ACK for in-order data wait for more data or a reply to ride on.
+    if ( need_send_ and data_only and delay_ack( ackno_before, payload_size ) ) {
+      need_send_ = false;
+    }
+
+    // Give incoming TCPReceiverMessage to sender. An ACK riding on data is never a duplicate ACK.
+    sender_.receive( msg.receiver, carries_data );
 
     // Send reply if needed.
     push( transmit );
@@ -88,16 +134,53 @@ public:
 
 private:
   TCPConfig cfg_;
-  TCPSender sender_ { ByteStream { cfg_.send_capacity }, cfg_.isn, cfg_.rt_timeout };
-  TCPReceiver receiver_ { Reassembler { ByteStream { cfg_.recv_capacity } } };
+  TCPSender sender_ { ByteStream { cfg_.send_capacity, cfg_.send_storage }, cfg_ };
+  TCPReceiver receiver_ { Reassembler { ByteStream { cfg_.recv_capacity, cfg_.recv_storage }, cfg_.reassembler },
+                          cfg_.window_scaling ? std::optional { cfg_.window_shift() } : std::nullopt,
+                          cfg_.sack };
 
   bool need_send_ {};
 
+  // Delayed ACKs (RFC 1122 4.2.3.2, RFC 5681 4.2)
+  uint64_t unacked_bytes_ {};               // in-order bytes received since our last ACK
+  std::optional<uint64_t> ack_deadline_ {}; // when a delayed ACK must go out, if one is pending
+
+  // Can the ACK for this segment wait? Only when it was in order, left no gap behind, and less than two
+  // full-sized segments (of the MSS negotiated in the SYNs) have gone unacknowledged.
+  bool delay_ack( std::optional<Wrap32> ackno_before, uint64_t payload_size )
+  {
+    const auto ackno = receiver_.send().ackno;
+    if ( cfg_.ack_delay == 0 or not ackno_before.has_value() or not ackno.has_value()
+         or ackno.value() != ackno_before.value() + static_cast<uint32_t>( payload_size )
+         or receiver_.reassembler().bytes_pending() > 0 ) {
+      return false;
+    }
+    unacked_bytes_ += payload_size;
+    if ( unacked_bytes_ >= 2UL * sender_.negotiated_mss() ) {
+      return false;
+    }
+    if ( not ack_deadline_.has_value() ) {
+      ack_deadline_ = cumulative_time_ + std::min( cfg_.ack_delay, TCPConfig::MAX_ACK_DELAY );
+    }
+    return true;
+  }
+
   void send( const TCPSenderMessage& sender_message, const TransmitFunction& transmit )
   {
     TCPMessage msg { sender_message, receiver_.send() };
+    // A SYN-ACK only offers what the peer's SYN offered (RFC 7323 2.2, RFC 2018 2)
+    const bool syn_ack = msg.sender.SYN and msg.receiver.ackno.has_value();
+    if ( msg.sender.SYN and cfg_.window_scaling and ( not syn_ack or receiver_.peer_scales() ) ) {
+      msg.sender.window_scale = cfg_.window_shift();
+    }
+    msg.sender.sack_permitted = msg.sender.SYN and cfg_.sack and ( not syn_ack or receiver_.peer_sack() );
+    if ( msg.sender.SYN ) {
+      msg.sender.mss = cfg_.mss;
+    }
     transmit( std::move( msg ) );
     need_send_ = false;
+    unacked_bytes_ = 0; // every segment carries the latest ACK
+    ack_deadline_.reset();
   }
 
   bool linger_after_streams_finish_ { true }; // one peer may need to linger to make sure all closure conditions met
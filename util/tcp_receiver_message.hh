@@ -2,26 +2,38 @@
 
 #include "wrapping_integers.hh"
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <utility>
+#include <vector>
 
 /*
  * The TCPReceiverMessage structure contains the information sent from a TCP receiver to its sender.
  *
- * It contains three fields:
+ * It contains four fields:
  *
  * 1) The acknowledgment number (ackno): the *next* sequence number needed by the TCP Receiver.
  *    This is an optional field that is empty if the TCPReceiver hasn't yet received the Initial Sequence Number.
  *
  * 2) The window size. This is the number of sequence numbers that the TCP receiver is interested
- *    to receive, starting from the ackno if present. The maximum value is 65,535 (UINT16_MAX from
- *    the <cstdint> header).
+ *    to receive, starting from the ackno if present. This is the true window in bytes: the TCP header
+ *    only has 16 bits for it, so values above 65,535 (UINT16_MAX from the <cstdint> header) require
+ *    RFC 7323 window scaling to have been negotiated, and are then a multiple of the scale factor.
  *
- * 3) The RST (reset) flag. If set, the stream has suffered an error and the connection should be aborted.
+ * 3) The SACK blocks (RFC 2018): up to MAX_SACK_BLOCKS [begin, end) ranges of sequence numbers beyond the
+ *    ackno that the receiver already holds. The first block contains the most recently received segment.
+ *    Only sent once both SYNs carried the SACK-permitted option.
+ *
+ * 4) The RST (reset) flag. If set, the stream has suffered an error and the connection should be aborted.
  */
 
 struct TCPReceiverMessage
 {
   std::optional<Wrap32> ackno {};
-  uint16_t window_size {};
+  uint32_t window_size {};
+  std::vector<std::pair<Wrap32, Wrap32>> sack {};
   bool RST {};
+
+  static constexpr size_t MAX_SACK_BLOCKS = 4; // what fits in the 40 bytes of TCP options
 };
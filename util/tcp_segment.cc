@@ -1,86 +1,269 @@
 #include "tcp_segment.hh"
 #include "checksum.hh"
+#include "tcp_config.hh"
 #include "wrapping_integers.hh"
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
+#include <initializer_list>
+#include <span>
 
-static constexpr uint32_t TCPHeaderMinLen = 5; // 32-bit words
+static constexpr uint32_t TCPHeaderMinLen = 5;  // 32-bit words
+static constexpr size_t TCPChecksumOffset = 16; // bytes from the start of the header
+
+// TCP option kinds
+static constexpr uint8_t TCPOptionEnd = 0;
+static constexpr uint8_t TCPOptionNop = 1;
+static constexpr uint8_t TCPOptionMSS = 2;
+static constexpr uint8_t TCPOptionWindowScale = 3;
+static constexpr uint8_t TCPOptionSackPermitted = 4;
+static constexpr uint8_t TCPOptionSack = 5;
 
 using namespace std;
 
-void TCPSegment::parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum )
+namespace {
+uint32_t read_uint32( string_view bytes )
 {
-  /* verify checksum */
-  InternetChecksum check { datagram_layer_pseudo_checksum };
-  check.add( parser.buffer() );
-  if ( check.value() ) {
-    parser.set_error();
-    return;
+  uint32_t ret = 0;
+  for ( const char c : bytes.substr( 0, 4 ) ) {
+    ret = ret << 8 | static_cast<uint8_t>( c );
   }
+  return ret;
+}
+} // namespace
 
-  uint32_t raw32 {};
-  uint16_t raw16 {};
-  uint8_t octet {};
+class Wrap32Serializable : public Wrap32
+{
+public:
+  uint32_t raw_value() const { return raw_value_; }
+};
 
-  parser.integer( udinfo.src_port );
-  parser.integer( udinfo.dst_port );
+void TCPSegment::parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum )
+{
+  /* verify checksum */
+  if ( not checksum_offload ) {
+    InternetChecksum check { datagram_layer_pseudo_checksum };
+    parser.input().for_each( [&]( string_view buffer ) { check.add( buffer ); } );
+    if ( check.value() ) {
+      parser.set_error();
+      return;
+    }
+  }
 
-  parser.integer( raw32 );
-  message.sender.seqno = Wrap32 { raw32 };
+  const auto header = parser.header<TCPHeaderMinLen * 4>();
+  if ( parser.has_error() ) {
+    return;
+  }
 
-  parser.integer( raw32 );
-  message.receiver.ackno = Wrap32 { raw32 };
+  udinfo.src_port = read_big_endian<uint16_t>( header.subspan<0>() );
+  udinfo.dst_port = read_big_endian<uint16_t>( header.subspan<2>() );
+  message.sender.seqno = Wrap32 { read_big_endian<uint32_t>( header.subspan<4>() ) };
+  message.receiver.ackno = Wrap32 { read_big_endian<uint32_t>( header.subspan<8>() ) };
 
-  parser.integer( octet );
-  const uint8_t data_offset = octet >> 4;
+  const uint8_t data_offset = static_cast<uint8_t>( header[12] ) >> 4;
 
-  parser.integer( octet ); // flags
-  if ( not( octet & 0b0001'0000 ) ) {
+  const uint8_t flags = header[13];
+  if ( not( flags & 0b0001'0000 ) ) {
     message.receiver.ackno.reset(); // no ACK
   }
 
-  message.sender.RST = message.receiver.RST = octet & 0b0000'0100;
-  message.sender.SYN = octet & 0b0000'0010;
-  message.sender.FIN = octet & 0b0000'0001;
+  message.sender.RST = message.receiver.RST = flags & 0b0000'0100;
+  message.sender.SYN = flags & 0b0000'0010;
+  message.sender.FIN = flags & 0b0000'0001;
 
-  parser.integer( message.receiver.window_size );
-  parser.integer( udinfo.cksum );
-  parser.integer( raw16 ); // urgent pointer
+  const uint16_t window = read_big_endian<uint16_t>( header.subspan<14>() );
+  udinfo.cksum = read_big_endian<uint16_t>( header.subspan<TCPChecksumOffset>() );
+  // (the urgent pointer is ignored)
 
-  // skip any options or anything extra in the header
+  // parse any options in the rest of the header
   if ( data_offset < TCPHeaderMinLen ) {
     parser.set_error();
+    return;
   }
-  parser.remove_prefix( data_offset * 4 - TCPHeaderMinLen * 4 );
+  array<char, MAX_OPTIONS_LEN> options {};
+  const span<char> present = span { options }.first( ( data_offset - TCPHeaderMinLen ) * 4 );
+  parser.string( present );
+  if ( parser.has_error() ) {
+    return;
+  }
+  parse_options( { present.data(), present.size() } );
+
+  const uint8_t shift = message.sender.SYN ? 0 : window_shift;
+  message.receiver.window_size = uint32_t { window } << shift;
 
   parser.all_remaining( message.sender.payload );
 }
 
-class Wrap32Serializable : public Wrap32
+void TCPSegment::parse_options( string_view options )
 {
-public:
-  uint32_t raw_value() const { return raw_value_; }
-};
+  while ( not options.empty() ) {
+    const uint8_t kind = options.front();
+    if ( kind == TCPOptionEnd ) {
+      break;
+    }
+    if ( kind == TCPOptionNop ) {
+      options.remove_prefix( 1 );
+      continue;
+    }
+
+    // every other option is kind, length (including these two bytes), value
+    if ( options.size() < 2 ) {
+      break;
+    }
+    const uint8_t len = options.at( 1 );
+    if ( len < 2 or len > options.size() ) {
+      break; // malformed: ignore the rest of the options
+    }
+    const string_view value = options.substr( 2, len - 2 );
+
+    if ( kind == TCPOptionMSS and value.size() == 2 and message.sender.SYN ) {
+      message.sender.mss = static_cast<uint16_t>( read_uint32( value ) ); // only two bytes are present
+    } else if ( kind == TCPOptionWindowScale and value.size() == 1 and message.sender.SYN ) {
+      // RFC 7323 2.3: treat a shift above 14 as 14
+      message.sender.window_scale = min( static_cast<uint8_t>( value.front() ), TCPConfig::MAX_WINDOW_SHIFT );
+    } else if ( kind == TCPOptionSackPermitted and value.empty() and message.sender.SYN ) {
+      message.sender.sack_permitted = true;
+    } else if ( kind == TCPOptionSack and value.size() % 8 == 0 ) {
+      for ( size_t i = 0; i < value.size(); i += 8 ) {
+        message.receiver.sack.emplace_back( Wrap32 { read_uint32( value.substr( i ) ) },
+                                            Wrap32 { read_uint32( value.substr( i + 4 ) ) } );
+      }
+    }
+
+    options.remove_prefix( len );
+  }
+}
+
+size_t TCPSegment::syn_options_len( const TCPMessage& msg )
+{
+  if ( not msg.sender.SYN ) {
+    return 0;
+  }
+  return ( msg.sender.mss.has_value() ? 4 : 0 ) + ( msg.sender.window_scale.has_value() ? 4 : 0 )
+         + ( msg.sender.sack_permitted ? 4 : 0 );
+}
+
+size_t TCPSegment::sack_blocks( const TCPMessage& msg )
+{
+  const size_t room = ( MAX_OPTIONS_LEN - syn_options_len( msg ) - 4 ) / 8; // after the two NOPs, kind and length
+  return min( { msg.receiver.sack.size(), TCPReceiverMessage::MAX_SACK_BLOCKS, room } );
+}
+
+TCPSegment::Options TCPSegment::serialize_options( const TCPMessage& msg )
+{
+  Options options;
+  const auto append = [&]( initializer_list<char> bytes ) {
+    ranges::copy( bytes, options.bytes.begin() + static_cast<ptrdiff_t>( options.size ) );
+    options.size += bytes.size();
+  };
+  const auto append_uint32 = [&]( uint32_t val ) {
+    append( { static_cast<char>( val >> 24 ),
+              static_cast<char>( val >> 16 ),
+              static_cast<char>( val >> 8 ),
+              static_cast<char>( val ) } );
+  };
+
+  if ( msg.sender.SYN and msg.sender.mss.has_value() ) {
+    append( { static_cast<char>( TCPOptionMSS ),
+              4,
+              static_cast<char>( msg.sender.mss.value() >> 8 ),
+              static_cast<char>( msg.sender.mss.value() & 0xff ) } );
+  }
+  if ( msg.sender.SYN and msg.sender.window_scale.has_value() ) {
+    append( { static_cast<char>( TCPOptionNop ),
+              static_cast<char>( TCPOptionWindowScale ),
+              3,
+              static_cast<char>( msg.sender.window_scale.value() ) } );
+  }
+  if ( msg.sender.SYN and msg.sender.sack_permitted ) {
+    append( { static_cast<char>( TCPOptionNop ),
+              static_cast<char>( TCPOptionNop ),
+              static_cast<char>( TCPOptionSackPermitted ),
+              2 } );
+  }
+  const size_t blocks = sack_blocks( msg );
+  if ( blocks > 0 ) {
+    append( { static_cast<char>( TCPOptionNop ),
+              static_cast<char>( TCPOptionNop ),
+              static_cast<char>( TCPOptionSack ),
+              static_cast<char>( 2 + blocks * 8 ) } );
+    for ( size_t i = 0; i < blocks; ++i ) {
+      append_uint32( Wrap32Serializable { msg.receiver.sack[i].first }.raw_value() );
+      append_uint32( Wrap32Serializable { msg.receiver.sack[i].second }.raw_value() );
+    }
+  }
+  return options; // every option above is already a multiple of 4 bytes
+}
+
+uint64_t TCPSegment::header_length( const TCPMessage& msg )
+{
+  // the length of what serialize_options() writes, without writing it
+  const size_t blocks = sack_blocks( msg );
+  return TCPHeaderMinLen * 4 + syn_options_len( msg ) + ( blocks > 0 ? 4 + blocks * 8 : 0 );
+}
 
 void TCPSegment::serialize( Serializer& serializer ) const
+{
+  const Options options = serialize_options( message );
+  serialize_header( serializer, message, options.view() );
+  serializer.buffer( message.sender.payload );
+}
+
+void TCPSegment::serialize( const TCPMessage& msg, PacketBuffer& buffer, uint32_t datagram_layer_pseudo_checksum )
+{
+  buffer.append( msg.sender.payload );
+  const Options options = serialize_options( msg );
+  const span<char> header = buffer.prepend( TCPHeaderMinLen * 4 + options.size );
+
+  if ( checksum_offload ) {
+    compute_checksum( datagram_layer_pseudo_checksum ); // only the pseudo-header sum, for the device
+  } else {
+    udinfo.cksum = 0;
+  }
+  Serializer s { header };
+  serialize_header( s, msg, options.view() );
+  if ( checksum_offload ) {
+    return;
+  }
+
+  // checksum the header and payload where they lie, then fill in the checksum
+  InternetChecksum check { datagram_layer_pseudo_checksum };
+  check.add( buffer.view() );
+  udinfo.cksum = check.value();
+  Serializer cksum { header.subspan( TCPChecksumOffset, sizeof( udinfo.cksum ) ) };
+  cksum.integer( udinfo.cksum );
+}
+
+void TCPSegment::serialize_header( Serializer& serializer, const TCPMessage& msg, string_view options ) const
 {
   serializer.integer( udinfo.src_port );
   serializer.integer( udinfo.dst_port );
-  serializer.integer( Wrap32Serializable { message.sender.seqno }.raw_value() );
-  serializer.integer( Wrap32Serializable { message.receiver.ackno.value_or( Wrap32 { 0 } ) }.raw_value() );
-  serializer.integer( uint8_t { TCPHeaderMinLen << 4 } ); // data offset
-  const bool reset = message.sender.RST or message.receiver.RST;
-  const uint8_t flags = ( message.receiver.ackno.has_value() ? 0b0001'0000U : 0 ) | ( reset ? 0b0000'0100U : 0 )
-                        | ( message.sender.SYN ? 0b0000'0010U : 0 ) | ( message.sender.FIN ? 0b0000'0001U : 0 );
+  serializer.integer( Wrap32Serializable { msg.sender.seqno }.raw_value() );
+  serializer.integer( Wrap32Serializable { msg.receiver.ackno.value_or( Wrap32 { 0 } ) }.raw_value() );
+  const uint8_t data_offset = TCPHeaderMinLen + options.size() / 4;
+  serializer.integer( static_cast<uint8_t>( data_offset << 4 ) );
+  const bool reset = msg.sender.RST or msg.receiver.RST;
+  const uint8_t flags = ( msg.receiver.ackno.has_value() ? 0b0001'0000U : 0 ) | ( reset ? 0b0000'0100U : 0 )
+                        | ( msg.sender.SYN ? 0b0000'0010U : 0 ) | ( msg.sender.FIN ? 0b0000'0001U : 0 );
   serializer.integer( flags );
-  serializer.integer( message.receiver.window_size );
+  const uint8_t shift = msg.sender.SYN ? 0 : window_shift;
+  const uint32_t window = min( msg.receiver.window_size >> shift, uint32_t { UINT16_MAX } );
+  serializer.integer( static_cast<uint16_t>( window ) );
   serializer.integer( udinfo.cksum );
   serializer.integer( uint16_t { 0 } ); // urgent pointer
-  serializer.buffer( message.sender.payload );
+  for ( const char c : options ) {
+    serializer.integer( static_cast<uint8_t>( c ) );
+  }
 }
 
 void TCPSegment::compute_checksum( uint32_t datagram_layer_pseudo_checksum )
 {
+  if ( checksum_offload ) {
+    udinfo.cksum = static_cast<uint16_t>( ~InternetChecksum { datagram_layer_pseudo_checksum }.value() );
+    return;
+  }
+
   udinfo.cksum = 0;
   Serializer s;
   serialize( s );
@@ -5,6 +5,10 @@
 #include "tcp_sender_message.hh"
 #include "udinfo.hh"
 
+#include <array>
+#include <cstdint>
+#include <string>
+
 struct TCPMessage
 {
   TCPSenderMessage sender {};
@@ -16,8 +20,43 @@ struct TCPSegment
   TCPMessage message {};
   UserDatagramInfo udinfo {};
 
+  // Window scale in effect for this connection (RFC 7323). The 16-bit window field of a non-SYN segment
+  // holds window_size >> window_shift; SYN segments are never scaled.
+  uint8_t window_shift {};
+
+  // Set when the device takes care of the checksum (a virtio-net header's NEEDS_CSUM): parse() doesn't verify
+  // it, and compute_checksum() leaves only the pseudo-header sum in the field, for the device to complete.
+  bool checksum_offload {};
+
   void parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum );
   void serialize( Serializer& serializer ) const;
 
+  // Serialize `msg` into `buffer` (which should be empty) with the header in its headroom, so that the lower
+  // layers can prepend theirs in place, and fill in the checksum there as compute_checksum() would. The message
+  // is read where it lies (`message` is not used), so its payload is copied only once, into `buffer`.
+  void serialize( const TCPMessage& msg, PacketBuffer& buffer, uint32_t datagram_layer_pseudo_checksum );
+
   void compute_checksum( uint32_t datagram_layer_pseudo_checksum );
+
+  // Length of the TCP header including options, in bytes
+  uint64_t header_length() const { return header_length( message ); }
+  static uint64_t header_length( const TCPMessage& msg );
+
+private:
+  static constexpr size_t MAX_OPTIONS_LEN = 40; // bytes, with the largest data offset (15 words)
+
+  // Options padded to a multiple of 4 bytes, built on the stack
+  struct Options
+  {
+    std::array<char, MAX_OPTIONS_LEN> bytes {};
+    size_t size {};
+
+    std::string_view view() const { return { bytes.data(), size }; }
+  };
+
+  void parse_options( std::string_view options );
+  void serialize_header( Serializer& serializer, const TCPMessage& msg, std::string_view options ) const;
+  static Options serialize_options( const TCPMessage& msg );
+  static size_t syn_options_len( const TCPMessage& msg ); // MSS, window scale and SACK-permitted
+  static size_t sack_blocks( const TCPMessage& msg );     // as many as fit after the SYN options
 };
@@ -2,12 +2,14 @@
 
 #include "wrapping_integers.hh"
 
+#include <cstdint>
+#include <optional>
 #include <string>
 
 /*
  * The TCPSenderMessage structure contains the information sent from a TCP sender to its receiver.
  *
- * It contains five fields:
+ * It contains eight fields:
  *
  * 1) The sequence number (seqno) of the beginning of the segment. If the SYN flag is set, this is the
  *    sequence number of the SYN flag. Otherwise, it's the sequence number of the beginning of the payload.
@@ -20,6 +22,16 @@
  * 4) The FIN flag. If set, the payload represents the ending of the byte stream.
  *
  * 5) The RST (reset) flag. If set, the stream has suffered an error and the connection should be aborted.
+ *
+ * 6) The window scale option (RFC 7323), only meaningful alongside SYN. If present, the peer is willing to
+ *    scale windows, and will itself advertise windows in units of 2^window_scale bytes once both SYNs
+ *    carried the option.
+ *
+ * 7) The SACK-permitted option (RFC 2018), only meaningful alongside SYN. If set, the peer can both send
+ *    and make use of SACK blocks once both SYNs carried the option.
+ *
+ * 8) The maximum segment size option (RFC 9293 3.7.1), only meaningful alongside SYN. If present, it is the
+ *    largest payload the peer is willing to receive in one segment.
  */
 
 struct TCPSenderMessage
@@ -32,6 +44,10 @@ struct TCPSenderMessage
 
   bool RST {};
 
+  std::optional<uint8_t> window_scale {};
+  bool sack_permitted {};
+  std::optional<uint16_t> mss {};
+
   // How many sequence numbers does this segment use?
   size_t sequence_length() const { return SYN + payload.size() + FIN; }
 };
@@ -0,0 +1,129 @@
+#include "timer_wheel.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+TimerWheel::Slot& TimerWheel::_slot_for( uint64_t deadline )
+{
+  if ( deadline <= _now ) {
+    return _due;
+  }
+
+  // the lowest level whose current rotation (the bits above it) already matches the deadline
+  for ( size_t level = 0; level < LEVELS; level++ ) {
+    const unsigned shift = SLOT_BITS * level;
+    if ( ( deadline >> ( shift + SLOT_BITS ) ) == ( _now >> ( shift + SLOT_BITS ) ) ) {
+      return _wheel.at( level ).at( ( deadline >> shift ) & ( SLOTS - 1 ) );
+    }
+  }
+  return _overflow;
+}
+
+void TimerWheel::_place( uint64_t key, uint64_t deadline )
+{
+  Slot& slot = _slot_for( deadline );
+  slot.push_back( { key, deadline } );
+  _index[key] = { &slot, prev( slot.end() ) };
+}
+
+void TimerWheel::_take( Slot& slot, vector<Timer>& out )
+{
+  for ( const auto& timer : slot ) {
+    out.push_back( timer );
+    _index.erase( timer.key );
+  }
+  slot.clear();
+}
+
+void TimerWheel::schedule( uint64_t key, uint64_t deadline_ms )
+{
+  cancel( key );
+  _place( key, deadline_ms );
+}
+
+void TimerWheel::cancel( uint64_t key )
+{
+  const auto it = _index.find( key );
+  if ( it == _index.end() ) {
+    return;
+  }
+  it->second.slot->erase( it->second.timer );
+  _index.erase( it );
+}
+
+vector<uint64_t> TimerWheel::expire( uint64_t now_ms )
+{
+  vector<Timer> pending;
+  _take( _due, pending );
+
+  if ( now_ms > _now ) {
+    // Collect every slot the clock passes over. If a level hasn't moved, no level above it has either.
+    for ( size_t level = 0; level < LEVELS; level++ ) {
+      const unsigned shift = SLOT_BITS * level;
+      const uint64_t from = _now >> shift;
+      const uint64_t to = now_ms >> shift;
+      if ( from == to ) {
+        break;
+      }
+      const uint64_t steps = min<uint64_t>( to - from, SLOTS );
+      for ( uint64_t i = 1; i <= steps; i++ ) {
+        _take( _wheel.at( level ).at( ( from + i ) & ( SLOTS - 1 ) ), pending );
+      }
+    }
+    if ( ( _now >> ( SLOT_BITS * LEVELS ) ) != ( now_ms >> ( SLOT_BITS * LEVELS ) ) ) {
+      _take( _overflow, pending );
+    }
+    _now = now_ms;
+  }
+
+  // Timers that aren't due yet cascade into a lower level.
+  vector<Timer> fired;
+  for ( const auto& timer : pending ) {
+    if ( timer.deadline <= _now ) {
+      fired.push_back( timer );
+    } else {
+      _place( timer.key, timer.deadline );
+    }
+  }
+
+  stable_sort( fired.begin(), fired.end(), []( const Timer& a, const Timer& b ) {
+    return a.deadline < b.deadline;
+  } );
+  vector<uint64_t> keys;
+  keys.reserve( fired.size() );
+  for ( const auto& timer : fired ) {
+    keys.push_back( timer.key );
+  }
+  return keys;
+}
+
+optional<uint64_t> TimerWheel::next_expiry() const
+{
+  if ( not _due.empty() ) {
+    return _now;
+  }
+
+  const auto earliest = []( const Slot& slot ) {
+    return min_element( slot.begin(), slot.end(), []( const Timer& a, const Timer& b ) {
+             return a.deadline < b.deadline;
+           } )->deadline;
+  };
+
+  // Every timer in a level is due before any timer in the levels above it, and within a level the slots
+  // ahead of the clock are in deadline order.
+  for ( size_t level = 0; level < LEVELS; level++ ) {
+    const uint64_t current = ( _now >> ( SLOT_BITS * level ) ) & ( SLOTS - 1 );
+    for ( uint64_t i = current + 1; i < SLOTS; i++ ) {
+      const Slot& slot = _wheel.at( level ).at( i );
+      if ( not slot.empty() ) {
+        return earliest( slot );
+      }
+    }
+  }
+
+  if ( not _overflow.empty() ) {
+    return earliest( _overflow );
+  }
+  return {};
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+//! Hierarchical timing wheel holding one deadline per key, with millisecond resolution.
+//! \details Level 0 has one slot per millisecond; each higher level has slots 64 times as wide. A timer
+//! lives in the lowest level whose current rotation contains its deadline, and moves down a level each time
+//! the wheel's clock reaches its slot. Scheduling and cancelling are O(1), each timer moves at most once per
+//! level before it fires, and finding the next deadline is O(levels * slots) however many timers are armed.
+class TimerWheel
+{
+public:
+  //! \param[in] now_ms is the wheel's starting time
+  explicit TimerWheel( uint64_t now_ms = 0 ) : _now( now_ms ) {}
+
+  //! Arm the timer for `key`, replacing any deadline it already had. A deadline in the past fires on the next
+  //! call to expire().
+  void schedule( uint64_t key, uint64_t deadline_ms );
+
+  //! Disarm the timer for `key` (no effect if it isn't armed)
+  void cancel( uint64_t key );
+
+  //! Advance the wheel's clock to `now_ms` and disarm every timer due by then
+  //! \returns the keys of those timers, earliest deadline first
+  std::vector<uint64_t> expire( uint64_t now_ms );
+
+  //! Deadline of the earliest armed timer, or empty if none is armed
+  std::optional<uint64_t> next_expiry() const;
+
+  size_t size() const { return _index.size(); } //!< Number of armed timers
+  uint64_t now() const { return _now; }         //!< Time the wheel was last advanced to
+
+private:
+  static constexpr unsigned SLOT_BITS = 6;
+  static constexpr size_t SLOTS = 1 << SLOT_BITS;
+  static constexpr size_t LEVELS = 4; //!< covers 2^24 ms (about 4.6 hours) before a timer overflows
+
+  struct Timer
+  {
+    uint64_t key;
+    uint64_t deadline;
+  };
+
+  using Slot = std::list<Timer>;
+
+  //! Where a key's timer is stored, so it can be cancelled without a search
+  struct Location
+  {
+    Slot* slot {};
+    Slot::iterator timer {};
+  };
+
+  std::array<std::array<Slot, SLOTS>, LEVELS> _wheel {};
+  Slot _due {};      //!< Timers whose deadline had already passed when they were scheduled
+  Slot _overflow {}; //!< Timers beyond the top level's current rotation
+  std::unordered_map<uint64_t, Location> _index {};
+  uint64_t _now;
+
+  //! The slot a timer belongs in, given the current time
+  Slot& _slot_for( uint64_t deadline );
+
+  //! Store a timer in the slot for its deadline and index it
+  void _place( uint64_t key, uint64_t deadline );
+
+  //! Move every timer in `slot` onto `out`, removing them from the index
+  void _take( Slot& slot, std::vector<Timer>& out );
+};
@@ -14,20 +14,30 @@ using namespace std;
 //! \param[in] devname is the name of the TUN or TAP device, specified at its creation.
 //! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device (expects
 //! Ethernet frames)
+//! \param[in] multi_queue attaches one more queue of a device created with `multi_queue`
+//! \param[in] vnet_hdr puts a virtio-net header before each datagram, and lets the kernel hand over (and take)
+//! datagrams whose TCP checksum is left to the device, and TCP datagrams of up to 64 KiB that are to be split
+//! into segments (TSO/GSO)
 //!
 //! To create a TUN device, you should already have run
 //!
 //!     ip tuntap add mode tun user `username` name `devname`
 //!
-//! as root before calling this function.
+//! (adding `multi_queue` for a multi-queue device) as root before calling this function.
 
-TunTapFD::TunTapFD( const string& devname, const bool is_tun )
-  : FileDescriptor( ::CheckSystemCall( "open", open( CLONEDEV, O_RDWR | O_CLOEXEC ) ) )
+TunTapFD::TunTapFD( const string& devname, const bool is_tun, const bool multi_queue, const bool vnet_hdr )
+  : FileDescriptor( ::CheckSystemCall( "open", open( CLONEDEV, O_RDWR | O_CLOEXEC ) ) ), _vnet_hdr( vnet_hdr )
 {
   struct ifreq tun_req
   {};
 
   tun_req.ifr_flags = static_cast<int16_t>( ( is_tun ? IFF_TUN : IFF_TAP ) | IFF_NO_PI ); // no packetinfo
+  if ( multi_queue ) {
+    tun_req.ifr_flags = static_cast<int16_t>( tun_req.ifr_flags | IFF_MULTI_QUEUE );
+  }
+  if ( vnet_hdr ) {
+    tun_req.ifr_flags = static_cast<int16_t>( tun_req.ifr_flags | IFF_VNET_HDR );
+  }
 
   // copy devname to ifr_name, making sure to null terminate
 
@@ -35,4 +45,19 @@ TunTapFD::TunTapFD( const string& devname, const bool is_tun )
   tun_req.ifr_name[IFNAMSIZ - 1] = '\0';
 
   CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETIFF, static_cast<void*>( &tun_req ) ) );
+
+  // With a virtio-net header, the kernel may hand us datagrams with their checksum left undone, and unsplit TSO
+  // datagrams. The offloads belong to the device rather than this fd, so turn them off again without one.
+  const unsigned int offloads = vnet_hdr ? TUN_F_CSUM | TUN_F_TSO4 : 0;
+  CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETOFFLOAD, offloads ) );
+}
+
+vector<TunFD> TunFD::open_queues( const string& devname, size_t count, bool vnet_hdr )
+{
+  vector<TunFD> queues;
+  queues.reserve( count );
+  for ( size_t i = 0; i < count; i++ ) {
+    queues.push_back( TunFD { devname, true, vnet_hdr } );
+  }
+  return queues;
 }
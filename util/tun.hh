@@ -2,7 +2,9 @@
 
 #include "file_descriptor.hh"
 
+#include <cstddef>
 #include <string>
+#include <vector>
 
 //! A FileDescriptor to a [Linux TUN/TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunTapFD : public FileDescriptor
@@ -10,15 +12,35 @@ class TunTapFD : public FileDescriptor
 public:
   //! Open an existing persistent [TUN or TAP
   //! device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunTapFD( const std::string& devname, bool is_tun );
+  explicit TunTapFD( const std::string& devname, bool is_tun, bool multi_queue = false, bool vnet_hdr = false );
+
+  //! Size of the virtio-net header (struct virtio_net_hdr) before each datagram, if vnet_hdr()
+  static constexpr size_t VNET_HDR_SIZE = 10;
+
+  //! Does each datagram read or written carry a virtio-net header, which enables checksum and TSO offloads?
+  bool vnet_hdr() const { return _vnet_hdr; }
+
+private:
+  bool _vnet_hdr;
 };
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunFD : public TunTapFD
 {
 public:
-  //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunFD( const std::string& devname ) : TunTapFD( devname, true ) {}
+  //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt),
+  //! optionally with virtio-net headers (see TunTapFD::vnet_hdr())
+  explicit TunFD( const std::string& devname, bool vnet_hdr = false ) : TunTapFD( devname, true, false, vnet_hdr )
+  {}
+
+  //! Open `count` queues of a persistent multi-queue TUN device. The kernel spreads the device's datagrams
+  //! across them, sending each flow to the queue that last wrote one of its datagrams.
+  static std::vector<TunFD> open_queues( const std::string& devname, size_t count, bool vnet_hdr = false );
+
+private:
+  TunFD( const std::string& devname, bool multi_queue, bool vnet_hdr )
+    : TunTapFD( devname, true, multi_queue, vnet_hdr )
+  {}
 };
 
 //! A FileDescriptor to a [Linux TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -1,21 +1,259 @@
 #include "tuntap_adapter.hh"
+#include "exception.hh"
 #include "parser.hh"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
 using namespace std;
 
+namespace {
+
+//! struct virtio_net_hdr, as defined in <linux/virtio_net.h> (which doesn't compile as C++)
+struct VirtioNetHeader
+{
+  static constexpr uint8_t F_NEEDS_CSUM = 1; //!< The device is to complete the checksum
+  static constexpr uint8_t F_DATA_VALID = 2; //!< The checksum has been checked
+  static constexpr uint8_t GSO_TCPV4 = 1;    //!< The datagram is a TCP segment to be split into gso_size pieces
+
+  uint8_t flags;
+  uint8_t gso_type;
+  uint16_t hdr_len;     //!< Length of the IPv4 and TCP headers, which each piece gets a copy of
+  uint16_t gso_size;    //!< Payload of each piece
+  uint16_t csum_start;  //!< Where checksumming starts
+  uint16_t csum_offset; //!< Where the checksum goes, after csum_start
+};
+static_assert( sizeof( VirtioNetHeader ) == TunTapFD::VNET_HDR_SIZE );
+
+constexpr size_t MAX_DATAGRAM_SIZE = 65535;
+constexpr uint16_t TCP_CHECKSUM_OFFSET = 16; // of the checksum field, from the start of the TCP header
+
+//! The virtio-net header to write before a datagram of `size` bytes that carries `seg`: the kernel completes
+//! its TCP checksum, and splits it into segments of `segment_size` if its payload is larger
+VirtioNetHeader vnet_header( size_t size, const TCPMessage& seg, optional<uint16_t> segment_size )
+{
+  VirtioNetHeader hdr {};
+  hdr.flags = VirtioNetHeader::F_NEEDS_CSUM;
+  hdr.csum_start = IPv4Header::LENGTH;
+  hdr.csum_offset = TCP_CHECKSUM_OFFSET;
+  const size_t payload_size = seg.sender.payload.size();
+  if ( segment_size.has_value() and payload_size > segment_size.value() ) {
+    hdr.gso_type = VirtioNetHeader::GSO_TCPV4;
+    hdr.gso_size = segment_size.value();
+    hdr.hdr_len = static_cast<uint16_t>( size - payload_size );
+  }
+  return hdr;
+}
+
+//! Has the kernel taken care of the checksum of the datagram that followed this virtio-net header?
+bool checksum_offloaded( string_view header )
+{
+  VirtioNetHeader hdr {};
+  memcpy( &hdr, header.data(), min( header.size(), sizeof( hdr ) ) );
+  return hdr.flags & ( VirtioNetHeader::F_NEEDS_CSUM | VirtioNetHeader::F_DATA_VALID );
+}
+
+//! Wrap a segment in an IPv4 datagram for a TUN device, behind a virtio-net header if it uses them
+PacketBuffer serialize_for_tun( TCPOverIPv4Adapter& adapter, const TCPMessage& seg, bool vnet_hdr )
+{
+  PacketBuffer datagram;
+  adapter.wrap_tcp_in_ip( seg, datagram, vnet_hdr );
+  if ( vnet_hdr ) {
+    const VirtioNetHeader hdr = vnet_header( datagram.size(), seg, adapter.segment_size() );
+    memcpy( datagram.prepend( sizeof( hdr ) ).data(), &hdr, sizeof( hdr ) );
+  }
+  return datagram;
+}
+
+//! Parse a datagram read from a TUN device, behind a virtio-net header if it uses them
+optional<TCPMessage> parse_from_tun( TCPOverIPv4Adapter& adapter, PacketBuffer& datagram, bool vnet_hdr )
+{
+  bool offloaded = false;
+  if ( vnet_hdr ) {
+    offloaded = checksum_offloaded( datagram.view().substr( 0, TunTapFD::VNET_HDR_SIZE ) );
+    datagram.remove_prefix( TunTapFD::VNET_HDR_SIZE );
+  }
+  return adapter.unwrap_tcp_in_ip( datagram, offloaded );
+}
+
+} // namespace
+
+TCPOverIPv4OverTunFdAdapter::TCPOverIPv4OverTunFdAdapter( TunFD&& tun ) : _tun( std::move( tun ) )
+{
+  _tun.set_blocking( false );
+}
+
+bool TCPOverIPv4OverTunFdAdapter::_read( optional<TCPMessage>& seg )
+{
+  // an unsplit TSO datagram may fill an IPv4 datagram, behind its virtio-net header
+  PacketBuffer datagram;
+  const span<char> room = datagram.append( TunTapFD::VNET_HDR_SIZE + MAX_DATAGRAM_SIZE );
+  const size_t size = _tun.read( room );
+  if ( size == 0 ) {
+    return false;
+  }
+  datagram.remove_suffix( room.size() - size );
+
+  seg = parse_from_tun( *this, datagram, _tun.vnet_hdr() );
+  return true;
+}
+
 optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::read()
 {
-  vector<string> strs( 2 );
-  strs.front().resize( IPv4Header::LENGTH );
-  _tun.read( strs );
+  optional<TCPMessage> seg;
+  _read( seg );
+  return seg;
+}
 
-  InternetDatagram ip_dgram;
-  const vector<string> buffers = { strs.at( 0 ), strs.at( 1 ) };
-  if ( parse( ip_dgram, buffers ) ) {
-    return unwrap_tcp_in_ip( ip_dgram );
+void TCPOverIPv4OverTunFdAdapter::write( const TCPMessage& seg )
+{
+  _tun.write( serialize_for_tun( *this, seg, _tun.vnet_hdr() ).view() );
+}
+
+vector<TCPMessage> TCPOverIPv4OverTunFdAdapter::read_batch( size_t max )
+{
+  vector<TCPMessage> segs;
+  optional<TCPMessage> seg;
+  for ( size_t i = 0; i < max and _read( seg ); i++ ) {
+    if ( seg.has_value() ) {
+      segs.push_back( std::move( seg.value() ) );
+    }
+  }
+  return segs;
+}
+
+void TCPOverIPv4OverTunFdAdapter::write_batch( span<const TCPMessage> segs )
+{
+  // a TUN device takes exactly one datagram per write
+  for ( const auto& seg : segs ) {
+    write( seg );
   }
-  return {};
 }
 
 //! Specialize LossyFdAdapter to TCPOverIPv4OverTunFdAdapter
 template class LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>;
+
+TCPOverIPv4OverTunUringAdapter::IO::IO( TunFD&& s_tun )
+  : tun( std::move( s_tun ) )
+  , arena( READ_DEPTH * READ_SIZE + WRITE_DEPTH * WRITE_SIZE )
+  , ring( READ_DEPTH + WRITE_DEPTH )
+{
+  // non-blocking, so the ring waits for readiness instead of parking a kernel worker thread in each read
+  tun.set_blocking( false );
+  ring.register_buffers( { span { arena } } );
+  for ( size_t i = WRITE_DEPTH; i > 0; i-- ) {
+    free_writes.push_back( i - 1 );
+  }
+  for ( size_t i = 0; i < READ_DEPTH; i++ ) {
+    post_read( i );
+  }
+}
+
+TCPOverIPv4OverTunUringAdapter::IO::~IO()
+{
+  try {
+    // let queued and in-flight writes finish; the posted reads are cancelled when the ring closes
+    ring.submit();
+    while ( writes_in_flight > 0 ) {
+      ring.wait();
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception destructing TCPOverIPv4OverTunUringAdapter: " << e.what() << endl;
+  }
+}
+
+span<char> TCPOverIPv4OverTunUringAdapter::IO::read_buffer( size_t index )
+{
+  return span { arena }.subspan( index * READ_SIZE, READ_SIZE );
+}
+
+span<char> TCPOverIPv4OverTunUringAdapter::IO::write_buffer( size_t index )
+{
+  return span { arena }.subspan( READ_DEPTH * READ_SIZE + index * WRITE_SIZE, WRITE_SIZE );
+}
+
+void TCPOverIPv4OverTunUringAdapter::IO::post_read( size_t index )
+{
+  ring.read(
+    tun,
+    read_buffer( index ),
+    [this, index]( int32_t result ) {
+      if ( result < 0 and result != -EINTR and result != -EAGAIN ) {
+        throw unix_error( "io_uring read from TUN device", -result );
+      }
+      if ( result > 0 ) {
+        received.emplace_back().append( { read_buffer( index ).data(), static_cast<size_t>( result ) } );
+      }
+      post_read( index );
+    },
+    0 );
+}
+
+TCPOverIPv4OverTunUringAdapter::TCPOverIPv4OverTunUringAdapter( TunFD&& tun )
+  : _io( make_unique<IO>( std::move( tun ) ) )
+{}
+
+optional<TCPMessage> TCPOverIPv4OverTunUringAdapter::read()
+{
+  if ( _io->received.empty() ) {
+    _io->ring.reap();
+    if ( _io->received.empty() ) {
+      return {};
+    }
+  }
+
+  PacketBuffer datagram = std::move( _io->received.front() );
+  _io->received.pop_front();
+  return parse_from_tun( *this, datagram, _io->tun.vnet_hdr() );
+}
+
+vector<TCPMessage> TCPOverIPv4OverTunUringAdapter::read_batch( size_t max )
+{
+  vector<TCPMessage> segs;
+  _io->ring.reap();
+  for ( size_t i = 0; i < max and not _io->received.empty(); i++ ) {
+    if ( auto seg = read() ) {
+      segs.push_back( std::move( seg.value() ) );
+    }
+  }
+  return segs;
+}
+
+void TCPOverIPv4OverTunUringAdapter::write_batch( span<const TCPMessage> segs )
+{
+  for ( const auto& seg : segs ) {
+    write( seg );
+  }
+}
+
+void TCPOverIPv4OverTunUringAdapter::write( const TCPMessage& seg )
+{
+  const PacketBuffer datagram = serialize_for_tun( *this, seg, _io->tun.vnet_hdr() );
+
+  const auto done = [io = _io.get()]( int32_t result ) {
+    io->writes_in_flight--;
+    if ( result < 0 ) {
+      throw unix_error( "io_uring write to TUN device", -result );
+    }
+  };
+
+  _io->writes_in_flight++;
+  if ( datagram.size() <= WRITE_SIZE and not _io->free_writes.empty() ) {
+    const size_t index = _io->free_writes.back();
+    _io->free_writes.pop_back();
+    copy( datagram.view().begin(), datagram.view().end(), _io->write_buffer( index ).begin() );
+    _io->ring.write(
+      _io->tun,
+      { _io->write_buffer( index ).data(), datagram.size() },
+      [io = _io.get(), index, done]( int32_t result ) {
+        io->free_writes.push_back( index );
+        done( result );
+      },
+      0 );
+  } else {
+    // the callback holds a reference, which keeps the block alive until the write completes
+    _io->ring.write( _io->tun, datagram.view(), [datagram, done]( int32_t result ) { done( result ); } );
+  }
+}
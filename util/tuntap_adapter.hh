@@ -1,12 +1,19 @@
 #pragma once
 
+#include "io_uring.hh"
+#include "packet_buffer.hh"
 #include "tcp_over_ip.hh"
 #include "tcp_segment.hh"
 #include "tun.hh"
 
+#include <deque>
+#include <memory>
 #include <optional>
+#include <span>
+#include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 template<class T>
 concept TCPDatagramAdapter = requires( T a, TCPMessage seg )
@@ -21,20 +28,36 @@ concept TCPDatagramAdapter = requires( T a, TCPMessage seg )
 };
 
 //! \brief A FD adapter for IPv4 datagrams read from and written to a TUN device
+//! \details If the TunFD was opened with virtio-net headers, the adapter leaves each outgoing segment's
+//! checksum for the kernel to complete, and has the kernel split segments larger than segment_size() (as
+//! sent with TCPConfig::tso_size). Incoming datagrams may then be TCP segments of up to 64 KiB that the kernel
+//! hasn't split, and those whose checksum the kernel has taken care of aren't checked again.
 class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter
 {
 private:
   TunFD _tun;
 
+  //! Read one datagram from the TUN device, and set `seg` to its TCP segment if it's related to the current
+  //! connection
+  //! \returns false if the TUN device had nothing to read
+  bool _read( std::optional<TCPMessage>& seg );
+
 public:
-  //! Construct from a TunFD
-  explicit TCPOverIPv4OverTunFdAdapter( TunFD&& tun ) : _tun( std::move( tun ) ) {}
+  //! Construct from a TunFD, which is made non-blocking so read_batch() can drain it
+  explicit TCPOverIPv4OverTunFdAdapter( TunFD&& tun );
 
   //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
   std::optional<TCPMessage> read();
 
+  //! Reads datagrams until the TUN device has no more (or `max` have been read), and returns the TCP
+  //! segments among them that are related to the current connection
+  std::vector<TCPMessage> read_batch( size_t max );
+
   //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
-  void write( const TCPMessage& seg ) { _tun.write( serialize( wrap_tcp_in_ip( seg ) ) ); }
+  void write( const TCPMessage& seg );
+
+  //! Creates an IPv4 datagram from each TCP segment and writes them to the TUN device, in order
+  void write_batch( std::span<const TCPMessage> segs );
 
   //! Access the underlying TUN device
   explicit operator TunFD&() { return _tun; }
@@ -46,5 +69,88 @@ public:
   FileDescriptor& fd() { return _tun; }
 };
 
+//! \brief A FD adapter for IPv4 datagrams read from and written to a TUN device through io_uring
+//! \details Keeps a batch of reads posted on the TUN device at all times, and queues writes instead of
+//! making a system call for each one. Everything queued reaches the kernel in one io_uring_enter when the
+//! EventLoop that watches ring() next waits. Datagrams go through a registered buffer arena. Handles TUN
+//! devices with virtio-net headers as TCPOverIPv4OverTunFdAdapter does.
+class TCPOverIPv4OverTunUringAdapter : public TCPOverIPv4Adapter
+{
+public:
+  //! Construct from a TunFD, and start reading from it
+  explicit TCPOverIPv4OverTunUringAdapter( TunFD&& tun );
+
+  //! Parses the next datagram that has been read, if it contains a TCP segment related to the current
+  //! connection (collecting any finished reads first)
+  std::optional<TCPMessage> read();
+
+  //! Parses up to `max` datagrams that have been read, returning the TCP segments related to the current
+  //! connection
+  std::vector<TCPMessage> read_batch( size_t max );
+
+  //! Creates an IPv4 datagram from a TCP segment and queues a write of it to the TUN device
+  void write( const TCPMessage& seg );
+
+  //! Queues a write of each segment; all of them reach the kernel in the same io_uring_enter
+  void write_batch( std::span<const TCPMessage> segs );
+
+  //! Are datagrams waiting for read()?
+  bool pending() const { return not _io->received.empty(); }
+
+  //! The ring to register with an EventLoop, which runs its completions and submits its writes
+  IoUring& ring() { return _io->ring; }
+
+  //! Readable when reads or writes have finished
+  FileDescriptor& fd() { return _io->ring.completion_fd(); }
+
+private:
+  static constexpr size_t READ_DEPTH = 32;   //!< Reads kept posted on the TUN device
+  static constexpr size_t READ_SIZE = 65536 + TunTapFD::VNET_HDR_SIZE; //!< Room for any IPv4 datagram
+  static constexpr size_t WRITE_DEPTH = 128; //!< Registered buffers for queued writes
+  static constexpr size_t WRITE_SIZE = 2048; //!< Room for a datagram on a 1500-byte MTU; larger datagrams (or
+                                             //!< writes beyond WRITE_DEPTH) get a buffer of their own
+
+  //! Lives on the heap so in-flight requests stay valid when the adapter is moved
+  struct IO
+  {
+    TunFD tun;
+    std::vector<char> arena; //!< READ_DEPTH read buffers, then WRITE_DEPTH write buffers
+    std::vector<size_t> free_writes {};
+    std::deque<PacketBuffer> received {};
+    size_t writes_in_flight {};
+    IoUring ring; //!< declared last, so it is torn down before the buffers it uses
+
+    explicit IO( TunFD&& s_tun );
+    ~IO();
+    IO( const IO& other ) = delete;
+    IO& operator=( const IO& other ) = delete;
+    IO( IO&& other ) = delete;
+    IO& operator=( IO&& other ) = delete;
+
+    std::span<char> read_buffer( size_t index );
+    std::span<char> write_buffer( size_t index );
+    void post_read( size_t index );
+  };
+
+  std::unique_ptr<IO> _io;
+};
+
+//! An adapter that can also move many segments per call
+template<class T>
+concept TCPDatagramBatchAdapter = TCPDatagramAdapter<T> and requires( T a, std::span<const TCPMessage> segs )
+{
+  {
+    a.write_batch( segs )
+    } -> std::same_as<void>;
+
+  {
+    a.read_batch( size_t {} )
+    } -> std::same_as<std::vector<TCPMessage>>;
+};
+
 static_assert( TCPDatagramAdapter<TCPOverIPv4OverTunFdAdapter> );
+static_assert( TCPDatagramAdapter<TCPOverIPv4OverTunUringAdapter> );
 static_assert( TCPDatagramAdapter<LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>> );
+static_assert( TCPDatagramBatchAdapter<TCPOverIPv4OverTunFdAdapter> );
+static_assert( TCPDatagramBatchAdapter<TCPOverIPv4OverTunUringAdapter> );
+static_assert( TCPDatagramBatchAdapter<LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>> );